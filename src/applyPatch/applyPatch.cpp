@@ -0,0 +1,16 @@
+#include <sdw.h>
+#include "patcher.h"
+
+int UMain(int argc, UChar* argv[])
+{
+	if (argc != 3 && argc != 4)
+	{
+		return 1;
+	}
+	CPatcher patcher;
+	if (!patcher.Load(argv[1]))
+	{
+		return 1;
+	}
+	return patcher.Apply(argv[2], argc == 4 ? argv[3] : nullptr) ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+#include "patcher.h"
+#include "crc32.h"
+
+const u64 CPatcher::s_uChunkSize = 4 * 1024 * 1024;
+
+CPatcher::CPatcher()
+	: m_ePatchFormat(kPatchFormatUnknown)
+	, m_fpSource(nullptr)
+	, m_fpTarget(nullptr)
+	, m_uSourceSize(0)
+{
+}
+
+CPatcher::~CPatcher()
+{
+	close();
+}
+
+bool CPatcher::Load(const UChar* a_pPatchFileName)
+{
+	FILE* fp = UFopen(a_pPatchFileName, USTR("rb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	Fseek(fp, 0, SEEK_END);
+	u64 uSize = Ftell(fp);
+	Fseek(fp, 0, SEEK_SET);
+	m_vPatch.resize(static_cast<size_t>(uSize));
+	bool bResult = uSize == 0 || fread(&*m_vPatch.begin(), 1, static_cast<size_t>(uSize), fp) == uSize;
+	fclose(fp);
+	if (!bResult)
+	{
+		return false;
+	}
+	m_ePatchFormat = DetectPatchFormat(m_vPatch.empty() ? nullptr : &*m_vPatch.begin(), m_vPatch.size());
+	return m_ePatchFormat != kPatchFormatUnknown;
+}
+
+EPatchFormat CPatcher::GetPatchFormat() const
+{
+	return m_ePatchFormat;
+}
+
+bool CPatcher::Apply(const UChar* a_pFileName, const UChar* a_pOutputFileName)
+{
+	close();
+	m_vBuffer.resize(static_cast<size_t>(s_uChunkSize));
+	if (a_pOutputFileName == nullptr)
+	{
+		m_fpTarget = UFopen(a_pFileName, USTR("r+b"), false);
+		if (m_fpTarget == nullptr)
+		{
+			return false;
+		}
+		Fseek(m_fpTarget, 0, SEEK_END);
+		m_uSourceSize = Ftell(m_fpTarget);
+	}
+	else
+	{
+		m_fpSource = UFopen(a_pFileName, USTR("rb"), false);
+		if (m_fpSource == nullptr)
+		{
+			return false;
+		}
+		m_fpTarget = UFopen(a_pOutputFileName, USTR("w+b"), false);
+		if (m_fpTarget == nullptr)
+		{
+			close();
+			return false;
+		}
+		Fseek(m_fpSource, 0, SEEK_END);
+		m_uSourceSize = Ftell(m_fpSource);
+		Fseek(m_fpSource, 0, SEEK_SET);
+		for (u64 uOffset = 0; uOffset < m_uSourceSize; uOffset += s_uChunkSize)
+		{
+			size_t uSize = static_cast<size_t>(min<u64>(s_uChunkSize, m_uSourceSize - uOffset));
+			if (fread(&*m_vBuffer.begin(), 1, uSize, m_fpSource) != uSize || fwrite(&*m_vBuffer.begin(), 1, uSize, m_fpTarget) != uSize)
+			{
+				close();
+				return false;
+			}
+		}
+	}
+	bool bResult = false;
+	switch (m_ePatchFormat)
+	{
+	case kPatchFormatDelta:
+		bResult = applyDelta();
+		break;
+	case kPatchFormatIps:
+		bResult = applyIps();
+		break;
+	case kPatchFormatBps:
+		bResult = applyBps();
+		break;
+	default:
+		break;
+	}
+	if (fflush(m_fpTarget) != 0)
+	{
+		bResult = false;
+	}
+	close();
+	return bResult;
+}
+
+bool CPatcher::applyDelta()
+{
+	const u8* pPatch = &*m_vPatch.begin();
+	u64 uPatchSize = m_vPatch.size();
+	u64 uOffset = sizeof(c_szDeltaMagic);
+	u64 uOldSize = 0;
+	u64 uNewSize = 0;
+	if (uPatchSize < uOffset + 12 || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uOldSize) || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uNewSize) || !checkCrc(uOldSize))
+	{
+		return false;
+	}
+	u64 uPosition = 0;
+	for (;;)
+	{
+		u64 uSkip = 0;
+		u64 uSizeFill = 0;
+		if (!ReadVarInt(pPatch, uPatchSize - 12, uOffset, uSkip) || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uSizeFill))
+		{
+			return false;
+		}
+		if (uSkip == 0 && uSizeFill == 0)
+		{
+			break;
+		}
+		uPosition += uSkip;
+		u64 uSize = uSizeFill >> 1;
+		bool bFill = (uSizeFill & 1) != 0;
+		u64 uDataSize = bFill ? 1 : uSize;
+		if (uPatchSize - 12 - uOffset < uDataSize || uPosition + uSize > uNewSize)
+		{
+			return false;
+		}
+		if (!(bFill ? fill(uPosition, pPatch[uOffset], uSize) : write(uPosition, pPatch + uOffset, uSize)))
+		{
+			return false;
+		}
+		uOffset += uDataSize;
+		uPosition += uSize;
+	}
+	u32 uNewCrc = 0;
+	memcpy(&uNewCrc, pPatch + uPatchSize - 8, 4);
+	u32 uCrc = 0;
+	return SetFileSize(m_fpTarget, uNewSize) && getCrc(m_fpTarget, uNewSize, uCrc) && uCrc == uNewCrc;
+}
+
+bool CPatcher::applyIps()
+{
+	const u8* pPatch = &*m_vPatch.begin();
+	u64 uPatchSize = m_vPatch.size();
+	u64 uOffset = sizeof(c_szIpsMagic);
+	for (;;)
+	{
+		if (uPatchSize - uOffset < 3)
+		{
+			return false;
+		}
+		if (memcmp(pPatch + uOffset, c_szIpsEnd, sizeof(c_szIpsEnd)) == 0)
+		{
+			uOffset += sizeof(c_szIpsEnd);
+			break;
+		}
+		if (uPatchSize - uOffset < 5)
+		{
+			return false;
+		}
+		u64 uPosition = pPatch[uOffset] << 16 | pPatch[uOffset + 1] << 8 | pPatch[uOffset + 2];
+		u64 uSize = pPatch[uOffset + 3] << 8 | pPatch[uOffset + 4];
+		uOffset += 5;
+		if (uSize == 0)
+		{
+			if (uPatchSize - uOffset < 3)
+			{
+				return false;
+			}
+			uSize = pPatch[uOffset] << 8 | pPatch[uOffset + 1];
+			if (!fill(uPosition, pPatch[uOffset + 2], uSize))
+			{
+				return false;
+			}
+			uOffset += 3;
+		}
+		else
+		{
+			if (uPatchSize - uOffset < uSize || !write(uPosition, pPatch + uOffset, uSize))
+			{
+				return false;
+			}
+			uOffset += uSize;
+		}
+	}
+	// the truncation extension
+	if (uPatchSize - uOffset >= 3)
+	{
+		u64 uSize = pPatch[uOffset] << 16 | pPatch[uOffset + 1] << 8 | pPatch[uOffset + 2];
+		return SetFileSize(m_fpTarget, uSize);
+	}
+	return true;
+}
+
+bool CPatcher::applyBps()
+{
+	const u8* pPatch = &*m_vPatch.begin();
+	u64 uPatchSize = m_vPatch.size();
+	u64 uOffset = sizeof(c_szBpsMagic);
+	u64 uSourceSize = 0;
+	u64 uTargetSize = 0;
+	u64 uMetadataSize = 0;
+	if (uPatchSize < uOffset + 12 || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uSourceSize) || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uTargetSize) || !ReadVarInt(pPatch, uPatchSize - 12, uOffset, uMetadataSize))
+	{
+		return false;
+	}
+	if (uPatchSize - 12 - uOffset < uMetadataSize || !checkCrc(uSourceSize))
+	{
+		return false;
+	}
+	uOffset += uMetadataSize;
+	u64 uPosition = 0;
+	u64 uSourceOffset = 0;
+	u64 uTargetOffset = 0;
+	while (uOffset < uPatchSize - 12)
+	{
+		u64 uAction = 0;
+		if (!ReadVarInt(pPatch, uPatchSize - 12, uOffset, uAction))
+		{
+			return false;
+		}
+		u64 uSize = (uAction >> 2) + 1;
+		if (uPosition + uSize > uTargetSize)
+		{
+			return false;
+		}
+		switch (uAction & 3)
+		{
+		case kBpsActionSourceRead:
+			// the target starts as a copy of the source and nothing behind uPosition was written yet
+			if (uPosition + uSize > uSourceSize)
+			{
+				return false;
+			}
+			break;
+		case kBpsActionTargetRead:
+			if (uPatchSize - 12 - uOffset < uSize || !write(uPosition, pPatch + uOffset, uSize))
+			{
+				return false;
+			}
+			uOffset += uSize;
+			break;
+		case kBpsActionSourceCopy:
+		case kBpsActionTargetCopy:
+			{
+				u64 uDelta = 0;
+				if (!ReadVarInt(pPatch, uPatchSize - 12, uOffset, uDelta))
+				{
+					return false;
+				}
+				bool bSource = (uAction & 3) == kBpsActionSourceCopy;
+				u64& uRelativeOffset = bSource ? uSourceOffset : uTargetOffset;
+				uRelativeOffset += (uDelta & 1) != 0 ? 0 - (uDelta >> 1) : uDelta >> 1;
+				if (bSource)
+				{
+					if (uRelativeOffset + uSize > uSourceSize)
+					{
+						return false;
+					}
+					// in place the source before uPosition is gone
+					if (m_fpSource == nullptr && uRelativeOffset < uPosition)
+					{
+						printf("SourceCopy needs an output file\n");
+						return false;
+					}
+					if (!copy(m_fpSource != nullptr ? m_fpSource : m_fpTarget, uRelativeOffset, uPosition, uSize))
+					{
+						return false;
+					}
+				}
+				else if (uRelativeOffset >= uPosition || !copy(m_fpTarget, uRelativeOffset, uPosition, uSize))
+				{
+					return false;
+				}
+				uRelativeOffset += uSize;
+			}
+			break;
+		}
+		uPosition += uSize;
+	}
+	if (uPosition != uTargetSize)
+	{
+		return false;
+	}
+	u32 uTargetCrc = 0;
+	memcpy(&uTargetCrc, pPatch + uPatchSize - 8, 4);
+	u32 uCrc = 0;
+	return SetFileSize(m_fpTarget, uTargetSize) && getCrc(m_fpTarget, uTargetSize, uCrc) && uCrc == uTargetCrc;
+}
+
+bool CPatcher::checkCrc(u64 a_uSourceSize)
+{
+	u64 uPatchSize = m_vPatch.size();
+	CCrc32 patchCrc;
+	patchCrc.Update(&*m_vPatch.begin(), static_cast<size_t>(uPatchSize - 4));
+	u32 uPatchCrc = 0;
+	u32 uSourceCrc = 0;
+	memcpy(&uPatchCrc, &*m_vPatch.begin() + uPatchSize - 4, 4);
+	memcpy(&uSourceCrc, &*m_vPatch.begin() + uPatchSize - 12, 4);
+	if (patchCrc.GetValue() != uPatchCrc)
+	{
+		printf("patch checksum mismatch\n");
+		return false;
+	}
+	u32 uCrc = 0;
+	if (a_uSourceSize != m_uSourceSize || !getCrc(m_fpTarget, a_uSourceSize, uCrc) || uCrc != uSourceCrc)
+	{
+		printf("the file is not the one the patch was made for\n");
+		return false;
+	}
+	return true;
+}
+
+bool CPatcher::getCrc(FILE* a_fpFile, u64 a_uSize, u32& a_uCrc)
+{
+	CCrc32 crc;
+	if (Fseek(a_fpFile, 0, SEEK_SET) != 0)
+	{
+		return false;
+	}
+	for (u64 uOffset = 0; uOffset < a_uSize; uOffset += s_uChunkSize)
+	{
+		size_t uSize = static_cast<size_t>(min<u64>(s_uChunkSize, a_uSize - uOffset));
+		if (fread(&*m_vBuffer.begin(), 1, uSize, a_fpFile) != uSize)
+		{
+			return false;
+		}
+		crc.Update(&*m_vBuffer.begin(), uSize);
+	}
+	a_uCrc = crc.GetValue();
+	return true;
+}
+
+bool CPatcher::write(u64 a_uOffset, const u8* a_pData, u64 a_uSize)
+{
+	return Fseek(m_fpTarget, static_cast<n64>(a_uOffset), SEEK_SET) == 0 && fwrite(a_pData, 1, static_cast<size_t>(a_uSize), m_fpTarget) == a_uSize;
+}
+
+bool CPatcher::fill(u64 a_uOffset, u8 a_uValue, u64 a_uSize)
+{
+	memset(&*m_vBuffer.begin(), a_uValue, static_cast<size_t>(min<u64>(s_uChunkSize, a_uSize)));
+	for (u64 uOffset = 0; uOffset < a_uSize; uOffset += s_uChunkSize)
+	{
+		if (!write(a_uOffset + uOffset, &*m_vBuffer.begin(), min<u64>(s_uChunkSize, a_uSize - uOffset)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CPatcher::copy(FILE* a_fpFile, u64 a_uFromOffset, u64 a_uToOffset, u64 a_uSize)
+{
+	u64 uPieceSize = s_uChunkSize;
+	if (a_fpFile == m_fpTarget && a_uFromOffset < a_uToOffset)
+	{
+		uPieceSize = min<u64>(uPieceSize, a_uToOffset - a_uFromOffset);
+	}
+	for (u64 uOffset = 0; uOffset < a_uSize; uOffset += uPieceSize)
+	{
+		size_t uSize = static_cast<size_t>(min<u64>(uPieceSize, a_uSize - uOffset));
+		if (Fseek(a_fpFile, static_cast<n64>(a_uFromOffset + uOffset), SEEK_SET) != 0 || fread(&*m_vBuffer.begin(), 1, uSize, a_fpFile) != uSize)
+		{
+			return false;
+		}
+		if (!write(a_uToOffset + uOffset, &*m_vBuffer.begin(), uSize))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void CPatcher::close()
+{
+	if (m_fpSource != nullptr)
+	{
+		fclose(m_fpSource);
+		m_fpSource = nullptr;
+	}
+	if (m_fpTarget != nullptr)
+	{
+		fclose(m_fpTarget);
+		m_fpTarget = nullptr;
+	}
+}
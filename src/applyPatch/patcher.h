@@ -0,0 +1,40 @@
+#ifndef PATCHER_H_
+#define PATCHER_H_
+
+#include <sdw.h>
+#include "patchformat.h"
+
+// applies a delta, IPS or BPS patch, the patch is read whole and the target file is patched in place through stdio
+class CPatcher
+{
+public:
+	CPatcher();
+	~CPatcher();
+	bool Load(const UChar* a_pPatchFileName);
+	EPatchFormat GetPatchFormat() const;
+	// a_pOutputFileName nullptr patches a_pFileName in place, otherwise it is copied first and stays the source of BPS SourceCopy
+	bool Apply(const UChar* a_pFileName, const UChar* a_pOutputFileName);
+	static const u64 s_uChunkSize;
+private:
+	CPatcher(const CPatcher&);
+	CPatcher& operator=(const CPatcher&);
+	bool applyDelta();
+	bool applyIps();
+	bool applyBps();
+	// checks the trailing CRC-32 of the patch itself and that the file still is the old one
+	bool checkCrc(u64 a_uSourceSize);
+	bool getCrc(FILE* a_fpFile, u64 a_uSize, u32& a_uCrc);
+	bool write(u64 a_uOffset, const u8* a_pData, u64 a_uSize);
+	bool fill(u64 a_uOffset, u8 a_uValue, u64 a_uSize);
+	// copies front to back in pieces that never read bytes this copy still has to write
+	bool copy(FILE* a_fpFile, u64 a_uFromOffset, u64 a_uToOffset, u64 a_uSize);
+	void close();
+	vector<u8> m_vPatch;
+	EPatchFormat m_ePatchFormat;
+	FILE* m_fpSource;
+	FILE* m_fpTarget;
+	u64 m_uSourceSize;
+	vector<u8> m_vBuffer;
+};
+
+#endif	// PATCHER_H_
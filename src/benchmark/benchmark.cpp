@@ -0,0 +1,282 @@
+#include <sdw.h>
+#include <algorithm>
+#include "initemulator.h"
+#include "metrics.h"
+#include "pagedump.h"
+#include "diff.h"
+#include "patchwriter.h"
+#include "elfgenerator.h"
+
+// microseconds of one stage over all measured iterations
+struct SSeries
+{
+	string InstructionSet;
+	string Tool;
+	string Stage;
+	vector<u64> Time;
+};
+
+static void addTime(vector<SSeries>& a_vSeries, const string& a_sInstructionSet, const string& a_sTool, const string& a_sStage, u64 a_uTime)
+{
+	for (vector<SSeries>::iterator it = a_vSeries.begin(); it != a_vSeries.end(); ++it)
+	{
+		if (it->InstructionSet == a_sInstructionSet && it->Tool == a_sTool && it->Stage == a_sStage)
+		{
+			it->Time.push_back(a_uTime);
+			return;
+		}
+	}
+	SSeries series;
+	series.InstructionSet = a_sInstructionSet;
+	series.Tool = a_sTool;
+	series.Stage = a_sStage;
+	series.Time.push_back(a_uTime);
+	a_vSeries.push_back(series);
+}
+
+static void addStageTime(vector<SSeries>& a_vSeries, const string& a_sInstructionSet, const string& a_sTool, const CMetrics& a_Metrics)
+{
+	static const char* c_pStageName[] = { "load", "map", "emulate", "rollback", "write" };
+	for (n32 i = 0; i < 5; i++)
+	{
+		addTime(a_vSeries, a_sInstructionSet, a_sTool, c_pStageName[i], a_Metrics.GetStageTime(c_pStageName[i]));
+	}
+}
+
+static bool writeFile(const UString& a_sFileName, const string& a_sData)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("wb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	size_t uWriteSize = fwrite(a_sData.data(), 1, a_sData.size(), fp);
+	fclose(fp);
+	return uWriteSize == a_sData.size();
+}
+
+// the same calls as emuInit on a copy of the image, the output file is written in the write stage
+static bool runEmuInit(const string& a_sElf, const UString& a_sOutputFileName, n32 a_nParallel, CMetrics& a_Metrics, n32& a_nFoldedCount)
+{
+	string sElf = a_sElf;
+	CInitEmulator initEmulator;
+	initEmulator.SetCommitPolicy(kCommitPolicyData);
+	initEmulator.SetParallel(a_nParallel);
+	initEmulator.SetMetrics(&a_Metrics);
+	if (!initEmulator.Load(reinterpret_cast<const u8*>(sElf.data()), sElf.size()) || !initEmulator.IsSupported() || !initEmulator.Emulate() || !initEmulator.Serialize(reinterpret_cast<u8*>(&*sElf.begin())))
+	{
+		return false;
+	}
+	bool bResult = writeFile(a_sOutputFileName, sElf);
+	a_Metrics.EndStage();
+	a_nFoldedCount = static_cast<n32>(initEmulator.GetInvalidIndexSet().size());
+	return bResult;
+}
+
+// dumpInitMemory with a delta dump, only the new memory is written
+static bool runDumpInitMemory(const string& a_sElf, const UString& a_sOutputFileName, n32 a_nParallel, CMetrics& a_Metrics)
+{
+	CInitEmulator initEmulator;
+	initEmulator.SetCommitPolicy(kCommitPolicyAlways);
+	initEmulator.SetParallel(a_nParallel);
+	initEmulator.SetMetrics(&a_Metrics);
+	if (!initEmulator.Load(reinterpret_cast<const u8*>(a_sElf.data()), a_sElf.size()) || !initEmulator.IsSupported() || !initEmulator.Emulate())
+	{
+		return false;
+	}
+	a_Metrics.BeginStage("write");
+	CPageDump pageDump;
+	pageDump.SetMemory(initEmulator.GetMemoryAddress(), initEmulator.GetMemoryAddressMax(), &initEmulator.GetMemory());
+	bool bResult = pageDump.Write(a_sOutputFileName, &initEmulator.GetInitialMemory());
+	a_Metrics.EndStage();
+	return bResult;
+}
+
+// makePatchIdc has a single stage, the diff and the writer run interleaved
+static bool runMakePatchIdc(const UString& a_sOldFileName, const UString& a_sNewFileName, const UString& a_sPatchFileName, EPatchFormat a_ePatchFormat, u64& a_uTime)
+{
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	CDiff diff;
+	if (!diff.Open(a_sOldFileName.c_str(), a_sNewFileName.c_str()))
+	{
+		return false;
+	}
+	CPatchWriter* pWriter = CPatchWriter::Create(a_ePatchFormat);
+	pWriter->SetFileName(a_sPatchFileName.c_str());
+	pWriter->SetSize(diff.GetOldSize(), diff.GetNewSize());
+	if (a_ePatchFormat != kPatchFormatIdc)
+	{
+		diff.SetChunkCallback(&CPatchWriter::OnChunk);
+	}
+	bool bResult = diff.Run(&CPatchWriter::OnRun, pWriter);
+	bResult = pWriter->Close() && bResult;
+	delete pWriter;
+	diff.Close();
+	a_uTime = static_cast<u64>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count());
+	return bResult;
+}
+
+// the first a_nWarmup iterations fill the page cache and the allocator and are not recorded
+static bool benchmark(const SElfParameter& a_Parameter, const UString& a_sOutputDirName, n32 a_nIteration, n32 a_nWarmup, n32 a_nParallel, vector<SSeries>& a_vSeries)
+{
+	static const char* c_pPatchFormatName[] = { "idc", "delta", "ips", "bps" };
+	string sInstructionSet = GetInstructionSetName(a_Parameter.InstructionSet);
+	string sElf;
+	CElfGenerator generator;
+	if (!generator.Generate(a_Parameter, sElf))
+	{
+		return false;
+	}
+	UString sBaseName = a_sOutputDirName + USTR("/synthetic.") + U8ToU(sInstructionSet);
+	UString sElfFileName = sBaseName + USTR(".so");
+	UString sEmuInitFileName = sBaseName + USTR(".emu.so");
+	if (!writeFile(sElfFileName, sElf))
+	{
+		return false;
+	}
+	for (n32 i = 0; i < a_nWarmup + a_nIteration; i++)
+	{
+		bool bRecord = i >= a_nWarmup;
+		CMetrics emuInitMetrics;
+		n32 nFoldedCount = 0;
+		if (!runEmuInit(sElf, sEmuInitFileName, a_nParallel, emuInitMetrics, nFoldedCount))
+		{
+			printf("%s: emuInit failed\n", sInstructionSet.c_str());
+			return false;
+		}
+		if (i == 0)
+		{
+			printf("%s: %llu bytes, %d entries, %d folded into .data\n", sInstructionSet.c_str(), static_cast<unsigned long long>(sElf.size()), a_Parameter.EntryCount, nFoldedCount);
+		}
+		CMetrics dumpInitMemoryMetrics;
+		if (!runDumpInitMemory(sElf, sBaseName + USTR(".dump"), a_nParallel, dumpInitMemoryMetrics))
+		{
+			printf("%s: dumpInitMemory failed\n", sInstructionSet.c_str());
+			return false;
+		}
+		if (bRecord)
+		{
+			addStageTime(a_vSeries, sInstructionSet, "emuInit", emuInitMetrics);
+			addStageTime(a_vSeries, sInstructionSet, "dumpInitMemory", dumpInitMemoryMetrics);
+		}
+		for (n32 j = 0; j < 4; j++)
+		{
+			u64 uTime = 0;
+			if (!runMakePatchIdc(sElfFileName, sEmuInitFileName, sBaseName + USTR(".") + U8ToU(c_pPatchFormatName[j]), static_cast<EPatchFormat>(j), uTime))
+			{
+				printf("%s: makePatchIdc --format %s failed\n", sInstructionSet.c_str(), c_pPatchFormatName[j]);
+				return false;
+			}
+			if (bRecord)
+			{
+				addTime(a_vSeries, sInstructionSet, string("makePatchIdc ") + c_pPatchFormatName[j], "write", uTime);
+			}
+		}
+	}
+	return true;
+}
+
+// the median is the number to compare between runs, min and max show the noise
+static void printReport(const vector<SSeries>& a_vSeries)
+{
+	printf("%-6s %-20s %-8s %10s %10s %10s\n", "isa", "tool", "stage", "min(us)", "median(us)", "max(us)");
+	for (vector<SSeries>::const_iterator it = a_vSeries.begin(); it != a_vSeries.end(); ++it)
+	{
+		vector<u64> vTime = it->Time;
+		sort(vTime.begin(), vTime.end());
+		u64 uMedian = vTime.size() % 2 != 0 ? vTime[vTime.size() / 2] : (vTime[vTime.size() / 2 - 1] + vTime[vTime.size() / 2]) / 2;
+		printf("%-6s %-20s %-8s %10llu %10llu %10llu\n", it->InstructionSet.c_str(), it->Tool.c_str(), it->Stage.c_str(), static_cast<unsigned long long>(vTime.front()), static_cast<unsigned long long>(uMedian), static_cast<unsigned long long>(vTime.back()));
+	}
+}
+
+int UMain(int argc, UChar* argv[])
+{
+	// benchmark [--isa arm|thumb|arm64]... [--entries N] [--data-size N] [--bss-size N] [--loop N] [--relocations N] [--bss-interval N] [--base <hex>] [--iterations N] [--warmup N] [--parallel N] <output directory>
+	SElfParameter parameter;
+	vector<EInstructionSet> vInstructionSet;
+	n32 nIteration = 10;
+	n32 nWarmup = 1;
+	n32 nParallel = 0;
+	vector<UString> vArg;
+	for (n32 i = 1; i < argc; i++)
+	{
+		if (UCscmp(argv[i], USTR("--isa")) == 0 && i + 1 < argc)
+		{
+			EInstructionSet eInstructionSet = kInstructionSetARM;
+			if (!ParseInstructionSet(argv[++i], eInstructionSet))
+			{
+				return 1;
+			}
+			vInstructionSet.push_back(eInstructionSet);
+		}
+		else if (UCscmp(argv[i], USTR("--entries")) == 0 && i + 1 < argc)
+		{
+			parameter.EntryCount = SToN32(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--data-size")) == 0 && i + 1 < argc)
+		{
+			parameter.DataSize = SToU64(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--bss-size")) == 0 && i + 1 < argc)
+		{
+			parameter.BssSize = SToU64(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--loop")) == 0 && i + 1 < argc)
+		{
+			parameter.LoopCount = static_cast<u32>(SToU64(argv[++i]));
+		}
+		else if (UCscmp(argv[i], USTR("--relocations")) == 0 && i + 1 < argc)
+		{
+			parameter.RelocationCount = SToN32(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--bss-interval")) == 0 && i + 1 < argc)
+		{
+			parameter.BssInterval = SToN32(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--base")) == 0 && i + 1 < argc)
+		{
+			parameter.BaseAddress = SToU64(argv[++i], 16);
+		}
+		else if (UCscmp(argv[i], USTR("--iterations")) == 0 && i + 1 < argc)
+		{
+			nIteration = SToN32(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--warmup")) == 0 && i + 1 < argc)
+		{
+			nWarmup = SToN32(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--parallel")) == 0 && i + 1 < argc)
+		{
+			nParallel = SToN32(argv[++i]);
+		}
+		else if (argv[i][0] == USTR('-') && argv[i][1] == USTR('-'))
+		{
+			return 1;
+		}
+		else
+		{
+			vArg.push_back(argv[i]);
+		}
+	}
+	if (vArg.size() != 1 || nIteration <= 0 || nWarmup < 0)
+	{
+		return 1;
+	}
+	if (vInstructionSet.empty())
+	{
+		vInstructionSet.push_back(kInstructionSetARM);
+		vInstructionSet.push_back(kInstructionSetThumb);
+		vInstructionSet.push_back(kInstructionSetAArch64);
+	}
+	vector<SSeries> vSeries;
+	for (vector<EInstructionSet>::const_iterator it = vInstructionSet.begin(); it != vInstructionSet.end(); ++it)
+	{
+		parameter.InstructionSet = *it;
+		if (!benchmark(parameter, vArg[0], nIteration, nWarmup, nParallel, vSeries))
+		{
+			return 1;
+		}
+	}
+	printReport(vSeries);
+	return 0;
+}
@@ -0,0 +1,342 @@
+#include "elfgenerator.h"
+#include <elfio/elfio.hpp>
+#include "runner.h"
+
+using namespace ELFIO;
+
+bool ParseInstructionSet(const UString& a_sName, EInstructionSet& a_eInstructionSet)
+{
+	if (a_sName == USTR("arm"))
+	{
+		a_eInstructionSet = kInstructionSetARM;
+	}
+	else if (a_sName == USTR("thumb"))
+	{
+		a_eInstructionSet = kInstructionSetThumb;
+	}
+	else if (a_sName == USTR("arm64"))
+	{
+		a_eInstructionSet = kInstructionSetAArch64;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char* GetInstructionSetName(EInstructionSet a_eInstructionSet)
+{
+	switch (a_eInstructionSet)
+	{
+	case kInstructionSetARM:
+		return "arm";
+	case kInstructionSetThumb:
+		return "thumb";
+	case kInstructionSetAArch64:
+		return "arm64";
+	default:
+		return "unknown";
+	}
+}
+
+SElfParameter::SElfParameter()
+	: InstructionSet(kInstructionSetARM)
+	, EntryCount(256)
+	, DataSize(0x10000)
+	, BssSize(0x10000)
+	, LoopCount(1)
+	, RelocationCount(256)
+	, BssInterval(16)
+	, BaseAddress(0)
+{
+}
+
+const u64 CElfGenerator::s_uPageSize = 0x1000;
+const u64 CElfGenerator::s_uFunctionSize = 64;
+
+CElfGenerator::CElfGenerator()
+	: m_eInstructionSet(kInstructionSetARM)
+	, m_b64(false)
+	, m_uWordSize(4)
+	, m_uBaseAddress(0)
+	, m_pElf(nullptr)
+{
+}
+
+// .dynsym holds the null symbol only, every relocation is R_*_RELATIVE against it
+bool CElfGenerator::Generate(const SElfParameter& a_Parameter, string& a_sElf)
+{
+	if (a_Parameter.EntryCount <= 0 || a_Parameter.LoopCount == 0 || a_Parameter.RelocationCount < 0 || a_Parameter.BssInterval < 0 || a_Parameter.BaseAddress % s_uPageSize != 0)
+	{
+		return false;
+	}
+	m_eInstructionSet = a_Parameter.InstructionSet;
+	m_b64 = m_eInstructionSet == kInstructionSetAArch64;
+	m_uWordSize = m_b64 ? 8 : 4;
+	m_uBaseAddress = a_Parameter.BaseAddress;
+	m_pElf = &a_sElf;
+	u64 uHeaderSize = m_b64 ? 64 : 52;
+	u64 uProgramHeaderSize = m_b64 ? 56 : 32;
+	u64 uSectionHeaderSize = m_b64 ? 64 : 40;
+	u64 uSymbolSize = m_b64 ? 24 : 16;
+	u64 uRelocationSize = m_b64 ? 24 : 8;
+	u64 uEntryCount = static_cast<u64>(a_Parameter.EntryCount);
+	u64 uRelocationCount = uEntryCount + a_Parameter.RelocationCount;
+	// the executable segment: headers, .dynsym, .dynstr, .rel.dyn or .rela.dyn and .text
+	u64 uDynSymOffset = Align(uHeaderSize + 2 * uProgramHeaderSize, 8);
+	u64 uDynStrOffset = uDynSymOffset + uSymbolSize;
+	u64 uRelocationOffset = Align(uDynStrOffset + 1, 8);
+	u64 uTextOffset = Align(uRelocationOffset + uRelocationCount * uRelocationSize, s_uFunctionSize);
+	u64 uTextSize = uEntryCount * s_uFunctionSize;
+	// the writable segment: .init_array, .data and .bss, file offsets equal addresses less the base
+	u64 uInitArrayOffset = Align(uTextOffset + uTextSize, s_uPageSize);
+	u64 uInitArraySize = uEntryCount * m_uWordSize;
+	u64 uDataOffset = Align(uInitArrayOffset + uInitArraySize, 16);
+	u64 uDataSize = Align(max<u64>(a_Parameter.DataSize, (uEntryCount + a_Parameter.RelocationCount) * m_uWordSize), m_uWordSize);
+	u64 uBssAddress = Align(uDataOffset + uDataSize, 16);
+	u64 uBssSize = Align(a_Parameter.BssSize, m_uWordSize);
+	u64 uBssSlotCount = uBssSize / m_uWordSize;
+	if (!m_b64 && m_uBaseAddress + uBssAddress + uBssSize > 0xFFFFFFFF)
+	{
+		return false;
+	}
+	const char* pRelocationName = m_b64 ? ".rela.dyn" : ".rel.dyn";
+	string sShStrTab(1, '\0');
+	u32 uDynSymName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".dynsym", strlen(".dynsym") + 1);
+	u32 uDynStrName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".dynstr", strlen(".dynstr") + 1);
+	u32 uRelocationName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(pRelocationName, strlen(pRelocationName) + 1);
+	u32 uTextName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".text", strlen(".text") + 1);
+	u32 uInitArrayName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".init_array", strlen(".init_array") + 1);
+	u32 uDataName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".data", strlen(".data") + 1);
+	u32 uBssName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".bss", strlen(".bss") + 1);
+	u32 uShStrTabName = static_cast<u32>(sShStrTab.size());
+	sShStrTab.append(".shstrtab", strlen(".shstrtab") + 1);
+	u64 uShStrTabOffset = uDataOffset + uDataSize;
+	u64 uSectionHeaderOffset = Align(uShStrTabOffset + sShStrTab.size(), 8);
+	const u16 c_uSectionCount = 9;
+	a_sElf.assign(static_cast<size_t>(uSectionHeaderOffset + c_uSectionCount * uSectionHeaderSize), '\0');
+	// ELF header
+	a_sElf[0] = ELFMAG0;
+	a_sElf[1] = ELFMAG1;
+	a_sElf[2] = ELFMAG2;
+	a_sElf[3] = ELFMAG3;
+	a_sElf[4] = m_b64 ? ELFCLASS64 : ELFCLASS32;
+	a_sElf[5] = ELFDATA2LSB;
+	a_sElf[6] = EV_CURRENT;
+	a_sElf[7] = ELFOSABI_NONE;
+	writeU16(EI_NIDENT, ET_DYN);
+	writeU16(EI_NIDENT + 2, static_cast<u16>(m_b64 ? kMachineAARCH64 : kMachineARM));
+	writeU32(EI_NIDENT + 4, EV_CURRENT);
+	u64 uOffset = EI_NIDENT + 8;
+	// e_entry stays 0
+	uOffset += m_uWordSize;
+	writeWord(uOffset, uHeaderSize);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, uSectionHeaderOffset);
+	uOffset += m_uWordSize;
+	// EF_ARM_EABI_VER5
+	writeU32(uOffset, m_b64 ? 0 : 0x05000000);
+	writeU16(uOffset + 4, static_cast<u16>(uHeaderSize));
+	writeU16(uOffset + 6, static_cast<u16>(uProgramHeaderSize));
+	writeU16(uOffset + 8, 2);
+	writeU16(uOffset + 10, static_cast<u16>(uSectionHeaderSize));
+	writeU16(uOffset + 12, c_uSectionCount);
+	writeU16(uOffset + 14, c_uSectionCount - 1);
+	writeProgramHeader(uHeaderSize, PT_LOAD, PF_R | PF_X, 0, uTextOffset + uTextSize, uTextOffset + uTextSize);
+	writeProgramHeader(uHeaderSize + uProgramHeaderSize, PT_LOAD, PF_R | PF_W, uInitArrayOffset, uDataOffset + uDataSize - uInitArrayOffset, uBssAddress + uBssSize - uInitArrayOffset);
+	// constructors, every Nth one writes .bss
+	vector<SRelocation> vRelocation;
+	for (u64 i = 0; i < uEntryCount; i++)
+	{
+		u64 uFunctionOffset = uTextOffset + i * s_uFunctionSize;
+		u64 uTargetAddress = m_uBaseAddress + uDataOffset + i * m_uWordSize;
+		if (a_Parameter.BssInterval != 0 && uBssSlotCount != 0 && (i + 1) % a_Parameter.BssInterval == 0)
+		{
+			uTargetAddress = m_uBaseAddress + uBssAddress + (i / a_Parameter.BssInterval % uBssSlotCount) * m_uWordSize;
+		}
+		writeFunction(uFunctionOffset, uTargetAddress, a_Parameter.LoopCount);
+		SRelocation relocation;
+		relocation.Offset = uInitArrayOffset + i * m_uWordSize;
+		relocation.Addend = (m_uBaseAddress + uFunctionOffset) | (m_eInstructionSet == kInstructionSetThumb ? 1 : 0);
+		vRelocation.push_back(relocation);
+	}
+	// a table of function pointers at the end of .data, out of reach of the constructors
+	for (n32 i = 0; i < a_Parameter.RelocationCount; i++)
+	{
+		SRelocation relocation;
+		relocation.Offset = uDataOffset + uDataSize - (a_Parameter.RelocationCount - i) * m_uWordSize;
+		relocation.Addend = vRelocation[i % uEntryCount].Addend;
+		vRelocation.push_back(relocation);
+	}
+	for (n32 i = 0; i < static_cast<n32>(vRelocation.size()); i++)
+	{
+		const SRelocation& relocation = vRelocation[i];
+		u64 uEntryOffset = uRelocationOffset + i * uRelocationSize;
+		if (m_b64)
+		{
+			// RELA, the word in the file stays 0 like the linkers leave it
+			writeU64(uEntryOffset, m_uBaseAddress + relocation.Offset);
+			writeU64(uEntryOffset + 8, 1027/* R_AARCH64_RELATIVE Adjust by program base. */);
+			writeU64(uEntryOffset + 16, relocation.Addend);
+		}
+		else
+		{
+			// REL, the addend is the word in the file
+			writeU32(uEntryOffset, static_cast<u32>(m_uBaseAddress + relocation.Offset));
+			writeU32(uEntryOffset + 4, 23/* R_ARM_RELATIVE Adjust by program base. */);
+			writeU32(relocation.Offset, static_cast<u32>(relocation.Addend));
+		}
+	}
+	memcpy(&*a_sElf.begin() + uShStrTabOffset, sShStrTab.data(), sShStrTab.size());
+	// section 0 stays null
+	u64 uSectionOffset = uSectionHeaderOffset + uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uDynSymName, SHT_DYNSYM, SHF_ALLOC, m_uBaseAddress + uDynSymOffset, uDynSymOffset, uSymbolSize, 2, 1, m_uWordSize, uSymbolSize);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uDynStrName, SHT_STRTAB, SHF_ALLOC, m_uBaseAddress + uDynStrOffset, uDynStrOffset, 1, 0, 0, 1, 0);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uRelocationName, m_b64 ? SHT_RELA : SHT_REL, SHF_ALLOC, m_uBaseAddress + uRelocationOffset, uRelocationOffset, uRelocationCount * uRelocationSize, 1, 0, m_uWordSize, uRelocationSize);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uTextName, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, m_uBaseAddress + uTextOffset, uTextOffset, uTextSize, 0, 0, s_uFunctionSize, 0);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uInitArrayName, SHT_INIT_ARRAY, SHF_ALLOC | SHF_WRITE, m_uBaseAddress + uInitArrayOffset, uInitArrayOffset, uInitArraySize, 0, 0, m_uWordSize, m_uWordSize);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uDataName, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, m_uBaseAddress + uDataOffset, uDataOffset, uDataSize, 0, 0, 16, 0);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uBssName, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, m_uBaseAddress + uBssAddress, uBssAddress, uBssSize, 0, 0, 16, 0);
+	uSectionOffset += uSectionHeaderSize;
+	writeSectionHeader(uSectionOffset, uShStrTabName, SHT_STRTAB, 0, 0, uShStrTabOffset, sShStrTab.size(), 0, 0, 1, 0);
+	m_pElf = nullptr;
+	return true;
+}
+
+// the same loop in each instruction set, its literal pool holds the target address and the loop count
+//   ldr r0, =target; ldr r2, =count; mov r1, #0; loop: add r1, r1, #1; subs r2, r2, #1; bne loop; str r1, [r0]; return
+void CElfGenerator::writeFunction(u64 a_uOffset, u64 a_uTargetAddress, u32 a_uLoopCount)
+{
+	static const u32 c_uARM[] = { 0xE59F0018, 0xE59F2018, 0xE3A01000, 0xE2811001, 0xE2522001, 0x1AFFFFFC, 0xE5801000, 0xE12FFF1E };
+	static const u16 c_uThumb[] = { 0x4803, 0x4A04, 0x2100, 0x3101, 0x3A01, 0xD1FC, 0x6001, 0x4770 };
+	static const u32 c_uAArch64[] = { 0x58000100, 0x58000122, 0xD2800001, 0x91000421, 0xF1000442, 0x54FFFFC1, 0xF9000001, 0xD65F03C0 };
+	const n32 c_nInstructionCount = 8;
+	switch (m_eInstructionSet)
+	{
+	case kInstructionSetARM:
+		for (n32 i = 0; i < c_nInstructionCount; i++)
+		{
+			writeU32(a_uOffset + i * 4, c_uARM[i]);
+		}
+		writeU32(a_uOffset + 32, static_cast<u32>(a_uTargetAddress));
+		writeU32(a_uOffset + 36, a_uLoopCount);
+		break;
+	case kInstructionSetThumb:
+		for (n32 i = 0; i < c_nInstructionCount; i++)
+		{
+			writeU16(a_uOffset + i * 2, c_uThumb[i]);
+		}
+		writeU32(a_uOffset + 16, static_cast<u32>(a_uTargetAddress));
+		writeU32(a_uOffset + 20, a_uLoopCount);
+		break;
+	case kInstructionSetAArch64:
+		for (n32 i = 0; i < c_nInstructionCount; i++)
+		{
+			writeU32(a_uOffset + i * 4, c_uAArch64[i]);
+		}
+		writeU64(a_uOffset + 32, a_uTargetAddress);
+		writeU64(a_uOffset + 40, a_uLoopCount);
+		break;
+	}
+}
+
+void CElfGenerator::writeU16(u64 a_uOffset, u16 a_uValue)
+{
+	for (n32 i = 0; i < 2; i++)
+	{
+		(*m_pElf)[static_cast<size_t>(a_uOffset + i)] = static_cast<char>(a_uValue >> (i * 8));
+	}
+}
+
+void CElfGenerator::writeU32(u64 a_uOffset, u32 a_uValue)
+{
+	for (n32 i = 0; i < 4; i++)
+	{
+		(*m_pElf)[static_cast<size_t>(a_uOffset + i)] = static_cast<char>(a_uValue >> (i * 8));
+	}
+}
+
+void CElfGenerator::writeU64(u64 a_uOffset, u64 a_uValue)
+{
+	for (n32 i = 0; i < 8; i++)
+	{
+		(*m_pElf)[static_cast<size_t>(a_uOffset + i)] = static_cast<char>(a_uValue >> (i * 8));
+	}
+}
+
+void CElfGenerator::writeWord(u64 a_uOffset, u64 a_uValue)
+{
+	if (m_b64)
+	{
+		writeU64(a_uOffset, a_uValue);
+	}
+	else
+	{
+		writeU32(a_uOffset, static_cast<u32>(a_uValue));
+	}
+}
+
+void CElfGenerator::writeSectionHeader(u64 a_uOffset, u32 a_uName, u32 a_uType, u64 a_uFlags, u64 a_uAddress, u64 a_uFileOffset, u64 a_uSize, u32 a_uLink, u32 a_uInfo, u64 a_uAlign, u64 a_uEntrySize)
+{
+	writeU32(a_uOffset, a_uName);
+	writeU32(a_uOffset + 4, a_uType);
+	u64 uOffset = a_uOffset + 8;
+	writeWord(uOffset, a_uFlags);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, a_uAddress);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, a_uFileOffset);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, a_uSize);
+	uOffset += m_uWordSize;
+	writeU32(uOffset, a_uLink);
+	writeU32(uOffset + 4, a_uInfo);
+	uOffset += 8;
+	writeWord(uOffset, a_uAlign);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, a_uEntrySize);
+}
+
+// the 64-bit header moves p_flags up next to p_type
+void CElfGenerator::writeProgramHeader(u64 a_uOffset, u32 a_uType, u32 a_uFlags, u64 a_uFileOffset, u64 a_uFileSize, u64 a_uMemorySize)
+{
+	writeU32(a_uOffset, a_uType);
+	u64 uOffset = a_uOffset + 4;
+	if (m_b64)
+	{
+		writeU32(uOffset, a_uFlags);
+		uOffset += 4;
+	}
+	// p_vaddr and p_paddr are p_offset moved up by the base
+	writeWord(uOffset, a_uFileOffset);
+	uOffset += m_uWordSize;
+	for (n32 i = 0; i < 2; i++)
+	{
+		writeWord(uOffset, m_uBaseAddress + a_uFileOffset);
+		uOffset += m_uWordSize;
+	}
+	writeWord(uOffset, a_uFileSize);
+	uOffset += m_uWordSize;
+	writeWord(uOffset, a_uMemorySize);
+	uOffset += m_uWordSize;
+	if (!m_b64)
+	{
+		writeU32(uOffset, a_uFlags);
+		uOffset += 4;
+	}
+	writeWord(uOffset, s_uPageSize);
+}
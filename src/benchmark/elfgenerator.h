@@ -0,0 +1,65 @@
+#ifndef ELFGENERATOR_H_
+#define ELFGENERATOR_H_
+
+#include <sdw.h>
+
+enum EInstructionSet
+{
+	kInstructionSetARM,
+	kInstructionSetThumb,
+	kInstructionSetAArch64
+};
+
+bool ParseInstructionSet(const UString& a_sName, EInstructionSet& a_eInstructionSet);
+const char* GetInstructionSetName(EInstructionSet a_eInstructionSet);
+
+struct SElfParameter
+{
+	SElfParameter();
+	EInstructionSet InstructionSet;
+	n32 EntryCount;
+	// grown to hold one word per entry and per relocation
+	u64 DataSize;
+	u64 BssSize;
+	// iterations of the loop in every constructor, 1 for trivial ones
+	u32 LoopCount;
+	// R_*_RELATIVE relocations into the end of .data, on top of the ones for .init_array
+	n32 RelocationCount;
+	// every Nth constructor writes .bss instead of .data and emuInit rolls it back, 0 for none
+	n32 BssInterval;
+	// where the image is linked, page aligned, above 4 GiB exercises the 64-bit address paths of arm64
+	u64 BaseAddress;
+};
+
+// little endian ET_DYN images linked at BaseAddress with one constructor per .init_array entry, the instructions are hand encoded so no toolchain is needed
+class CElfGenerator
+{
+public:
+	CElfGenerator();
+	bool Generate(const SElfParameter& a_Parameter, string& a_sElf);
+	static const u64 s_uPageSize;
+	// every constructor starts on this boundary, which keeps the literal pools aligned
+	static const u64 s_uFunctionSize;
+private:
+	struct SRelocation
+	{
+		u64 Offset;
+		u64 Addend;
+	};
+	// code of one constructor that stores the loop counter at a_uTargetAddress
+	void writeFunction(u64 a_uOffset, u64 a_uTargetAddress, u32 a_uLoopCount);
+	void writeU16(u64 a_uOffset, u16 a_uValue);
+	void writeU32(u64 a_uOffset, u32 a_uValue);
+	void writeU64(u64 a_uOffset, u64 a_uValue);
+	// 4 or 8 bytes by class
+	void writeWord(u64 a_uOffset, u64 a_uValue);
+	void writeSectionHeader(u64 a_uOffset, u32 a_uName, u32 a_uType, u64 a_uFlags, u64 a_uAddress, u64 a_uFileOffset, u64 a_uSize, u32 a_uLink, u32 a_uInfo, u64 a_uAlign, u64 a_uEntrySize);
+	void writeProgramHeader(u64 a_uOffset, u32 a_uType, u32 a_uFlags, u64 a_uFileOffset, u64 a_uFileSize, u64 a_uMemorySize);
+	EInstructionSet m_eInstructionSet;
+	bool m_b64;
+	u64 m_uWordSize;
+	u64 m_uBaseAddress;
+	string* m_pElf;
+};
+
+#endif	// ELFGENERATOR_H_
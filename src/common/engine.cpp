@@ -0,0 +1,74 @@
+#include "engine.h"
+
+const u64 CEngine::s_uStackAddress = 0x60000000;
+const u64 CEngine::s_uStackSize = 0x200000;
+const u64 CEngine::s_uStackPointer = 0x60100000;
+const u64 CEngine::s_uReturnAddress = 0x68000000;
+
+CEngine::CEngine()
+	: m_pUc(nullptr)
+	, m_pContext(nullptr)
+{
+}
+
+CEngine::~CEngine()
+{
+	if (m_pContext != nullptr)
+	{
+		uc_free(m_pContext);
+	}
+	if (m_pUc != nullptr)
+	{
+		uc_close(m_pUc);
+	}
+}
+
+uc_err CEngine::Open(uc_arch a_eArch, uc_mode a_eMode, const CMemoryImage& a_Memory, CMemoryImage& a_WritableMemory, string& a_sStack, n32 a_nSPRegId, n32 a_nLRRegId, n32 a_nPCRegId)
+{
+	uc_err eErr = uc_open(a_eArch, a_eMode, &m_pUc);
+	if (eErr != UC_ERR_OK)
+	{
+		m_pUc = nullptr;
+		return eErr;
+	}
+	const vector<SSegment>& vSegment = a_Memory.GetSegmentList();
+	for (vector<SSegment>::const_iterator it = vSegment.begin(); eErr == UC_ERR_OK && it != vSegment.end(); ++it)
+	{
+		// unicorn only reads through the pointer of a mapping without UC_PROT_WRITE
+		u8* pMemory = (it->Protection & UC_PROT_WRITE) != 0 ? a_WritableMemory.GetPointer(it->Address, it->Size) : a_Memory.GetPointer(it->Address, it->Size);
+		eErr = pMemory != nullptr ? uc_mem_map_ptr(m_pUc, it->Address, static_cast<size_t>(it->Size), it->Protection, pMemory) : UC_ERR_ARG;
+	}
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	eErr = uc_mem_map_ptr(m_pUc, s_uStackAddress, a_sStack.size(), UC_PROT_READ | UC_PROT_WRITE, &*a_sStack.begin());
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	u64 uSP = s_uStackPointer;
+	eErr = uc_reg_write(m_pUc, a_nSPRegId, &uSP);
+	u64 uLR = s_uReturnAddress;
+	eErr = uc_reg_write(m_pUc, a_nLRRegId, &uLR);
+	u64 uPC = 0x00000000;
+	eErr = uc_reg_write(m_pUc, a_nPCRegId, &uPC);
+	eErr = uc_context_alloc(m_pUc, &m_pContext);
+	if (eErr != UC_ERR_OK)
+	{
+		m_pContext = nullptr;
+		return eErr;
+	}
+	return uc_context_save(m_pUc, m_pContext);
+}
+
+uc_err CEngine::Reset()
+{
+	// every entry starts from the same registers, as if the engine were freshly opened
+	return uc_context_restore(m_pUc, m_pContext);
+}
+
+uc_engine* CEngine::GetUc() const
+{
+	return m_pUc;
+}
@@ -0,0 +1,28 @@
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <sdw.h>
+#include <unicorn/unicorn.h>
+#include "memoryimage.h"
+
+// one long-lived engine per instruction set, so translated blocks stay warm across all .init_array entries
+class CEngine
+{
+public:
+	CEngine();
+	~CEngine();
+	// the writable segments come from a_WritableMemory and the others from a_Memory, which any number of engines can share as the guest cannot write it
+	uc_err Open(uc_arch a_eArch, uc_mode a_eMode, const CMemoryImage& a_Memory, CMemoryImage& a_WritableMemory, string& a_sStack, n32 a_nSPRegId, n32 a_nLRRegId, n32 a_nPCRegId);
+	// the registers only, the owner of the stack clears what the last entry wrote there
+	uc_err Reset();
+	uc_engine* GetUc() const;
+	static const u64 s_uStackAddress;
+	static const u64 s_uStackSize;
+	static const u64 s_uStackPointer;
+	static const u64 s_uReturnAddress;
+private:
+	uc_engine* m_pUc;
+	uc_context* m_pContext;
+};
+
+#endif	// ENGINE_H_
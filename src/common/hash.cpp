@@ -0,0 +1,126 @@
+#include "hash.h"
+
+static const u64 s_uPrime1 = 0x9E3779B185EBCA87ULL;
+static const u64 s_uPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const u64 s_uPrime3 = 0x165667B19E3779F9ULL;
+static const u64 s_uPrime4 = 0x85EBCA77C2B2AE63ULL;
+static const u64 s_uPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline u64 rotateLeft(u64 a_uValue, n32 a_nShift)
+{
+	return (a_uValue << a_nShift) | (a_uValue >> (64 - a_nShift));
+}
+
+static inline u64 read64(const u8* a_pData)
+{
+	u64 uValue = 0;
+	memcpy(&uValue, a_pData, sizeof(uValue));
+	return uValue;
+}
+
+static inline u32 read32(const u8* a_pData)
+{
+	u32 uValue = 0;
+	memcpy(&uValue, a_pData, sizeof(uValue));
+	return uValue;
+}
+
+static inline u64 hashRound(u64 a_uAccumulator, u64 a_uInput)
+{
+	a_uAccumulator += a_uInput * s_uPrime2;
+	a_uAccumulator = rotateLeft(a_uAccumulator, 31);
+	return a_uAccumulator * s_uPrime1;
+}
+
+static inline u64 mergeRound(u64 a_uAccumulator, u64 a_uValue)
+{
+	a_uAccumulator ^= hashRound(0, a_uValue);
+	return a_uAccumulator * s_uPrime1 + s_uPrime4;
+}
+
+u64 Hash64(const void* a_pData, size_t a_uSize, u64 a_uSeed)
+{
+	const u8* pData = static_cast<const u8*>(a_pData);
+	const u8* pEnd = pData + a_uSize;
+	u64 uHash = 0;
+	if (a_uSize >= 32)
+	{
+		u64 uV1 = a_uSeed + s_uPrime1 + s_uPrime2;
+		u64 uV2 = a_uSeed + s_uPrime2;
+		u64 uV3 = a_uSeed;
+		u64 uV4 = a_uSeed - s_uPrime1;
+		const u8* pLimit = pEnd - 32;
+		do
+		{
+			uV1 = hashRound(uV1, read64(pData));
+			uV2 = hashRound(uV2, read64(pData + 8));
+			uV3 = hashRound(uV3, read64(pData + 16));
+			uV4 = hashRound(uV4, read64(pData + 24));
+			pData += 32;
+		} while (pData <= pLimit);
+		uHash = rotateLeft(uV1, 1) + rotateLeft(uV2, 7) + rotateLeft(uV3, 12) + rotateLeft(uV4, 18);
+		uHash = mergeRound(uHash, uV1);
+		uHash = mergeRound(uHash, uV2);
+		uHash = mergeRound(uHash, uV3);
+		uHash = mergeRound(uHash, uV4);
+	}
+	else
+	{
+		uHash = a_uSeed + s_uPrime5;
+	}
+	uHash += static_cast<u64>(a_uSize);
+	while (pData + 8 <= pEnd)
+	{
+		uHash ^= hashRound(0, read64(pData));
+		uHash = rotateLeft(uHash, 27) * s_uPrime1 + s_uPrime4;
+		pData += 8;
+	}
+	if (pData + 4 <= pEnd)
+	{
+		uHash ^= static_cast<u64>(read32(pData)) * s_uPrime1;
+		uHash = rotateLeft(uHash, 23) * s_uPrime2 + s_uPrime3;
+		pData += 4;
+	}
+	while (pData < pEnd)
+	{
+		uHash ^= *pData * s_uPrime5;
+		uHash = rotateLeft(uHash, 11) * s_uPrime1;
+		pData++;
+	}
+	uHash ^= uHash >> 33;
+	uHash *= s_uPrime2;
+	uHash ^= uHash >> 29;
+	uHash *= s_uPrime3;
+	uHash ^= uHash >> 32;
+	return uHash;
+}
+
+CHashKey::CHashKey()
+{
+}
+
+void CHashKey::Update(const void* a_pData, size_t a_uSize)
+{
+	m_vHash.push_back(a_uSize);
+	m_vHash.push_back(Hash64(a_pData, a_uSize, 0));
+	m_vHash.push_back(Hash64(a_pData, a_uSize, s_uPrime1));
+}
+
+void CHashKey::Update(const string& a_sData)
+{
+	Update(a_sData.data(), a_sData.size());
+}
+
+void CHashKey::Update(u64 a_uValue)
+{
+	m_vHash.push_back(a_uValue);
+}
+
+string CHashKey::GetHexDigest() const
+{
+	const void* pData = m_vHash.empty() ? nullptr : &*m_vHash.begin();
+	size_t uSize = m_vHash.size() * sizeof(u64);
+	char szDigest[33] = {};
+	sprintf(szDigest, "%016llx%016llx", static_cast<unsigned long long>(Hash64(pData, uSize, 0)), static_cast<unsigned long long>(Hash64(pData, uSize, s_uPrime2)));
+	return szDigest;
+}
@@ -0,0 +1,22 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <sdw.h>
+
+// XXH64, fast enough to hash a whole image on every run
+u64 Hash64(const void* a_pData, size_t a_uSize, u64 a_uSeed);
+
+// accumulates the hashes of several buffers into a 128-bit key
+class CHashKey
+{
+public:
+	CHashKey();
+	void Update(const void* a_pData, size_t a_uSize);
+	void Update(const string& a_sData);
+	void Update(u64 a_uValue);
+	string GetHexDigest() const;
+private:
+	vector<u64> m_vHash;
+};
+
+#endif	// HASH_H_
@@ -0,0 +1,939 @@
+#include "hostcall.h"
+
+using namespace ELFIO;
+
+enum EFunction
+{
+	kFunctionMemcpy,
+	kFunctionMemmove,
+	kFunctionMemset,
+	kFunctionMemcmp,
+	kFunctionMemchr,
+	kFunctionStrlen,
+	kFunctionStrcmp,
+	kFunctionStrncmp,
+	kFunctionStrcpy,
+	kFunctionStrchr,
+	kFunctionAeabiMemset,
+	kFunctionAeabiMemclr,
+	kFunctionAtexit,
+	kFunctionCxaGuardAcquire,
+	kFunctionCxaGuardRelease,
+	kFunctionCxaGuardAbort,
+	kFunctionPthreadOnce,
+	kFunctionPthreadMutex,
+	kFunctionErrno,
+	kFunctionMalloc,
+	kFunctionCalloc,
+	kFunctionRealloc,
+	kFunctionFree,
+	kFunctionOperatorNew,
+	kFunctionStrdup,
+	kFunctionFail,
+	kFunctionCount
+};
+
+enum ESysCall
+{
+	kSysCallGetpid,
+	kSysCallGettid,
+	kSysCallClockGettime,
+	kSysCallFutex,
+	kSysCallMmap,
+	kSysCallMunmap,
+};
+
+struct SSymbol
+{
+	const char* Name;
+	// offset in the stub page, a function slot or a data word
+	u64 Offset;
+};
+
+static const u64 s_uSlotSize = 32;
+static const u64 s_uStackChkGuardOffset = 0x800;
+static const u64 s_uErrnoOffset = 0x808;
+
+static const SSymbol s_Symbol[] =
+{
+	{ "memcpy", kFunctionMemcpy * s_uSlotSize },
+	{ "__aeabi_memcpy", kFunctionMemcpy * s_uSlotSize },
+	{ "__aeabi_memcpy4", kFunctionMemcpy * s_uSlotSize },
+	{ "__aeabi_memcpy8", kFunctionMemcpy * s_uSlotSize },
+	{ "memmove", kFunctionMemmove * s_uSlotSize },
+	{ "__aeabi_memmove", kFunctionMemmove * s_uSlotSize },
+	{ "__aeabi_memmove4", kFunctionMemmove * s_uSlotSize },
+	{ "__aeabi_memmove8", kFunctionMemmove * s_uSlotSize },
+	{ "memset", kFunctionMemset * s_uSlotSize },
+	{ "__aeabi_memset", kFunctionAeabiMemset * s_uSlotSize },
+	{ "__aeabi_memset4", kFunctionAeabiMemset * s_uSlotSize },
+	{ "__aeabi_memset8", kFunctionAeabiMemset * s_uSlotSize },
+	{ "__aeabi_memclr", kFunctionAeabiMemclr * s_uSlotSize },
+	{ "__aeabi_memclr4", kFunctionAeabiMemclr * s_uSlotSize },
+	{ "__aeabi_memclr8", kFunctionAeabiMemclr * s_uSlotSize },
+	{ "memcmp", kFunctionMemcmp * s_uSlotSize },
+	{ "memchr", kFunctionMemchr * s_uSlotSize },
+	{ "strlen", kFunctionStrlen * s_uSlotSize },
+	{ "strcmp", kFunctionStrcmp * s_uSlotSize },
+	{ "strncmp", kFunctionStrncmp * s_uSlotSize },
+	{ "strcpy", kFunctionStrcpy * s_uSlotSize },
+	{ "strchr", kFunctionStrchr * s_uSlotSize },
+	{ "atexit", kFunctionAtexit * s_uSlotSize },
+	{ "__cxa_atexit", kFunctionAtexit * s_uSlotSize },
+	{ "__cxa_guard_acquire", kFunctionCxaGuardAcquire * s_uSlotSize },
+	{ "__cxa_guard_release", kFunctionCxaGuardRelease * s_uSlotSize },
+	{ "__cxa_guard_abort", kFunctionCxaGuardAbort * s_uSlotSize },
+	{ "pthread_once", kFunctionPthreadOnce * s_uSlotSize },
+	{ "pthread_mutex_lock", kFunctionPthreadMutex * s_uSlotSize },
+	{ "pthread_mutex_unlock", kFunctionPthreadMutex * s_uSlotSize },
+	{ "__errno", kFunctionErrno * s_uSlotSize },
+	{ "__errno_location", kFunctionErrno * s_uSlotSize },
+	{ "malloc", kFunctionMalloc * s_uSlotSize },
+	{ "calloc", kFunctionCalloc * s_uSlotSize },
+	{ "realloc", kFunctionRealloc * s_uSlotSize },
+	{ "free", kFunctionFree * s_uSlotSize },
+	{ "strdup", kFunctionStrdup * s_uSlotSize },
+	{ "_Znwj"/* operator new(unsigned int) */, kFunctionOperatorNew * s_uSlotSize },
+	{ "_Znwm"/* operator new(unsigned long) */, kFunctionOperatorNew * s_uSlotSize },
+	{ "_Znaj"/* operator new[](unsigned int) */, kFunctionOperatorNew * s_uSlotSize },
+	{ "_Znam"/* operator new[](unsigned long) */, kFunctionOperatorNew * s_uSlotSize },
+	{ "_ZnwjRKSt9nothrow_t", kFunctionMalloc * s_uSlotSize },
+	{ "_ZnwmRKSt9nothrow_t", kFunctionMalloc * s_uSlotSize },
+	{ "_ZnajRKSt9nothrow_t", kFunctionMalloc * s_uSlotSize },
+	{ "_ZnamRKSt9nothrow_t", kFunctionMalloc * s_uSlotSize },
+	{ "_ZdlPv"/* operator delete(void*) */, kFunctionFree * s_uSlotSize },
+	{ "_ZdaPv"/* operator delete[](void*) */, kFunctionFree * s_uSlotSize },
+	{ "_ZdlPvj", kFunctionFree * s_uSlotSize },
+	{ "_ZdlPvm", kFunctionFree * s_uSlotSize },
+	{ "_ZdaPvj", kFunctionFree * s_uSlotSize },
+	{ "_ZdaPvm", kFunctionFree * s_uSlotSize },
+	{ "abort", kFunctionFail * s_uSlotSize },
+	{ "__stack_chk_fail", kFunctionFail * s_uSlotSize },
+	{ "__stack_chk_guard", s_uStackChkGuardOffset },
+};
+
+struct SSysCallNumber
+{
+	n32 SysCall;
+	// r7 on ARM EABI, x8 on AArch64
+	u64 ArmNumber;
+	u64 Arm64Number;
+};
+
+static const SSysCallNumber s_SysCallNumber[] =
+{
+	{ kSysCallGetpid, 20, 172 },
+	{ kSysCallGettid, 224, 178 },
+	{ kSysCallClockGettime, 263, 113 },
+	{ kSysCallFutex, 240, 98 },
+	{ kSysCallMmap, 192/* mmap2 */, 222 },
+	{ kSysCallMunmap, 91, 215 },
+};
+
+static const u64 s_uErrorAgain = static_cast<u64>(-11)/* -EAGAIN */;
+static const u64 s_uErrorNoMemory = static_cast<u64>(-12)/* -ENOMEM */;
+static const u64 s_uErrorInvalid = static_cast<u64>(-22)/* -EINVAL */;
+
+// every slot starts with a return, pthread_once calls init_routine itself when the hook flags it in ip or x16
+static const u32 s_uArmReturn = 0xE12FFF1E/* bx lr */;
+static const u32 s_uArmPthreadOnce[] =
+{
+	0xE35C0000/* cmp ip, #0 */,
+	0x012FFF1E/* bxeq lr */,
+	0xE92D4010/* push {r4, lr} */,
+	0xE12FFF31/* blx r1 */,
+	0xE3A00000/* mov r0, #0 */,
+	0xE8BD8010/* pop {r4, pc} */
+};
+static const u32 s_uArm64Return = 0xD65F03C0/* ret */;
+static const u32 s_uArm64PthreadOnce[] =
+{
+	0xB5000050/* cbnz x16, #8 */,
+	0xD65F03C0/* ret */,
+	0xA9BF7BFD/* stp x29, x30, [sp, #-16]! */,
+	0xD63F0020/* blr x1 */,
+	0xD2800000/* mov x0, #0 */,
+	0xA8C17BFD/* ldp x29, x30, [sp], #16 */,
+	0xD65F03C0/* ret */
+};
+
+const u64 CHostCall::s_uStubAddress = 0x70000000;
+const u64 CHostCall::s_uStubSize = 0x1000;
+const u64 CHostCall::s_uHeapHeaderSize = 16;
+// right above the stack
+const u64 CHostCall::s_uTlsAddress = 0x60200000;
+// EXCP_SWI of the ARM targets, raised by svc with the pc already past it
+const u32 CHostCall::s_uInterruptSvc = 2;
+
+SHeap::SHeap()
+	: Address(0x40000000)
+	, Size(0x1000000)
+	, KeepPointer(false)
+{
+}
+
+SThread::SThread()
+	: TlsSize(0x1000)
+	, ProcessId(1000)
+	, ClockTime(0)
+{
+}
+
+CHostCall::CHostCall()
+	: m_uMachine(EM_ARM)
+	, m_fAccess(nullptr)
+	, m_pAccessUserData(nullptr)
+	, m_bFailed(false)
+	, m_uHeapTop(0)
+	, m_uHeapLastBlock(0)
+	, m_uHeapCommittedTop(0)
+	, m_uHeapCommittedLastBlock(0)
+	, m_uAllocationCount(0)
+	, m_bTlsWritten(false)
+	, m_bSysCallFailed(false)
+	, m_uInterrupt(0)
+	, m_uSysCallNumber(0)
+{
+	// no heap and no thread local storage until SetHeap and SetThread
+	m_Heap.Size = 0;
+	m_Thread.TlsSize = 0;
+}
+
+void CHostCall::Init(u16 a_uMachine)
+{
+	m_uMachine = a_uMachine;
+}
+
+void CHostCall::AddMemory(u64 a_uAddress, u64 a_uSize, u8* a_pMemory, bool a_bReadOnly)
+{
+	SMemory memory;
+	memory.Address = a_uAddress;
+	memory.Size = a_uSize;
+	memory.Memory = a_pMemory;
+	memory.ReadOnly = a_bReadOnly;
+	m_vMemory.push_back(memory);
+}
+
+void CHostCall::SetAccessCallback(FAccess a_fAccess, void* a_pUserData)
+{
+	m_fAccess = a_fAccess;
+	m_pAccessUserData = a_pUserData;
+}
+
+void CHostCall::SetHeap(const SHeap& a_Heap)
+{
+	m_Heap = a_Heap;
+	m_Heap.Size = m_Heap.Size / 4096 * 4096;
+	m_sHeap.assign(static_cast<size_t>(m_Heap.Size), 0);
+	m_uHeapTop = m_Heap.Address;
+	m_uHeapLastBlock = 0;
+	m_uHeapCommittedTop = m_uHeapTop;
+	m_uHeapCommittedLastBlock = m_uHeapLastBlock;
+	if (m_Heap.Size != 0)
+	{
+		AddMemory(m_Heap.Address, m_Heap.Size, GetHeapMemory(), false);
+	}
+}
+
+const SHeap& CHostCall::GetHeap() const
+{
+	return m_Heap;
+}
+
+u8* CHostCall::GetHeapMemory()
+{
+	return m_sHeap.empty() ? nullptr : reinterpret_cast<u8*>(&*m_sHeap.begin());
+}
+
+u64 CHostCall::GetHeapTop() const
+{
+	return m_uHeapTop;
+}
+
+void CHostCall::CommitHeap()
+{
+	m_uHeapCommittedTop = m_uHeapTop;
+	m_uHeapCommittedLastBlock = m_uHeapLastBlock;
+}
+
+void CHostCall::RollbackHeap()
+{
+	m_uHeapTop = m_uHeapCommittedTop;
+	m_uHeapLastBlock = m_uHeapCommittedLastBlock;
+}
+
+u64 CHostCall::GetAllocationCount() const
+{
+	return m_uAllocationCount;
+}
+
+void CHostCall::SetThread(const SThread& a_Thread)
+{
+	m_Thread = a_Thread;
+	m_Thread.TlsSize = Align(m_Thread.TlsSize, 4096);
+	m_sTls.assign(static_cast<size_t>(m_Thread.TlsSize), 0);
+	if (m_Thread.TlsSize != 0)
+	{
+		AddMemory(s_uTlsAddress, m_Thread.TlsSize, reinterpret_cast<u8*>(&*m_sTls.begin()), false);
+	}
+}
+
+const SThread& CHostCall::GetThread() const
+{
+	return m_Thread;
+}
+
+u64 CHostCall::GetThreadPointer() const
+{
+	return m_Thread.TlsSize != 0 ? s_uTlsAddress : 0;
+}
+
+bool CHostCall::IsTlsWritten() const
+{
+	return m_bTlsWritten;
+}
+
+uc_err CHostCall::Attach(uc_engine* a_pUc)
+{
+	uc_err eErr = uc_mem_map(a_pUc, s_uStubAddress, static_cast<size_t>(s_uStubSize), UC_PROT_ALL);
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	if (m_Heap.Size != 0)
+	{
+		eErr = uc_mem_map_ptr(a_pUc, m_Heap.Address, static_cast<size_t>(m_Heap.Size), UC_PROT_READ | UC_PROT_WRITE, &*m_sHeap.begin());
+		if (eErr != UC_ERR_OK)
+		{
+			return eErr;
+		}
+	}
+	vector<u32> vCode(static_cast<size_t>(s_uStubSize / 4), 0);
+	for (n32 i = 0; i < kFunctionCount; i++)
+	{
+		vCode[static_cast<size_t>(i * s_uSlotSize / 4)] = m_uMachine == EM_ARM ? s_uArmReturn : s_uArm64Return;
+	}
+	if (m_uMachine == EM_ARM)
+	{
+		memcpy(&vCode[static_cast<size_t>(kFunctionPthreadOnce * s_uSlotSize / 4)], s_uArmPthreadOnce, sizeof(s_uArmPthreadOnce));
+	}
+	else
+	{
+		memcpy(&vCode[static_cast<size_t>(kFunctionPthreadOnce * s_uSlotSize / 4)], s_uArm64PthreadOnce, sizeof(s_uArm64PthreadOnce));
+	}
+	eErr = uc_mem_write(a_pUc, s_uStubAddress, &*vCode.begin(), static_cast<size_t>(s_uStubSize));
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	if (m_Thread.TlsSize != 0)
+	{
+		eErr = uc_mem_map_ptr(a_pUc, s_uTlsAddress, static_cast<size_t>(m_Thread.TlsSize), UC_PROT_READ | UC_PROT_WRITE, &*m_sTls.begin());
+		if (eErr != UC_ERR_OK)
+		{
+			return eErr;
+		}
+		uc_hook hook = 0;
+		eErr = uc_hook_add(a_pUc, &hook, UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&CHostCall::onTlsWrite), this, s_uTlsAddress, s_uTlsAddress + m_Thread.TlsSize - 1);
+		if (eErr != UC_ERR_OK)
+		{
+			return eErr;
+		}
+	}
+	uc_hook hook = 0;
+	eErr = uc_hook_add(a_pUc, &hook, UC_HOOK_INTR, reinterpret_cast<void*>(&CHostCall::onInterrupt), this, 1, 0);
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	return uc_hook_add(a_pUc, &hook, UC_HOOK_CODE, reinterpret_cast<void*>(&CHostCall::onCode), this, s_uStubAddress, s_uStubAddress + kFunctionCount * s_uSlotSize - 1);
+}
+
+void CHostCall::Clear()
+{
+	m_bFailed = false;
+	m_uAllocationCount = 0;
+	if (m_bTlsWritten)
+	{
+		memset(&*m_sTls.begin(), 0, m_sTls.size());
+		m_bTlsWritten = false;
+	}
+	m_bSysCallFailed = false;
+	m_uInterrupt = 0;
+	m_uSysCallNumber = 0;
+}
+
+bool CHostCall::IsFailed() const
+{
+	return m_bFailed;
+}
+
+bool CHostCall::IsSysCallFailed() const
+{
+	return m_bSysCallFailed;
+}
+
+u32 CHostCall::GetInterrupt() const
+{
+	return m_uInterrupt;
+}
+
+u64 CHostCall::GetSysCallNumber() const
+{
+	return m_uSysCallNumber;
+}
+
+bool CHostCall::Resolve(const string& a_sName, u64& a_uAddress)
+{
+	for (n32 i = 0; i < static_cast<n32>(sizeof(s_Symbol) / sizeof(s_Symbol[0])); i++)
+	{
+		if (a_sName == s_Symbol[i].Name)
+		{
+			a_uAddress = s_uStubAddress + s_Symbol[i].Offset;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CHostCall::onCode(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData)
+{
+	CHostCall* pHostCall = static_cast<CHostCall*>(a_pUserData);
+	u64 uOffset = a_uAddress - s_uStubAddress;
+	if (uOffset % s_uSlotSize != 0)
+	{
+		return;
+	}
+	if (!pHostCall->call(a_pUc, static_cast<n32>(uOffset / s_uSlotSize)))
+	{
+		pHostCall->m_bFailed = true;
+		uc_emu_stop(a_pUc);
+	}
+}
+
+void CHostCall::onInterrupt(uc_engine* a_pUc, u32 a_uInterrupt, void* a_pUserData)
+{
+	CHostCall* pHostCall = static_cast<CHostCall*>(a_pUserData);
+	pHostCall->m_uInterrupt = a_uInterrupt;
+	if (a_uInterrupt != s_uInterruptSvc || !pHostCall->sysCall(a_pUc))
+	{
+		pHostCall->m_bSysCallFailed = true;
+		uc_emu_stop(a_pUc);
+	}
+}
+
+void CHostCall::onTlsWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	static_cast<CHostCall*>(a_pUserData)->m_bTlsWritten = true;
+}
+
+bool CHostCall::call(uc_engine* a_pUc, n32 a_nFunction)
+{
+	static const n32 c_nArmArgRegId[] = { UC_ARM_REG_R0, UC_ARM_REG_R1, UC_ARM_REG_R2 };
+	static const n32 c_nArm64ArgRegId[] = { UC_ARM64_REG_X0, UC_ARM64_REG_X1, UC_ARM64_REG_X2 };
+	const n32* pArgRegId = m_uMachine == EM_ARM ? c_nArmArgRegId : c_nArm64ArgRegId;
+	u64 uArg[3] = {};
+	for (n32 i = 0; i < 3; i++)
+	{
+		uc_reg_read(a_pUc, pArgRegId[i], &uArg[i]);
+	}
+	u64 uResult = uArg[0];
+	switch (a_nFunction)
+	{
+	case kFunctionMemcpy:
+	case kFunctionMemmove:
+		if (uArg[2] != 0)
+		{
+			u8* pDest = getWritePointer(uArg[0], uArg[2]);
+			u8* pSrc = getPointer(uArg[1], uArg[2]);
+			if (pDest == nullptr || pSrc == nullptr)
+			{
+				return false;
+			}
+			access(uArg[1], uArg[2], false);
+			access(uArg[0], uArg[2], true);
+			memmove(pDest, pSrc, static_cast<size_t>(uArg[2]));
+		}
+		break;
+	case kFunctionMemset:
+	case kFunctionAeabiMemset:
+	case kFunctionAeabiMemclr:
+		{
+			// memset(s, c, n), __aeabi_memset(s, n, c), __aeabi_memclr(s, n)
+			u64 uSize = a_nFunction == kFunctionMemset ? uArg[2] : uArg[1];
+			u8 uValue = static_cast<u8>(a_nFunction == kFunctionMemset ? uArg[1] : (a_nFunction == kFunctionAeabiMemset ? uArg[2] : 0));
+			if (uSize != 0)
+			{
+				u8* pDest = getWritePointer(uArg[0], uSize);
+				if (pDest == nullptr)
+				{
+					return false;
+				}
+				access(uArg[0], uSize, true);
+				memset(pDest, uValue, static_cast<size_t>(uSize));
+			}
+		}
+		break;
+	case kFunctionMemcmp:
+		uResult = 0;
+		if (uArg[2] != 0)
+		{
+			u8* pLeft = getPointer(uArg[0], uArg[2]);
+			u8* pRight = getPointer(uArg[1], uArg[2]);
+			if (pLeft == nullptr || pRight == nullptr)
+			{
+				return false;
+			}
+			access(uArg[0], uArg[2], false);
+			access(uArg[1], uArg[2], false);
+			uResult = static_cast<u64>(static_cast<n64>(memcmp(pLeft, pRight, static_cast<size_t>(uArg[2]))));
+		}
+		break;
+	case kFunctionMemchr:
+		uResult = 0;
+		if (uArg[2] != 0)
+		{
+			u64 uMaxSize = 0;
+			u8* pBuffer = getPointer(uArg[0], 0, &uMaxSize);
+			if (pBuffer == nullptr)
+			{
+				return false;
+			}
+			u64 uSize = min<u64>(uArg[2], uMaxSize);
+			const u8* pFound = static_cast<const u8*>(memchr(pBuffer, static_cast<u8>(uArg[1]), static_cast<size_t>(uSize)));
+			if (pFound != nullptr)
+			{
+				uSize = pFound - pBuffer + 1;
+				uResult = uArg[0] + (pFound - pBuffer);
+			}
+			else if (uSize < uArg[2])
+			{
+				return false;
+			}
+			access(uArg[0], uSize, false);
+		}
+		break;
+	case kFunctionStrlen:
+		if (!getString(uArg[0], UINT64_MAX, uResult))
+		{
+			return false;
+		}
+		access(uArg[0], uResult + 1, false);
+		break;
+	case kFunctionStrcmp:
+	case kFunctionStrncmp:
+		{
+			u64 uMaxSize = a_nFunction == kFunctionStrcmp ? UINT64_MAX : uArg[2];
+			u64 uLeftSize = 0;
+			u64 uRightSize = 0;
+			if (!getString(uArg[0], uMaxSize, uLeftSize) || !getString(uArg[1], uMaxSize, uRightSize))
+			{
+				return false;
+			}
+			// the shorter string's terminator decides when the prefixes match
+			u64 uSize = min<u64>(min<u64>(uLeftSize, uRightSize) + 1, uMaxSize);
+			access(uArg[0], uSize, false);
+			access(uArg[1], uSize, false);
+			uResult = static_cast<u64>(static_cast<n64>(memcmp(getPointer(uArg[0], 0), getPointer(uArg[1], 0), static_cast<size_t>(uSize))));
+		}
+		break;
+	case kFunctionStrcpy:
+		{
+			u64 uSize = 0;
+			if (!getString(uArg[1], UINT64_MAX, uSize))
+			{
+				return false;
+			}
+			u8* pDest = getWritePointer(uArg[0], uSize + 1);
+			if (pDest == nullptr)
+			{
+				return false;
+			}
+			access(uArg[1], uSize + 1, false);
+			access(uArg[0], uSize + 1, true);
+			memmove(pDest, getPointer(uArg[1], 0), static_cast<size_t>(uSize + 1));
+		}
+		break;
+	case kFunctionStrchr:
+		{
+			u64 uSize = 0;
+			if (!getString(uArg[0], UINT64_MAX, uSize))
+			{
+				return false;
+			}
+			access(uArg[0], uSize + 1, false);
+			const u8* pString = getPointer(uArg[0], 0);
+			const u8* pFound = static_cast<const u8*>(memchr(pString, static_cast<u8>(uArg[1]), static_cast<size_t>(uSize + 1)));
+			uResult = pFound != nullptr ? uArg[0] + (pFound - pString) : 0;
+		}
+		break;
+	case kFunctionAtexit:
+		// destructors only run at exit, which never happens here
+		uResult = 0;
+		break;
+	case kFunctionCxaGuardAcquire:
+		{
+			u8* pGuard = getPointer(uArg[0], 4);
+			if (pGuard == nullptr)
+			{
+				return false;
+			}
+			access(uArg[0], 4, false);
+			uResult = (pGuard[0] & 1) == 0 ? 1 : 0;
+		}
+		break;
+	case kFunctionCxaGuardRelease:
+		{
+			u8* pGuard = getWritePointer(uArg[0], 4);
+			if (pGuard == nullptr)
+			{
+				return false;
+			}
+			access(uArg[0], 4, true);
+			u32 uComplete = 1;
+			memcpy(pGuard, &uComplete, 4);
+		}
+		break;
+	case kFunctionCxaGuardAbort:
+	case kFunctionPthreadMutex:
+		uResult = 0;
+		break;
+	case kFunctionPthreadOnce:
+		{
+			u8* pOnce = getPointer(uArg[0], 4);
+			if (pOnce == nullptr)
+			{
+				return false;
+			}
+			u32 uState = 0;
+			memcpy(&uState, pOnce, 4);
+			access(uArg[0], 4, false);
+			u64 uCall = 0;
+			if (uState == 0)
+			{
+				if (getWritePointer(uArg[0], 4) == nullptr)
+				{
+					return false;
+				}
+				// bionic ONCE_INITIALIZATION_COMPLETE, the stub calls init_routine right after the hook
+				uState = 2;
+				access(uArg[0], 4, true);
+				memcpy(pOnce, &uState, 4);
+				uCall = 1;
+			}
+			uc_reg_write(a_pUc, m_uMachine == EM_ARM ? static_cast<n32>(UC_ARM_REG_R12) : static_cast<n32>(UC_ARM64_REG_X16), &uCall);
+			uResult = 0;
+		}
+		break;
+	case kFunctionErrno:
+		uResult = s_uStubAddress + s_uErrnoOffset;
+		break;
+	case kFunctionMalloc:
+		if (!allocate(uArg[0], uResult))
+		{
+			uResult = 0;
+		}
+		break;
+	case kFunctionOperatorNew:
+		// operator new would throw, which cannot be emulated
+		if (!allocate(uArg[0], uResult))
+		{
+			return false;
+		}
+		break;
+	case kFunctionCalloc:
+		{
+			u64 uSize = uArg[0] * uArg[1];
+			if ((uArg[0] != 0 && uSize / uArg[0] != uArg[1]) || !allocate(uSize, uResult))
+			{
+				uResult = 0;
+				break;
+			}
+			access(uResult, uSize, true);
+			memset(getPointer(uResult, uSize), 0, static_cast<size_t>(uSize));
+		}
+		break;
+	case kFunctionRealloc:
+		if (!reallocate(uArg[0], uArg[1], uResult))
+		{
+			uResult = 0;
+		}
+		break;
+	case kFunctionFree:
+		release(uArg[0]);
+		break;
+	case kFunctionStrdup:
+		{
+			u64 uSize = 0;
+			if (!getString(uArg[0], UINT64_MAX, uSize))
+			{
+				return false;
+			}
+			if (!allocate(uSize + 1, uResult))
+			{
+				uResult = 0;
+				break;
+			}
+			access(uArg[0], uSize + 1, false);
+			access(uResult, uSize + 1, true);
+			memcpy(getPointer(uResult, uSize + 1), getPointer(uArg[0], uSize + 1), static_cast<size_t>(uSize + 1));
+		}
+		break;
+	default:
+		return false;
+	}
+	uc_reg_write(a_pUc, pArgRegId[0], &uResult);
+	return true;
+}
+
+// a single thread that has not started any other, so nothing can wake a futex wait and every answer is fixed
+bool CHostCall::sysCall(uc_engine* a_pUc)
+{
+	static const n32 c_nArmArgRegId[] = { UC_ARM_REG_R0, UC_ARM_REG_R1, UC_ARM_REG_R2, UC_ARM_REG_R3 };
+	static const n32 c_nArm64ArgRegId[] = { UC_ARM64_REG_X0, UC_ARM64_REG_X1, UC_ARM64_REG_X2, UC_ARM64_REG_X3 };
+	bool bArm = m_uMachine == EM_ARM;
+	const n32* pArgRegId = bArm ? c_nArmArgRegId : c_nArm64ArgRegId;
+	uc_reg_read(a_pUc, bArm ? static_cast<n32>(UC_ARM_REG_R7) : static_cast<n32>(UC_ARM64_REG_X8), &m_uSysCallNumber);
+	u64 uArg[4] = {};
+	for (n32 i = 0; i < 4; i++)
+	{
+		uc_reg_read(a_pUc, pArgRegId[i], &uArg[i]);
+	}
+	if (bArm)
+	{
+		for (n32 i = 0; i < 4; i++)
+		{
+			uArg[i] &= 0xFFFFFFFF;
+		}
+	}
+	n32 nSysCall = -1;
+	for (n32 i = 0; i < static_cast<n32>(sizeof(s_SysCallNumber) / sizeof(s_SysCallNumber[0])); i++)
+	{
+		if (m_uSysCallNumber == (bArm ? s_SysCallNumber[i].ArmNumber : s_SysCallNumber[i].Arm64Number))
+		{
+			nSysCall = s_SysCallNumber[i].SysCall;
+			break;
+		}
+	}
+	u64 uResult = 0;
+	switch (nSysCall)
+	{
+	case kSysCallGetpid:
+	case kSysCallGettid:
+		uResult = m_Thread.ProcessId;
+		break;
+	case kSysCallClockGettime:
+		{
+			// struct timespec is two longs
+			u64 uValueSize = bArm ? 4 : 8;
+			u8* pTime = getWritePointer(uArg[1], uValueSize * 2);
+			if (pTime == nullptr)
+			{
+				return false;
+			}
+			u64 uSecond = m_Thread.ClockTime / 1000000000;
+			u64 uNanosecond = m_Thread.ClockTime % 1000000000;
+			access(uArg[1], uValueSize * 2, true);
+			memcpy(pTime, &uSecond, static_cast<size_t>(uValueSize));
+			memcpy(pTime + uValueSize, &uNanosecond, static_cast<size_t>(uValueSize));
+		}
+		break;
+	case kSysCallFutex:
+		// the command without FUTEX_PRIVATE_FLAG and FUTEX_CLOCK_REALTIME
+		switch (uArg[1] & 0x7F)
+		{
+		case 0/* FUTEX_WAIT */:
+		case 9/* FUTEX_WAIT_BITSET */:
+			{
+				u8* pFutex = getPointer(uArg[0], 4);
+				if (pFutex == nullptr)
+				{
+					return false;
+				}
+				u32 uValue = 0;
+				memcpy(&uValue, pFutex, 4);
+				access(uArg[0], 4, false);
+				if (uValue == static_cast<u32>(uArg[2]))
+				{
+					// would sleep forever
+					return false;
+				}
+				uResult = s_uErrorAgain;
+			}
+			break;
+		case 1/* FUTEX_WAKE */:
+		case 10/* FUTEX_WAKE_BITSET */:
+			// nobody waits
+			uResult = 0;
+			break;
+		default:
+			return false;
+		}
+		break;
+	case kSysCallMmap:
+		{
+			// anonymous memory only, taken page aligned and zeroed from the heap, the address hint is ignored
+			if ((uArg[3] & 0x20/* MAP_ANONYMOUS */) == 0 || (uArg[3] & 0x10/* MAP_FIXED */) != 0)
+			{
+				return false;
+			}
+			u64 uSize = Align(uArg[1], 4096);
+			if (uArg[1] == 0)
+			{
+				uResult = s_uErrorInvalid;
+			}
+			else if (!allocate(uSize, uResult, 4096))
+			{
+				uResult = s_uErrorNoMemory;
+			}
+			else
+			{
+				access(uResult, uSize, true);
+				memset(getPointer(uResult, uSize), 0, static_cast<size_t>(uSize));
+			}
+		}
+		break;
+	case kSysCallMunmap:
+		release(uArg[0]);
+		uResult = 0;
+		break;
+	default:
+		return false;
+	}
+	uc_reg_write(a_pUc, pArgRegId[0], &uResult);
+	return true;
+}
+
+u8* CHostCall::getPointer(u64 a_uAddress, u64 a_uSize, u64* a_pMaxSize, bool a_bWrite)
+{
+	for (vector<SMemory>::const_iterator it = m_vMemory.begin(); it != m_vMemory.end(); ++it)
+	{
+		const SMemory& memory = *it;
+		if (a_uAddress < memory.Address || a_uAddress - memory.Address >= memory.Size)
+		{
+			continue;
+		}
+		u64 uMaxSize = memory.Size - (a_uAddress - memory.Address);
+		if (a_uSize > uMaxSize || (a_bWrite && memory.ReadOnly))
+		{
+			return nullptr;
+		}
+		if (a_pMaxSize != nullptr)
+		{
+			*a_pMaxSize = uMaxSize;
+		}
+		return memory.Memory + (a_uAddress - memory.Address);
+	}
+	return nullptr;
+}
+
+u8* CHostCall::getWritePointer(u64 a_uAddress, u64 a_uSize)
+{
+	return getPointer(a_uAddress, a_uSize, nullptr, true);
+}
+
+bool CHostCall::getString(u64 a_uAddress, u64 a_uMaxSize, u64& a_uSize)
+{
+	u64 uMaxSize = 0;
+	const u8* pString = getPointer(a_uAddress, 0, &uMaxSize);
+	if (pString == nullptr)
+	{
+		return false;
+	}
+	const u8* pEnd = static_cast<const u8*>(memchr(pString, 0, static_cast<size_t>(min<u64>(a_uMaxSize, uMaxSize))));
+	if (pEnd != nullptr)
+	{
+		a_uSize = pEnd - pString;
+		return true;
+	}
+	if (a_uMaxSize <= uMaxSize)
+	{
+		a_uSize = a_uMaxSize;
+		return true;
+	}
+	return false;
+}
+
+void CHostCall::access(u64 a_uAddress, u64 a_uSize, bool a_bWrite)
+{
+	if (a_bWrite && m_Thread.TlsSize != 0 && a_uAddress < s_uTlsAddress + m_Thread.TlsSize && a_uAddress + a_uSize > s_uTlsAddress)
+	{
+		m_bTlsWritten = true;
+	}
+	if (m_fAccess != nullptr)
+	{
+		m_fAccess(m_pAccessUserData, a_uAddress, a_uSize, a_bWrite);
+	}
+}
+
+bool CHostCall::allocate(u64 a_uSize, u64& a_uAddress, u64 a_uAlignment)
+{
+	// every block is at least 16-byte aligned and preceded by a header holding its size
+	if (a_uSize > m_Heap.Size)
+	{
+		return false;
+	}
+	u64 uBlockSize = Align(max<u64>(a_uSize, 1), s_uHeapHeaderSize);
+	u64 uAddress = Align(m_uHeapTop + s_uHeapHeaderSize, a_uAlignment);
+	if (uAddress + uBlockSize > m_Heap.Address + m_Heap.Size)
+	{
+		return false;
+	}
+	u8* pHeader = getPointer(uAddress - s_uHeapHeaderSize, s_uHeapHeaderSize);
+	access(uAddress - s_uHeapHeaderSize, 8, true);
+	memcpy(pHeader, &a_uSize, 8);
+	a_uAddress = uAddress;
+	m_uHeapLastBlock = a_uAddress;
+	m_uHeapTop = a_uAddress + uBlockSize;
+	m_uAllocationCount++;
+	return true;
+}
+
+void CHostCall::release(u64 a_uAddress)
+{
+	if (a_uAddress != 0 && a_uAddress == m_uHeapLastBlock)
+	{
+		m_uHeapTop = a_uAddress - s_uHeapHeaderSize;
+		m_uHeapLastBlock = 0;
+	}
+	m_uAllocationCount++;
+}
+
+bool CHostCall::reallocate(u64 a_uAddress, u64 a_uSize, u64& a_uNewAddress)
+{
+	if (a_uAddress == 0)
+	{
+		return allocate(a_uSize, a_uNewAddress);
+	}
+	u8* pHeader = getPointer(a_uAddress - s_uHeapHeaderSize, s_uHeapHeaderSize);
+	if (pHeader == nullptr || a_uAddress < m_Heap.Address + s_uHeapHeaderSize || a_uAddress >= m_uHeapTop)
+	{
+		return false;
+	}
+	u64 uOldSize = 0;
+	memcpy(&uOldSize, pHeader, 8);
+	access(a_uAddress - s_uHeapHeaderSize, 8, false);
+	if (a_uAddress == m_uHeapLastBlock && a_uSize <= m_Heap.Size)
+	{
+		// the last block grows or shrinks in place
+		u64 uBlockSize = Align(max<u64>(a_uSize, 1), s_uHeapHeaderSize);
+		if (uBlockSize <= m_Heap.Address + m_Heap.Size - a_uAddress)
+		{
+			access(a_uAddress - s_uHeapHeaderSize, 8, true);
+			memcpy(pHeader, &a_uSize, 8);
+			m_uHeapTop = a_uAddress + uBlockSize;
+			m_uAllocationCount++;
+			a_uNewAddress = a_uAddress;
+			return true;
+		}
+	}
+	if (!allocate(a_uSize, a_uNewAddress))
+	{
+		return false;
+	}
+	u64 uSize = min<u64>(uOldSize, a_uSize);
+	access(a_uAddress, uSize, false);
+	access(a_uNewAddress, uSize, true);
+	memcpy(getPointer(a_uNewAddress, uSize), getPointer(a_uAddress, uSize), static_cast<size_t>(uSize));
+	return true;
+}
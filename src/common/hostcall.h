@@ -0,0 +1,108 @@
+#ifndef HOSTCALL_H_
+#define HOSTCALL_H_
+
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include <unicorn/unicorn.h>
+
+struct SHeap
+{
+	SHeap();
+	u64 Address;
+	// 0 disables the heap, allocations then return nullptr
+	u64 Size;
+	// commit entries that leave pointers into the heap in .data, the output then needs the heap too
+	bool KeepPointer;
+};
+
+struct SThread
+{
+	SThread();
+	// thread local storage mapped right above the stack, the thread pointer register points at its start, 0 maps none and leaves the register zero
+	u64 TlsSize;
+	// what getpid and gettid return
+	u32 ProcessId;
+	// what clock_gettime returns for every clock, nanoseconds since the epoch
+	u64 ClockTime;
+};
+
+// imported libc and C++ runtime functions run natively on the host, their GOT slots point at stubs that only return and a code hook does the work before the return runs
+class CHostCall
+{
+public:
+	typedef void (*FAccess)(void* a_pUserData, u64 a_uAddress, u64 a_uSize, bool a_bWrite);
+	CHostCall();
+	void Init(u16 a_uMachine);
+	// host functions can write a_pMemory only where the guest could
+	void AddMemory(u64 a_uAddress, u64 a_uSize, u8* a_pMemory, bool a_bReadOnly);
+	void SetAccessCallback(FAccess a_fAccess, void* a_pUserData);
+	void SetHeap(const SHeap& a_Heap);
+	const SHeap& GetHeap() const;
+	u8* GetHeapMemory();
+	u64 GetHeapTop() const;
+	void CommitHeap();
+	void RollbackHeap();
+	u64 GetAllocationCount() const;
+	void SetThread(const SThread& a_Thread);
+	const SThread& GetThread() const;
+	u64 GetThreadPointer() const;
+	// the current entry wrote its thread local storage
+	bool IsTlsWritten() const;
+	uc_err Attach(uc_engine* a_pUc);
+	// also zeroes the thread local storage, every entry starts from a fresh one like from a fresh stack
+	void Clear();
+	bool IsFailed() const;
+	// an svc asked for a system call without an implementation, or another exception was raised
+	bool IsSysCallFailed() const;
+	u32 GetInterrupt() const;
+	u64 GetSysCallNumber() const;
+	// the stub address of an imported symbol with a host implementation
+	static bool Resolve(const string& a_sName, u64& a_uAddress);
+	static const u64 s_uStubAddress;
+	static const u64 s_uStubSize;
+	static const u64 s_uHeapHeaderSize;
+	static const u64 s_uTlsAddress;
+	static const u32 s_uInterruptSvc;
+private:
+	struct SMemory
+	{
+		u64 Address;
+		u64 Size;
+		u8* Memory;
+		bool ReadOnly;
+	};
+	static void onCode(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData);
+	static void onInterrupt(uc_engine* a_pUc, u32 a_uInterrupt, void* a_pUserData);
+	static void onTlsWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	bool call(uc_engine* a_pUc, n32 a_nFunction);
+	bool sysCall(uc_engine* a_pUc);
+	u8* getPointer(u64 a_uAddress, u64 a_uSize, u64* a_pMaxSize = nullptr, bool a_bWrite = false);
+	// nullptr for memory the guest cannot write either
+	u8* getWritePointer(u64 a_uAddress, u64 a_uSize);
+	bool getString(u64 a_uAddress, u64 a_uMaxSize, u64& a_uSize);
+	void access(u64 a_uAddress, u64 a_uSize, bool a_bWrite);
+	bool allocate(u64 a_uSize, u64& a_uAddress, u64 a_uAlignment = s_uHeapHeaderSize);
+	void release(u64 a_uAddress);
+	bool reallocate(u64 a_uAddress, u64 a_uSize, u64& a_uNewAddress);
+	u16 m_uMachine;
+	vector<SMemory> m_vMemory;
+	FAccess m_fAccess;
+	void* m_pAccessUserData;
+	bool m_bFailed;
+	SHeap m_Heap;
+	string m_sHeap;
+	// bump allocation, only the last block can be freed, the committed state comes back on rollback
+	u64 m_uHeapTop;
+	u64 m_uHeapLastBlock;
+	u64 m_uHeapCommittedTop;
+	u64 m_uHeapCommittedLastBlock;
+	u64 m_uAllocationCount;
+	SThread m_Thread;
+	string m_sTls;
+	bool m_bTlsWritten;
+	bool m_bSysCallFailed;
+	u32 m_uInterrupt;
+	u64 m_uSysCallNumber;
+};
+
+#endif	// HOSTCALL_H_
@@ -0,0 +1,879 @@
+#include "initemulator.h"
+#include "hash.h"
+#include "manifest.h"
+#include "pagetracker.h"
+#include "resultcache.h"
+#include "speculator.h"
+
+using namespace ELFIO;
+
+CInitEmulator::CInitEmulator()
+	: m_eCommitPolicy(kCommitPolicyData)
+	, m_bVerbose(false)
+	, m_nParallel(0)
+	, m_pMetrics(&m_Metrics)
+	, m_pProfiler(nullptr)
+	, m_uElfSize(0)
+	, m_bSupported(false)
+	, m_pDataSection(nullptr)
+	, m_pRelaDynSection(nullptr)
+{
+}
+
+void CInitEmulator::SetCommitPolicy(ECommitPolicy a_eCommitPolicy)
+{
+	m_eCommitPolicy = a_eCommitPolicy;
+}
+
+void CInitEmulator::SetVerbose(bool a_bVerbose)
+{
+	m_bVerbose = a_bVerbose;
+}
+
+void CInitEmulator::SetParallel(n32 a_nParallel)
+{
+	m_nParallel = a_nParallel;
+}
+
+void CInitEmulator::SetCacheDirName(const UString& a_sCacheDirName)
+{
+	m_sCacheDirName = a_sCacheDirName;
+}
+
+void CInitEmulator::SetBudget(const SBudget& a_Budget)
+{
+	m_Budget = a_Budget;
+}
+
+void CInitEmulator::SetHeap(const SHeap& a_Heap)
+{
+	m_Heap = a_Heap;
+}
+
+void CInitEmulator::SetThread(const SThread& a_Thread)
+{
+	m_Thread = a_Thread;
+}
+
+void CInitEmulator::SetMetrics(CMetrics* a_pMetrics)
+{
+	m_pMetrics = a_pMetrics != nullptr ? a_pMetrics : &m_Metrics;
+}
+
+void CInitEmulator::SetProfiler(CProfiler* a_pProfiler)
+{
+	m_pProfiler = a_pProfiler;
+}
+
+void CInitEmulator::SetManifestFileName(const UString& a_sManifestFileName)
+{
+	m_sManifestFileName = a_sManifestFileName;
+}
+
+bool CInitEmulator::Load(const u8* a_pElf, u64 a_uElfSize)
+{
+	m_pMetrics->BeginStage("load");
+	m_uElfSize = a_uElfSize;
+	m_bSupported = false;
+	m_pDataSection = nullptr;
+	m_pRelaDynSection = nullptr;
+	m_vInitEntry.clear();
+	m_vAddress.clear();
+	m_InitialMemory.Clear();
+	m_Memory.Clear();
+	m_sInvalidIndex.clear();
+	// ELFIO copies what it reads, the buffer is not needed afterwards
+	CMemoryStreamBuf elfStreamBuf(a_pElf, a_uElfSize);
+	istream input(&elfStreamBuf);
+	if (!m_ElfFile.load(input))
+	{
+		return false;
+	}
+	u8 uClass = m_ElfFile.get_class();
+	if (uClass != ELFCLASS32 && uClass != ELFCLASS64)
+	{
+		return false;
+	}
+	u8 uEncoding = m_ElfFile.get_encoding();
+	if (uEncoding != ELFDATA2LSB)
+	{
+		// support little endian only
+		return false;
+	}
+	u16 uType = m_ElfFile.get_type();
+	if (uType != ET_DYN)
+	{
+		// support shared object file only
+		return false;
+	}
+	u16 uMachine = m_ElfFile.get_machine();
+	switch (uMachine)
+	{
+	case kMachineARM:
+		if (uClass != ELFCLASS32)
+		{
+			return false;
+		}
+		break;
+	case kMachineAARCH64:
+		if (uClass != ELFCLASS64)
+		{
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+	section* pBssSection = nullptr;
+	n32 nSectionSize = m_ElfFile.sections.size();
+	for (n32 i = 0; i < nSectionSize; i++)
+	{
+		section* pSection = m_ElfFile.sections[i];
+		if (pSection == nullptr)
+		{
+			return false;
+		}
+		string sName = pSection->get_name();
+		if (sName == ".data")
+		{
+			m_pDataSection = pSection;
+		}
+		else if (sName == ".bss")
+		{
+			pBssSection = pSection;
+		}
+		else if (sName == ".rela.dyn")
+		{
+			m_pRelaDynSection = pSection;
+		}
+	}
+	if (!findInitEntry())
+	{
+		return false;
+	}
+	// emuInit folds entries into .data, dumpInitMemory runs them whatever they write
+	if (m_vInitEntry.empty())
+	{
+		return true;
+	}
+	if (m_eCommitPolicy == kCommitPolicyData && (m_pDataSection == nullptr || m_pDataSection->get_size() == 0))
+	{
+		return true;
+	}
+	m_pMetrics->BeginStage("map");
+	if (!m_Loader.Load(m_ElfFile, m_Memory))
+	{
+		// no executable PT_LOAD segment
+		return m_eCommitPolicy == kCommitPolicyData;
+	}
+	u64 uMemoryAddress4K = m_Loader.GetMemoryAddress();
+	// .data and .rela.dyn are written back into the file, both have to lie inside it
+	if (m_pDataSection != nullptr && (m_Memory.GetPointer(m_pDataSection->get_address(), m_pDataSection->get_size()) == nullptr || !isInFile(m_pDataSection->get_offset(), m_pDataSection->get_size())))
+	{
+		return false;
+	}
+	if (m_pRelaDynSection != nullptr && !isInFile(m_pRelaDynSection->get_offset(), m_pRelaDynSection->get_size()))
+	{
+		return false;
+	}
+	if (!m_Relocator.Apply(m_ElfFile, m_Memory))
+	{
+		return false;
+	}
+	if (m_bVerbose && m_Relocator.GetUnresolvedCount() != 0)
+	{
+		printf("%d relocations against unresolved symbols bound to 0\n", m_Relocator.GetUnresolvedCount());
+	}
+	u32 uEntrySize = uClass == ELFCLASS64 ? 8 : 4;
+	if (m_pRelaDynSection != nullptr)
+	{
+		map<u64, n32> mSlotIndex;
+		for (n32 i = 0; i < static_cast<n32>(m_vInitEntry.size()); i++)
+		{
+			if (m_vInitEntry[i].Tag != DT_INIT)
+			{
+				mSlotIndex.insert(make_pair(m_vInitEntry[i].Address, i));
+			}
+		}
+		relocation_section_accessor relaDynSection(m_ElfFile, m_pRelaDynSection);
+		n32 nEnteyCount = static_cast<n32>(relaDynSection.get_entries_num());
+		for (n32 i = 0; i < nEnteyCount; i++)
+		{
+			Elf64_Addr uOffset = 0;
+			Elf_Word uSymbol = 0;
+			Elf_Word uType = 0;
+			Elf_Sxword nAddend = 0;
+			if (!relaDynSection.get_entry(i, uOffset, uSymbol, uType, nAddend))
+			{
+				return false;
+			}
+			if (uSymbol != 0 || (uMachine == kMachineARM && uType != 23/* R_ARM_RELATIVE Adjust by program base. */) || (uMachine == kMachineAARCH64 && uType != 1027/* R_AARCH64_RELATIVE Adjust by program base. */))
+			{
+				continue;
+			}
+			map<u64, n32>::const_iterator it = mSlotIndex.find(uOffset);
+			if (it != mSlotIndex.end())
+			{
+				m_vInitEntry[it->second].RelaDynIndex = i;
+			}
+		}
+	}
+	m_ImageLayout = SImageLayout();
+	m_ImageLayout.Machine = uMachine;
+	m_ImageLayout.MemoryAddress = uMemoryAddress4K;
+	m_ImageLayout.TextAddressMin = m_Loader.GetTextAddressMin();
+	m_ImageLayout.TextAddressMax = m_Loader.GetTextAddressMax();
+	m_ImageLayout.SegmentList = m_Loader.GetSegmentList();
+	m_ImageLayout.RelocationTargetList = m_Relocator.GetTargetList();
+	m_ImageLayout.DataAddress = 0;
+	m_ImageLayout.DataSize = 0;
+	if (m_pDataSection != nullptr)
+	{
+		m_ImageLayout.DataAddress = m_pDataSection->get_address();
+		m_ImageLayout.DataSize = m_pDataSection->get_size();
+	}
+	m_ImageLayout.BssAddress = 0;
+	m_ImageLayout.BssSize = 0;
+	if (pBssSection != nullptr)
+	{
+		m_ImageLayout.BssAddress = pBssSection->get_address();
+		m_ImageLayout.BssSize = pBssSection->get_size();
+	}
+	// the slots hold the relocated function addresses by now
+	u64 uDisabledAddress = uEntrySize == 8 ? UINT64_MAX : 0xFFFFFFFF;
+	m_vAddress.resize(m_vInitEntry.size());
+	for (size_t i = 0; i < m_vInitEntry.size(); i++)
+	{
+		const SInitEntry& entry = m_vInitEntry[i];
+		if (entry.Tag == DT_INIT)
+		{
+			m_vAddress[i] = entry.Address;
+			continue;
+		}
+		u64 uAddress = 0;
+		if (!m_Memory.Read(entry.Address, &uAddress, uEntrySize))
+		{
+			return false;
+		}
+		// disabled by an earlier run
+		m_vAddress[i] = uAddress == uDisabledAddress ? 0 : uAddress;
+	}
+	if (m_pProfiler != nullptr)
+	{
+		m_pProfiler->LoadSymbol(m_ElfFile);
+	}
+	if (!m_InitialMemory.Copy(m_Memory, false))
+	{
+		return false;
+	}
+	m_bSupported = true;
+	return true;
+}
+
+bool CInitEmulator::IsSupported() const
+{
+	return m_bSupported;
+}
+
+// the loader finds the initializers through PT_DYNAMIC, section names are only a fallback for images without DT_INIT_ARRAY
+bool CInitEmulator::findInitEntry()
+{
+	u64 uEntrySize = m_ElfFile.get_class() == ELFCLASS64 ? 8 : 4;
+	u64 uPreInitArrayAddress = 0;
+	u64 uPreInitArraySize = 0;
+	u64 uInitAddress = 0;
+	u64 uInitFileOffset = 0;
+	u64 uInitArrayAddress = 0;
+	u64 uInitArraySize = 0;
+	bool bInitArray = false;
+	n32 nSegmentSize = m_ElfFile.segments.size();
+	for (n32 i = 0; i < nSegmentSize; i++)
+	{
+		segment* pSegment = m_ElfFile.segments[i];
+		if (pSegment == nullptr || pSegment->get_type() != PT_DYNAMIC)
+		{
+			continue;
+		}
+		const char* pDynamic = pSegment->get_data();
+		u64 uDynamicSize = pSegment->get_file_size();
+		for (u64 uOffset = 0; pDynamic != nullptr && uOffset + uEntrySize * 2 <= uDynamicSize; uOffset += uEntrySize * 2)
+		{
+			u64 uTag = 0;
+			u64 uValue = 0;
+			memcpy(&uTag, pDynamic + uOffset, static_cast<size_t>(uEntrySize));
+			memcpy(&uValue, pDynamic + uOffset + uEntrySize, static_cast<size_t>(uEntrySize));
+			if (uTag == DT_NULL)
+			{
+				break;
+			}
+			switch (uTag)
+			{
+			case DT_PREINIT_ARRAY:
+				uPreInitArrayAddress = uValue;
+				break;
+			case DT_PREINIT_ARRAYSZ:
+				uPreInitArraySize = uValue;
+				break;
+			case DT_INIT:
+				uInitAddress = uValue;
+				uInitFileOffset = pSegment->get_offset() + uOffset;
+				break;
+			case DT_INIT_ARRAY:
+				uInitArrayAddress = uValue;
+				bInitArray = true;
+				break;
+			case DT_INIT_ARRAYSZ:
+				uInitArraySize = uValue;
+				break;
+			default:
+				break;
+			}
+		}
+		break;
+	}
+	if (!bInitArray)
+	{
+		n32 nSectionSize = m_ElfFile.sections.size();
+		for (n32 i = 0; i < nSectionSize; i++)
+		{
+			section* pSection = m_ElfFile.sections[i];
+			if (pSection->get_name() == ".init_array")
+			{
+				uInitArrayAddress = pSection->get_address();
+				uInitArraySize = pSection->get_size();
+				break;
+			}
+		}
+	}
+	if (!addInitArray(DT_PREINIT_ARRAY, uPreInitArrayAddress, uPreInitArraySize))
+	{
+		return false;
+	}
+	if (uInitAddress != 0)
+	{
+		if (!isInFile(uInitFileOffset, uEntrySize))
+		{
+			return false;
+		}
+		SInitEntry entry;
+		entry.Tag = DT_INIT;
+		entry.Index = 0;
+		entry.Address = uInitAddress;
+		entry.FileOffset = uInitFileOffset;
+		entry.RelaDynIndex = -1;
+		m_vInitEntry.push_back(entry);
+	}
+	return addInitArray(DT_INIT_ARRAY, uInitArrayAddress, uInitArraySize);
+}
+
+bool CInitEmulator::addInitArray(u32 a_uTag, u64 a_uAddress, u64 a_uSize)
+{
+	u64 uEntrySize = m_ElfFile.get_class() == ELFCLASS64 ? 8 : 4;
+	if (a_uSize == 0)
+	{
+		return true;
+	}
+	// the slots are rewritten in the file, so they have to be file backed
+	n32 nSegmentSize = m_ElfFile.segments.size();
+	for (n32 i = 0; i < nSegmentSize; i++)
+	{
+		segment* pSegment = m_ElfFile.segments[i];
+		if (pSegment == nullptr || pSegment->get_type() != PT_LOAD || a_uAddress < pSegment->get_virtual_address() || a_uAddress - pSegment->get_virtual_address() > pSegment->get_file_size() || a_uSize > pSegment->get_file_size() - (a_uAddress - pSegment->get_virtual_address()))
+		{
+			continue;
+		}
+		u64 uFileOffset = pSegment->get_offset() + (a_uAddress - pSegment->get_virtual_address());
+		if (uFileOffset < pSegment->get_offset() || !isInFile(uFileOffset, a_uSize))
+		{
+			return false;
+		}
+		for (u64 uOffset = 0; uOffset + uEntrySize <= a_uSize; uOffset += uEntrySize)
+		{
+			SInitEntry entry;
+			entry.Tag = a_uTag;
+			entry.Index = static_cast<n32>(uOffset / uEntrySize);
+			entry.Address = a_uAddress + uOffset;
+			entry.FileOffset = uFileOffset + uOffset;
+			entry.RelaDynIndex = -1;
+			m_vInitEntry.push_back(entry);
+		}
+		return true;
+	}
+	return false;
+}
+
+// written as a subtraction, offsets and sizes come from the file and their sum may wrap
+bool CInitEmulator::isInFile(u64 a_uOffset, u64 a_uSize) const
+{
+	return a_uSize <= m_uElfSize && a_uOffset <= m_uElfSize - a_uSize;
+}
+
+// copies only the bytes that differ and records them, an untouched page of the mapping stays shared with the file
+void CInitEmulator::patch(u8* a_pElf, u64 a_uOffset, const u8* a_pData, u64 a_uSize)
+{
+	for (u64 i = 0; i < a_uSize;)
+	{
+		if (a_pElf[static_cast<size_t>(a_uOffset + i)] == a_pData[static_cast<size_t>(i)])
+		{
+			i++;
+			continue;
+		}
+		u64 uBegin = i;
+		for (i++; i < a_uSize && a_pElf[static_cast<size_t>(a_uOffset + i)] != a_pData[static_cast<size_t>(i)]; i++)
+		{
+		}
+		memcpy(a_pElf + static_cast<size_t>(a_uOffset + uBegin), a_pData + static_cast<size_t>(uBegin), static_cast<size_t>(i - uBegin));
+		if (!m_vPatchRange.empty() && m_vPatchRange.back().first + m_vPatchRange.back().second == a_uOffset + uBegin)
+		{
+			m_vPatchRange.back().second += i - uBegin;
+		}
+		else
+		{
+			m_vPatchRange.push_back(make_pair(a_uOffset + uBegin, i - uBegin));
+		}
+	}
+}
+
+string CInitEmulator::getEntryName(n32 a_nIndex) const
+{
+	const SInitEntry& entry = m_vInitEntry[a_nIndex];
+	if (entry.Tag == DT_INIT)
+	{
+		return "DT_INIT";
+	}
+	char szName[32] = {};
+	sprintf(szName, entry.Tag == DT_PREINIT_ARRAY ? ".preinit_array[%d]" : ".init_array[%d]", entry.Index);
+	return szName;
+}
+
+static bool isPageChanged(const vector<u32>& a_vPageList, const vector<u8>& a_vChangedPage)
+{
+	for (vector<u32>::const_iterator it = a_vPageList.begin(); it != a_vPageList.end(); ++it)
+	{
+		if (*it >= a_vChangedPage.size() || a_vChangedPage[*it] != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// marks the pages whose content after a rerun entry may differ from the last run, pages it wrote the same way stay as they were
+static void markChangedPage(const CManifest::SEntry* a_pOldEntry, const CManifest::SEntry& a_NewEntry, vector<u8>& a_vChangedPage)
+{
+	map<u32, size_t> mOldPage;
+	if (a_pOldEntry != nullptr && a_pOldEntry->Committed)
+	{
+		for (size_t i = 0; i < a_pOldEntry->WritePageList.size(); i++)
+		{
+			mOldPage.insert(make_pair(a_pOldEntry->WritePageList[i], i));
+		}
+	}
+	if (a_NewEntry.Committed)
+	{
+		for (size_t i = 0; i < a_NewEntry.WritePageList.size(); i++)
+		{
+			u32 uPage = a_NewEntry.WritePageList[i];
+			map<u32, size_t>::iterator it = mOldPage.find(uPage);
+			if (it == mOldPage.end() || memcmp(a_NewEntry.WritePageData.data() + i * CManifest::s_uPageSize, a_pOldEntry->WritePageData.data() + it->second * CManifest::s_uPageSize, static_cast<size_t>(CManifest::s_uPageSize)) != 0)
+			{
+				a_vChangedPage[uPage] = 1;
+			}
+			if (it != mOldPage.end())
+			{
+				mOldPage.erase(it);
+			}
+		}
+	}
+	// what only the last run wrote is not there this time
+	for (map<u32, size_t>::const_iterator it = mOldPage.begin(); it != mOldPage.end(); ++it)
+	{
+		a_vChangedPage[it->first] = 1;
+	}
+}
+
+bool CInitEmulator::Emulate()
+{
+	if (!m_bSupported)
+	{
+		return false;
+	}
+	CResultCache resultCache;
+	resultCache.SetDirName(m_sCacheDirName);
+	string sCacheKey;
+	bool bCached = false;
+	if (resultCache.IsEnabled())
+	{
+		CHashKey hashKey;
+		hashKey.Update(CResultCache::s_uVersion);
+		hashKey.Update(m_eCommitPolicy);
+		UpdateHashKey(hashKey, m_ImageLayout);
+		UpdateHashKey(hashKey, m_Budget);
+		UpdateHashKey(hashKey, m_Heap);
+		UpdateHashKey(hashKey, m_Thread);
+		const vector<SSegment>& vSegment = m_Memory.GetSegmentList();
+		for (n32 i = 0; i < static_cast<n32>(vSegment.size()); i++)
+		{
+			hashKey.Update(vSegment[i].Address);
+			hashKey.Update(m_Memory.GetSegmentMemory(i), static_cast<size_t>(vSegment[i].Size));
+		}
+		for (size_t i = 0; i < m_vInitEntry.size(); i++)
+		{
+			hashKey.Update(static_cast<u64>(m_vInitEntry[i].Tag));
+			hashKey.Update(m_vAddress[i]);
+		}
+		if (m_pRelaDynSection != nullptr)
+		{
+			hashKey.Update(m_pRelaDynSection->get_data(), static_cast<size_t>(m_pRelaDynSection->get_size()));
+		}
+		sCacheKey = hashKey.GetHexDigest();
+		// a cached result has no profile, the entries still run and the result is stored again
+		bCached = m_pProfiler == nullptr && resultCache.Load(sCacheKey, m_Memory, m_sInvalidIndex);
+	}
+	m_pMetrics->BeginStage("emulate");
+	n32 nEntryCount = static_cast<n32>(m_vAddress.size());
+	bool bManifest = !m_sManifestFileName.empty() && !bCached;
+	CManifest oldManifest;
+	CManifest newManifest;
+	// pages that may hold something else than in the last run at the current entry, an entry that touches none of them is replayed
+	vector<u8> vChangedPage;
+	bool bIncremental = false;
+	// heap addresses depend on every earlier allocation, from the first entry that allocates on everything runs again
+	bool bHeapUsed = false;
+	if (bManifest)
+	{
+		CHashKey hashKey;
+		hashKey.Update(CManifest::s_uVersion);
+		hashKey.Update(m_eCommitPolicy);
+		UpdateHashKey(hashKey, m_ImageLayout);
+		UpdateHashKey(hashKey, m_Budget);
+		UpdateHashKey(hashKey, m_Heap);
+		UpdateHashKey(hashKey, m_Thread);
+		newManifest.SetKey(hashKey.GetHexDigest());
+		newManifest.SetInitialMemory(m_Memory);
+		newManifest.GetEntryList().resize(nEntryCount);
+		// a profile needs every entry to run
+		bIncremental = m_pProfiler == nullptr && oldManifest.Load(m_sManifestFileName);
+		if (bIncremental)
+		{
+			newManifest.GetChangedPageList(oldManifest, vChangedPage);
+		}
+	}
+	vector<CSpeculator::SResult> vResult;
+	CPageTracker tracker;
+	CRunner runner;
+	runner.Init(m_ImageLayout, &m_Memory, m_eCommitPolicy);
+	runner.SetVerbose(m_bVerbose);
+	runner.SetCountInstruction(m_pMetrics->IsEnabled());
+	runner.SetBudget(m_Budget);
+	runner.SetHeap(m_Heap);
+	runner.SetThread(m_Thread);
+	runner.SetProfiler(m_pProfiler);
+	if (!bCached && m_nParallel > 1 && m_pProfiler == nullptr && !bManifest)
+	{
+		CSpeculator speculator;
+		speculator.SetJobs(m_nParallel);
+		speculator.SetCountInstruction(m_pMetrics->IsEnabled());
+		speculator.SetBudget(m_Budget);
+		speculator.SetHeap(m_Heap);
+		speculator.SetThread(m_Thread);
+		speculator.Run(m_ImageLayout, m_Memory, m_eCommitPolicy, m_vAddress, vResult);
+		tracker.SetRange(m_Memory.GetAddress(), m_Memory.GetSize());
+		runner.AddTracker(&tracker);
+	}
+	else if (bManifest)
+	{
+		tracker.SetRange(m_Memory.GetAddress(), m_Memory.GetSize());
+		tracker.SetTrackRead(true);
+		runner.AddTracker(&tracker);
+	}
+	// pages written by the entries committed so far, a speculative result that touched any of them is stale
+	vector<u8> vCommittedPage(static_cast<size_t>(m_Memory.GetSize() / CPageTracker::s_uPageSize), 0);
+	for (n32 i = 0; !bCached && i < nEntryCount; i++)
+	{
+		u64 uAddress = m_vAddress[i];
+		if (m_bVerbose)
+		{
+			printf("%s: %8llX\n", getEntryName(i).c_str(), uAddress);
+		}
+		if (uAddress == 0)
+		{
+			continue;
+		}
+		if (uAddress < m_ImageLayout.TextAddressMin || uAddress >= m_ImageLayout.TextAddressMax)
+		{
+			return false;
+		}
+		bool bSpeculated = !vResult.empty() && vResult[i].Valid;
+		if (bSpeculated)
+		{
+			const vector<u32>& vAccessPageList = vResult[i].AccessPageList;
+			for (vector<u32>::const_iterator it = vAccessPageList.begin(); it != vAccessPageList.end(); ++it)
+			{
+				if (vCommittedPage[*it] != 0)
+				{
+					bSpeculated = false;
+					break;
+				}
+			}
+		}
+		const CManifest::SEntry* pOldEntry = nullptr;
+		if (bIncremental && i < static_cast<n32>(oldManifest.GetEntryList().size()))
+		{
+			pOldEntry = &oldManifest.GetEntryList()[i];
+		}
+		bool bReused = pOldEntry != nullptr && pOldEntry->Address == uAddress && pOldEntry->HeapAllocationCount == 0 && !bHeapUsed && !isPageChanged(pOldEntry->FetchPageList, vChangedPage) && !isPageChanged(pOldEntry->ReadPageList, vChangedPage) && !isPageChanged(pOldEntry->WritePageList, vChangedPage);
+		CMetrics::SEntry entry;
+		entry.Index = i;
+		entry.Address = uAddress;
+		entry.Speculated = bSpeculated;
+		entry.Reused = bReused;
+		EEntryResult eEntryResult = kEntryResultFailed;
+		if (bReused)
+		{
+			// same code and same inputs as in the last run, its pages are put back as they were
+			const CManifest::SEntry& oldEntry = *pOldEntry;
+			entry.ExitReason = static_cast<EExitReason>(oldEntry.ExitReason);
+			memset(&entry.RunStat, 0, sizeof(entry.RunStat));
+			for (size_t j = 0; oldEntry.Committed && j < oldEntry.WritePageList.size(); j++)
+			{
+				// the runner sees every page clean between entries and takes the new bytes as they are
+				if (!m_Memory.Write(m_Memory.GetAddress() + oldEntry.WritePageList[j] * CManifest::s_uPageSize, oldEntry.WritePageData.data() + j * CManifest::s_uPageSize, CManifest::s_uPageSize))
+				{
+					return false;
+				}
+			}
+			eEntryResult = oldEntry.Committed ? kEntryResultCommitted : kEntryResultRolledBack;
+			newManifest.GetEntryList()[i] = oldEntry;
+		}
+		else if (bSpeculated)
+		{
+			const CSpeculator::SResult& result = vResult[i];
+			entry.ExitReason = result.ExitReason;
+			entry.RunStat = result.RunStat;
+			// a rolled back entry left its pages as they were, later results that read them still hold
+			for (size_t j = 0; result.EntryResult == kEntryResultCommitted && j < result.WritePageList.size(); j++)
+			{
+				if (!m_Memory.Write(m_Memory.GetAddress() + result.WritePageList[j] * CPageTracker::s_uPageSize, result.WritePageData.data() + j * CPageTracker::s_uPageSize, CPageTracker::s_uPageSize))
+				{
+					return false;
+				}
+				vCommittedPage[result.WritePageList[j]] = 1;
+			}
+			eEntryResult = result.EntryResult;
+		}
+		else
+		{
+			tracker.Clear();
+			EExitReason eExitReason = kExitReasonError;
+			if (m_pProfiler != nullptr)
+			{
+				m_pProfiler->BeginEntry(i, getEntryName(i));
+			}
+			bool bRun = runner.Run(uAddress, i, eExitReason);
+			if (m_pProfiler != nullptr)
+			{
+				m_pProfiler->EndEntry();
+			}
+			if (!bRun)
+			{
+				return false;
+			}
+			// committing or rolling back an entry is timed apart from running it
+			m_pMetrics->BeginStage("rollback");
+			eEntryResult = runner.Finish(eExitReason);
+			m_pMetrics->BeginStage("emulate");
+			entry.ExitReason = eExitReason;
+			entry.RunStat = runner.GetRunStat();
+			const vector<u32>& vWritePageList = tracker.GetWritePageList();
+			for (vector<u32>::const_iterator it = vWritePageList.begin(); eEntryResult == kEntryResultCommitted && it != vWritePageList.end(); ++it)
+			{
+				vCommittedPage[*it] = 1;
+			}
+			if (bManifest)
+			{
+				CManifest::SEntry& newEntry = newManifest.GetEntryList()[i];
+				newEntry.Address = uAddress;
+				newEntry.ExitReason = static_cast<u8>(eExitReason);
+				newEntry.Committed = eEntryResult == kEntryResultCommitted;
+				newEntry.Invalidated = newEntry.Committed && m_eCommitPolicy == kCommitPolicyData;
+				newEntry.HeapAllocationCount = entry.RunStat.HeapAllocationCount;
+				newEntry.FetchPageList = tracker.GetFetchPageList();
+				newEntry.ReadPageList = tracker.GetReadPageList();
+				newEntry.WritePageList = vWritePageList;
+				if (newEntry.Committed)
+				{
+					newEntry.WritePageData.resize(static_cast<size_t>(vWritePageList.size() * CManifest::s_uPageSize));
+					for (size_t j = 0; j < vWritePageList.size(); j++)
+					{
+						m_Memory.Read(m_Memory.GetAddress() + vWritePageList[j] * CManifest::s_uPageSize, &*newEntry.WritePageData.begin() + j * CManifest::s_uPageSize, CManifest::s_uPageSize);
+					}
+				}
+				if (bIncremental)
+				{
+					markChangedPage(pOldEntry, newEntry, vChangedPage);
+				}
+				bHeapUsed = bHeapUsed || newEntry.HeapAllocationCount != 0;
+			}
+		}
+		entry.Committed = eEntryResult == kEntryResultCommitted;
+		// only emuInit takes folded entries out of .init_array
+		entry.Invalidated = entry.Committed && m_eCommitPolicy == kCommitPolicyData;
+		m_pMetrics->AddEntry(entry);
+		if (eEntryResult == kEntryResultFailed)
+		{
+			return false;
+		}
+		else if (entry.Invalidated)
+		{
+			m_sInvalidIndex.insert(i);
+		}
+	}
+	if (resultCache.IsEnabled() && !bCached)
+	{
+		resultCache.Save(sCacheKey, m_InitialMemory, m_Memory, m_sInvalidIndex);
+	}
+	if (bManifest && !newManifest.Save(m_sManifestFileName) && m_bVerbose)
+	{
+		printf("Failed to write the manifest\n");
+	}
+	return true;
+}
+
+u64 CInitEmulator::GetMemoryAddress() const
+{
+	return m_Loader.GetMemoryAddress();
+}
+
+u64 CInitEmulator::GetMemoryAddressMax() const
+{
+	return m_Loader.GetMemoryAddressMax();
+}
+
+const vector<SSegment>& CInitEmulator::GetSegmentList() const
+{
+	return m_Loader.GetSegmentList();
+}
+
+const CMemoryImage& CInitEmulator::GetInitialMemory() const
+{
+	return m_InitialMemory;
+}
+
+const CMemoryImage& CInitEmulator::GetMemory() const
+{
+	return m_Memory;
+}
+
+const set<n32>& CInitEmulator::GetInvalidIndexSet() const
+{
+	return m_sInvalidIndex;
+}
+
+void CInitEmulator::GetDirtyRangeList(vector<pair<u64, u64>>& a_vDirtyRange) const
+{
+	a_vDirtyRange.clear();
+	const vector<SSegment>& vSegment = m_Memory.GetSegmentList();
+	for (n32 i = 0; i < static_cast<n32>(vSegment.size()); i++)
+	{
+		const u8* pMemory = m_Memory.GetSegmentMemory(i);
+		const u8* pInitialMemory = m_InitialMemory.GetPointer(vSegment[i].Address, vSegment[i].Size);
+		if (pInitialMemory == nullptr)
+		{
+			continue;
+		}
+		u64 uSize = vSegment[i].Size;
+		u64 uOffset = 0;
+		while (uOffset < uSize)
+		{
+			// equal pages are skipped whole
+			u64 uPageSize = min<u64>(CPageTracker::s_uPageSize, uSize - uOffset);
+			if (memcmp(pMemory + uOffset, pInitialMemory + uOffset, static_cast<size_t>(uPageSize)) == 0)
+			{
+				uOffset += uPageSize;
+				continue;
+			}
+			for (u64 uEnd = uOffset + uPageSize; uOffset < uEnd; uOffset++)
+			{
+				if (pMemory[uOffset] == pInitialMemory[uOffset])
+				{
+					continue;
+				}
+				u64 uAddress = vSegment[i].Address + uOffset;
+				if (!a_vDirtyRange.empty() && a_vDirtyRange.back().first + a_vDirtyRange.back().second == uAddress)
+				{
+					a_vDirtyRange.back().second++;
+				}
+				else
+				{
+					a_vDirtyRange.push_back(make_pair(uAddress, 1));
+				}
+			}
+		}
+	}
+}
+
+bool CInitEmulator::Serialize(u8* a_pElf)
+{
+	m_pMetrics->BeginStage("write");
+	m_vPatchRange.clear();
+	if (!m_bSupported || m_pDataSection == nullptr)
+	{
+		return m_bSupported;
+	}
+	string sData(static_cast<size_t>(m_pDataSection->get_size()), 0);
+	if (!sData.empty() && !m_Memory.Read(m_pDataSection->get_address(), &*sData.begin(), sData.size()))
+	{
+		return false;
+	}
+	// the dynamic linker applies the relocations again on device, it needs the file bytes there
+	m_Relocator.Restore(reinterpret_cast<u8*>(&*sData.begin()), m_pDataSection->get_address(), m_pDataSection->get_size());
+	patch(a_pElf, m_pDataSection->get_offset(), reinterpret_cast<const u8*>(sData.data()), sData.size());
+	if (m_sInvalidIndex.empty())
+	{
+		return true;
+	}
+	u32 uEntrySize = m_ElfFile.get_class() == ELFCLASS64 ? 8 : 4;
+	bool bRelaDynChanged = false;
+	for (set<n32>::const_iterator it = m_sInvalidIndex.begin(); it != m_sInvalidIndex.end(); ++it)
+	{
+		const SInitEntry& entry = m_vInitEntry[*it];
+		if (entry.Tag == DT_INIT)
+		{
+			// the loader would call whatever DT_INIT points at, DT_DEBUG only makes it store a pointer to its debug data there
+			u64 uTag = DT_DEBUG;
+			patch(a_pElf, entry.FileOffset, reinterpret_cast<const u8*>(&uTag), uEntrySize);
+		}
+		else if (entry.RelaDynIndex < 0)
+		{
+			// -1 in either width
+			u64 uNone = UINT64_MAX;
+			patch(a_pElf, entry.FileOffset, reinterpret_cast<const u8*>(&uNone), uEntrySize);
+		}
+		else
+		{
+			relocation_section_accessor relaDynSection(m_ElfFile, m_pRelaDynSection);
+			Elf64_Addr uOffset = 0;
+			Elf_Word uSymbol = 0;
+			Elf_Word uType = 0;
+			Elf_Sxword nAddend = 0;
+			if (!relaDynSection.get_entry(entry.RelaDynIndex, uOffset, uSymbol, uType, nAddend))
+			{
+				return false;
+			}
+			relaDynSection.set_entry(entry.RelaDynIndex, uOffset, uSymbol, uType, -1);
+			bRelaDynChanged = true;
+		}
+	}
+	if (bRelaDynChanged)
+	{
+		patch(a_pElf, m_pRelaDynSection->get_offset(), reinterpret_cast<const u8*>(m_pRelaDynSection->get_data()), m_pRelaDynSection->get_size());
+	}
+	sort(m_vPatchRange.begin(), m_vPatchRange.end());
+	return true;
+}
+
+const vector<pair<u64, u64>>& CInitEmulator::GetPatchRangeList() const
+{
+	return m_vPatchRange;
+}
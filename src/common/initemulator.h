@@ -0,0 +1,103 @@
+#ifndef INITEMULATOR_H_
+#define INITEMULATOR_H_
+
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include "engine.h"
+#include "loader.h"
+#include "mappedfile.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "relocator.h"
+#include "runner.h"
+
+// the whole of emuInit over an ELF image in memory: load, run the initializers, query what changed and patch the image, both tools are front-ends of it
+class CInitEmulator
+{
+public:
+	CInitEmulator();
+	// kCommitPolicyData folds the entries into .data like emuInit, kCommitPolicyAlways keeps everything like dumpInitMemory
+	void SetCommitPolicy(ECommitPolicy a_eCommitPolicy);
+	void SetVerbose(bool a_bVerbose);
+	void SetParallel(n32 a_nParallel);
+	void SetCacheDirName(const UString& a_sCacheDirName);
+	void SetBudget(const SBudget& a_Budget);
+	void SetHeap(const SHeap& a_Heap);
+	void SetThread(const SThread& a_Thread);
+	// stages and entries are recorded here, nullptr records nothing
+	void SetMetrics(CMetrics* a_pMetrics);
+	// block profile of every entry, nullptr profiles nothing, profiling bypasses the cache and speculation so each entry runs here
+	void SetProfiler(CProfiler* a_pProfiler);
+	// reads the footprints of the last run from here and writes the new ones back, entries whose pages did not change are replayed from it, empty disables
+	void SetManifestFileName(const UString& a_sManifestFileName);
+	// false for images that cannot be handled
+	bool Load(const u8* a_pElf, u64 a_uElfSize);
+	// false when the image has nothing to run, emuInit then leaves it as it is
+	bool IsSupported() const;
+	bool Emulate();
+	u64 GetMemoryAddress() const;
+	// unaligned end of the image
+	u64 GetMemoryAddressMax() const;
+	const vector<SSegment>& GetSegmentList() const;
+	// the relocated image before any entry ran
+	const CMemoryImage& GetInitialMemory() const;
+	const CMemoryImage& GetMemory() const;
+	// the initializers folded into .data, indices in loader order
+	const set<n32>& GetInvalidIndexSet() const;
+	// address and size of every byte run the entries changed
+	void GetDirtyRangeList(vector<pair<u64, u64>>& a_vDirtyRange) const;
+	// writes the new .data into a_pElf, a copy of the loaded image, and disables the folded entries
+	bool Serialize(u8* a_pElf);
+	// file offset and size of every byte run Serialize changed, ascending
+	const vector<pair<u64, u64>>& GetPatchRangeList() const;
+private:
+	// one function the loader calls, .preinit_array entries, then DT_INIT, then .init_array entries
+	struct SInitEntry
+	{
+		// DT_PREINIT_ARRAY, DT_INIT or DT_INIT_ARRAY
+		u32 Tag;
+		// index within its array
+		n32 Index;
+		// the array slot, or the function of DT_INIT
+		u64 Address;
+		// the array slot, or the DT_INIT entry of PT_DYNAMIC
+		u64 FileOffset;
+		// the .rela.dyn entry relocating the array slot, -1 for none
+		n32 RelaDynIndex;
+	};
+	CInitEmulator(const CInitEmulator&);
+	CInitEmulator& operator=(const CInitEmulator&);
+	bool findInitEntry();
+	bool addInitArray(u32 a_uTag, u64 a_uAddress, u64 a_uSize);
+	string getEntryName(n32 a_nIndex) const;
+	bool isInFile(u64 a_uOffset, u64 a_uSize) const;
+	void patch(u8* a_pElf, u64 a_uOffset, const u8* a_pData, u64 a_uSize);
+	ECommitPolicy m_eCommitPolicy;
+	bool m_bVerbose;
+	n32 m_nParallel;
+	UString m_sCacheDirName;
+	UString m_sManifestFileName;
+	SBudget m_Budget;
+	SHeap m_Heap;
+	SThread m_Thread;
+	CMetrics m_Metrics;
+	CMetrics* m_pMetrics;
+	CProfiler* m_pProfiler;
+	u64 m_uElfSize;
+	ELFIO::elfio m_ElfFile;
+	bool m_bSupported;
+	ELFIO::section* m_pDataSection;
+	ELFIO::section* m_pRelaDynSection;
+	CLoader m_Loader;
+	CRelocator m_Relocator;
+	SImageLayout m_ImageLayout;
+	vector<SInitEntry> m_vInitEntry;
+	// the function of each entry of m_vInitEntry, 0 to skip
+	vector<u64> m_vAddress;
+	CMemoryImage m_InitialMemory;
+	CMemoryImage m_Memory;
+	set<n32> m_sInvalidIndex;
+	vector<pair<u64, u64>> m_vPatchRange;
+};
+
+#endif	// INITEMULATOR_H_
@@ -0,0 +1,127 @@
+#include "loader.h"
+
+using namespace ELFIO;
+
+CLoader::CLoader()
+	: m_uMemoryAddress(0)
+	, m_uMemoryAddressMax(0)
+	, m_uTextAddressMin(0)
+	, m_uTextAddressMax(0)
+{
+}
+
+bool CLoader::Load(const elfio& a_ElfFile, CMemoryImage& a_Memory)
+{
+	m_vSegment.clear();
+	m_uMemoryAddress = UINT64_MAX;
+	m_uMemoryAddressMax = 0;
+	m_uTextAddressMin = UINT64_MAX;
+	m_uTextAddressMax = 0;
+	map<u64, SSegment> mSegment;
+	n32 nSegmentSize = a_ElfFile.segments.size();
+	for (n32 i = 0; i < nSegmentSize; i++)
+	{
+		const segment* pSegment = a_ElfFile.segments[i];
+		if (pSegment == nullptr)
+		{
+			return false;
+		}
+		if (pSegment->get_type() != PT_LOAD || pSegment->get_memory_size() == 0)
+		{
+			continue;
+		}
+		u64 uAddress = pSegment->get_virtual_address();
+		u64 uSize = pSegment->get_memory_size();
+		if (pSegment->get_file_size() > uSize || uSize > UINT64_MAX - 4096 - uAddress)
+		{
+			return false;
+		}
+		u32 uFlags = pSegment->get_flags();
+		SSegment& seg = mSegment[uAddress / 4096 * 4096];
+		u64 uEnd = Align(uAddress + uSize, 4096);
+		seg.Address = uAddress / 4096 * 4096;
+		seg.Size = max<u64>(seg.Size, uEnd - seg.Address);
+		seg.Protection |= ((uFlags & PF_R) != 0 ? UC_PROT_READ : 0) | ((uFlags & PF_W) != 0 ? UC_PROT_WRITE : 0) | ((uFlags & PF_X) != 0 ? UC_PROT_EXEC : 0);
+		if (uAddress < m_uMemoryAddress)
+		{
+			m_uMemoryAddress = uAddress;
+		}
+		if (uAddress + uSize > m_uMemoryAddressMax)
+		{
+			m_uMemoryAddressMax = uAddress + uSize;
+		}
+		if ((uFlags & PF_X) != 0)
+		{
+			if (uAddress < m_uTextAddressMin)
+			{
+				m_uTextAddressMin = uAddress;
+			}
+			if (uAddress + uSize > m_uTextAddressMax)
+			{
+				m_uTextAddressMax = uAddress + uSize;
+			}
+		}
+	}
+	if (mSegment.empty() || m_uTextAddressMin >= m_uTextAddressMax)
+	{
+		return false;
+	}
+	// segments sharing a page are mapped once with the union of their protections
+	for (map<u64, SSegment>::const_iterator it = mSegment.begin(); it != mSegment.end(); ++it)
+	{
+		if (!m_vSegment.empty() && it->second.Address < m_vSegment.back().Address + m_vSegment.back().Size)
+		{
+			SSegment& seg = m_vSegment.back();
+			seg.Size = max<u64>(seg.Size, it->second.Address + it->second.Size - seg.Address);
+			seg.Protection |= it->second.Protection;
+		}
+		else
+		{
+			m_vSegment.push_back(it->second);
+		}
+	}
+	m_uMemoryAddress = m_uMemoryAddress / 4096 * 4096;
+	if (!a_Memory.Create(m_vSegment))
+	{
+		// a segment does not fit the address space of a 32-bit host or cannot be reserved
+		return false;
+	}
+	for (n32 i = 0; i < nSegmentSize; i++)
+	{
+		const segment* pSegment = a_ElfFile.segments[i];
+		if (pSegment->get_type() != PT_LOAD || pSegment->get_file_size() == 0 || pSegment->get_data() == nullptr)
+		{
+			continue;
+		}
+		if (!a_Memory.Write(pSegment->get_virtual_address(), pSegment->get_data(), pSegment->get_file_size()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+u64 CLoader::GetMemoryAddress() const
+{
+	return m_uMemoryAddress;
+}
+
+u64 CLoader::GetMemoryAddressMax() const
+{
+	return m_uMemoryAddressMax;
+}
+
+u64 CLoader::GetTextAddressMin() const
+{
+	return m_uTextAddressMin;
+}
+
+u64 CLoader::GetTextAddressMax() const
+{
+	return m_uTextAddressMax;
+}
+
+const vector<SSegment>& CLoader::GetSegmentList() const
+{
+	return m_vSegment;
+}
@@ -0,0 +1,29 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include "memoryimage.h"
+
+// builds the emulated image from the PT_LOAD segments, bss stays zero and the gaps between segments are not backed at all
+class CLoader
+{
+public:
+	CLoader();
+	bool Load(const ELFIO::elfio& a_ElfFile, CMemoryImage& a_Memory);
+	u64 GetMemoryAddress() const;
+	// end of the last segment, not page aligned
+	u64 GetMemoryAddressMax() const;
+	// span of the executable segments
+	u64 GetTextAddressMin() const;
+	u64 GetTextAddressMax() const;
+	const vector<SSegment>& GetSegmentList() const;
+private:
+	u64 m_uMemoryAddress;
+	u64 m_uMemoryAddressMax;
+	u64 m_uTextAddressMin;
+	u64 m_uTextAddressMax;
+	vector<SSegment> m_vSegment;
+};
+
+#endif	// LOADER_H_
@@ -0,0 +1,194 @@
+#include "manifest.h"
+#include "hash.h"
+
+const u32 CManifest::s_uSignature = SDW_CONVERT_ENDIAN32('EIMF');
+const u32 CManifest::s_uVersion = 1;
+const u64 CManifest::s_uPageSize = 4096;
+
+CManifest::SEntry::SEntry()
+	: Address(0)
+	, ExitReason(0)
+	, Committed(false)
+	, Invalidated(false)
+	, HeapAllocationCount(0)
+{
+}
+
+CManifest::CManifest()
+{
+}
+
+void CManifest::SetKey(const string& a_sKey)
+{
+	m_sKey = a_sKey;
+}
+
+const string& CManifest::GetKey() const
+{
+	return m_sKey;
+}
+
+void CManifest::SetInitialMemory(const CMemoryImage& a_Memory)
+{
+	u64 uPageCount = a_Memory.GetSize() / s_uPageSize;
+	// the gaps between segments hash like zero pages
+	string sZeroPage(static_cast<size_t>(s_uPageSize), 0);
+	u64 uZeroPageHash = Hash64(sZeroPage.data(), sZeroPage.size(), 0);
+	m_vPageHash.assign(static_cast<size_t>(uPageCount), uZeroPageHash);
+	const vector<SSegment>& vSegment = a_Memory.GetSegmentList();
+	for (n32 i = 0; i < static_cast<n32>(vSegment.size()); i++)
+	{
+		const u8* pMemory = a_Memory.GetSegmentMemory(i);
+		u64 uPage = (vSegment[i].Address - a_Memory.GetAddress()) / s_uPageSize;
+		for (u64 uOffset = 0; uOffset < vSegment[i].Size; uOffset += s_uPageSize)
+		{
+			m_vPageHash[static_cast<size_t>(uPage + uOffset / s_uPageSize)] = Hash64(pMemory + uOffset, static_cast<size_t>(s_uPageSize), 0);
+		}
+	}
+}
+
+void CManifest::GetChangedPageList(const CManifest& a_Manifest, vector<u8>& a_vChangedPage) const
+{
+	if (m_sKey != a_Manifest.m_sKey || m_vPageHash.size() != a_Manifest.m_vPageHash.size())
+	{
+		a_vChangedPage.assign(m_vPageHash.size(), 1);
+		return;
+	}
+	a_vChangedPage.assign(m_vPageHash.size(), 0);
+	for (size_t i = 0; i < m_vPageHash.size(); i++)
+	{
+		if (m_vPageHash[i] != a_Manifest.m_vPageHash[i])
+		{
+			a_vChangedPage[i] = 1;
+		}
+	}
+}
+
+vector<CManifest::SEntry>& CManifest::GetEntryList()
+{
+	return m_vEntry;
+}
+
+const vector<CManifest::SEntry>& CManifest::GetEntryList() const
+{
+	return m_vEntry;
+}
+
+static bool readPageList(FILE* a_fp, u32 a_uCount, vector<u32>& a_vPageList)
+{
+	a_vPageList.resize(a_uCount);
+	return a_vPageList.empty() || fread(&*a_vPageList.begin(), sizeof(u32), a_vPageList.size(), a_fp) == a_vPageList.size();
+}
+
+static bool writePageList(FILE* a_fp, const vector<u32>& a_vPageList)
+{
+	return a_vPageList.empty() || fwrite(&*a_vPageList.begin(), sizeof(u32), a_vPageList.size(), a_fp) == a_vPageList.size();
+}
+
+// header, key, page hashes, then per entry its fixed fields, the three page lists and the written pages of a committed entry
+bool CManifest::Load(const UString& a_sFileName)
+{
+	m_sKey.clear();
+	m_vPageHash.clear();
+	m_vEntry.clear();
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("rb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	u32 uHeader[4] = {};
+	u64 uPageCount = 0;
+	bool bResult = fread(uHeader, sizeof(uHeader), 1, fp) == 1 && uHeader[0] == s_uSignature && uHeader[1] == s_uVersion;
+	if (bResult)
+	{
+		m_sKey.resize(uHeader[2]);
+		bResult = m_sKey.empty() || fread(&*m_sKey.begin(), 1, m_sKey.size(), fp) == m_sKey.size();
+	}
+	bResult = bResult && fread(&uPageCount, sizeof(uPageCount), 1, fp) == 1;
+	if (bResult)
+	{
+		m_vPageHash.resize(static_cast<size_t>(uPageCount));
+		bResult = m_vPageHash.empty() || fread(&*m_vPageHash.begin(), sizeof(u64), m_vPageHash.size(), fp) == m_vPageHash.size();
+	}
+	if (bResult)
+	{
+		m_vEntry.resize(uHeader[3]);
+	}
+	for (vector<SEntry>::iterator it = m_vEntry.begin(); bResult && it != m_vEntry.end(); ++it)
+	{
+		SEntry& entry = *it;
+		u64 uValue[2] = {};
+		u8 uFlag[4] = {};
+		u32 uCount[3] = {};
+		bResult = fread(uValue, sizeof(uValue), 1, fp) == 1 && fread(uFlag, sizeof(uFlag), 1, fp) == 1 && fread(uCount, sizeof(uCount), 1, fp) == 1;
+		if (!bResult)
+		{
+			break;
+		}
+		entry.Address = uValue[0];
+		entry.HeapAllocationCount = uValue[1];
+		entry.ExitReason = uFlag[0];
+		entry.Committed = uFlag[1] != 0;
+		entry.Invalidated = uFlag[2] != 0;
+		bResult = readPageList(fp, uCount[0], entry.FetchPageList) && readPageList(fp, uCount[1], entry.ReadPageList) && readPageList(fp, uCount[2], entry.WritePageList);
+		if (bResult && entry.Committed && !entry.WritePageList.empty())
+		{
+			entry.WritePageData.resize(static_cast<size_t>(entry.WritePageList.size() * s_uPageSize));
+			bResult = fread(&*entry.WritePageData.begin(), 1, entry.WritePageData.size(), fp) == entry.WritePageData.size();
+		}
+	}
+	fclose(fp);
+	if (!bResult)
+	{
+		m_sKey.clear();
+		m_vPageHash.clear();
+		m_vEntry.clear();
+	}
+	return bResult;
+}
+
+bool CManifest::Save(const UString& a_sFileName) const
+{
+	// write a private file and rename it, a failed run leaves the old manifest alone
+	UString sTempFileName = a_sFileName + USTR(".tmp");
+	FILE* fp = UFopen(sTempFileName.c_str(), USTR("wb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	u32 uHeader[4] = { s_uSignature, s_uVersion, static_cast<u32>(m_sKey.size()), static_cast<u32>(m_vEntry.size()) };
+	u64 uPageCount = m_vPageHash.size();
+	bool bResult = fwrite(uHeader, sizeof(uHeader), 1, fp) == 1 && fwrite(m_sKey.data(), 1, m_sKey.size(), fp) == m_sKey.size() && fwrite(&uPageCount, sizeof(uPageCount), 1, fp) == 1;
+	if (bResult && !m_vPageHash.empty())
+	{
+		bResult = fwrite(&*m_vPageHash.begin(), sizeof(u64), m_vPageHash.size(), fp) == m_vPageHash.size();
+	}
+	for (vector<SEntry>::const_iterator it = m_vEntry.begin(); bResult && it != m_vEntry.end(); ++it)
+	{
+		const SEntry& entry = *it;
+		u64 uValue[2] = { entry.Address, entry.HeapAllocationCount };
+		u8 uFlag[4] = { entry.ExitReason, static_cast<u8>(entry.Committed ? 1 : 0), static_cast<u8>(entry.Invalidated ? 1 : 0), 0 };
+		u32 uCount[3] = { static_cast<u32>(entry.FetchPageList.size()), static_cast<u32>(entry.ReadPageList.size()), static_cast<u32>(entry.WritePageList.size()) };
+		bResult = fwrite(uValue, sizeof(uValue), 1, fp) == 1 && fwrite(uFlag, sizeof(uFlag), 1, fp) == 1 && fwrite(uCount, sizeof(uCount), 1, fp) == 1;
+		bResult = bResult && writePageList(fp, entry.FetchPageList) && writePageList(fp, entry.ReadPageList) && writePageList(fp, entry.WritePageList);
+		if (bResult && entry.Committed)
+		{
+			bResult = fwrite(entry.WritePageData.data(), 1, entry.WritePageData.size(), fp) == entry.WritePageData.size();
+		}
+	}
+	fclose(fp);
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	if (!bResult || MoveFileExW(sTempFileName.c_str(), a_sFileName.c_str(), MOVEFILE_REPLACE_EXISTING) == 0)
+#else
+	if (!bResult || rename(sTempFileName.c_str(), a_sFileName.c_str()) != 0)
+#endif
+	{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+		_wremove(sTempFileName.c_str());
+#else
+		remove(sTempFileName.c_str());
+#endif
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,47 @@
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <sdw.h>
+#include "memoryimage.h"
+
+// footprint and result of every entry of the last run, the next run replays the entries whose pages did not change instead of running them
+class CManifest
+{
+public:
+	struct SEntry
+	{
+		SEntry();
+		u64 Address;
+		u8 ExitReason;
+		bool Committed;
+		bool Invalidated;
+		u64 HeapAllocationCount;
+		// pages of the image, relative to its 4K aligned start
+		vector<u32> FetchPageList;
+		vector<u32> ReadPageList;
+		vector<u32> WritePageList;
+		// the written pages right after a committed entry, empty otherwise
+		string WritePageData;
+	};
+	CManifest();
+	// hash of everything but the memory that decides the results, manifests with another key are not used
+	void SetKey(const string& a_sKey);
+	const string& GetKey() const;
+	// hashes each page of the image the entries start from
+	void SetInitialMemory(const CMemoryImage& a_Memory);
+	// one flag per page whose initial content differs from a_Manifest, every page if the keys or sizes differ
+	void GetChangedPageList(const CManifest& a_Manifest, vector<u8>& a_vChangedPage) const;
+	vector<SEntry>& GetEntryList();
+	const vector<SEntry>& GetEntryList() const;
+	bool Load(const UString& a_sFileName);
+	bool Save(const UString& a_sFileName) const;
+	static const u32 s_uSignature;
+	static const u32 s_uVersion;
+	static const u64 s_uPageSize;
+private:
+	string m_sKey;
+	vector<u64> m_vPageHash;
+	vector<SEntry> m_vEntry;
+};
+
+#endif	// MANIFEST_H_
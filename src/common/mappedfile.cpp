@@ -0,0 +1,155 @@
+#include "mappedfile.h"
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+CMappedFile::CMappedFile()
+	: m_pData(nullptr)
+	, m_uSize(0)
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	, m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(nullptr)
+#endif
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Open(const UString& a_sFileName)
+{
+	Close();
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	m_hFile = CreateFileW(a_sFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER nFileSize;
+	if (!GetFileSizeEx(m_hFile, &nFileSize) || nFileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	m_uSize = static_cast<u64>(nFileSize.QuadPart);
+	if (m_uSize > SIZE_MAX)
+	{
+		Close();
+		return false;
+	}
+	m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (m_hMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_pData = static_cast<u8*>(MapViewOfFile(m_hMapping, FILE_MAP_COPY, 0, 0, 0));
+	if (m_pData == nullptr)
+	{
+		Close();
+		return false;
+	}
+#else
+	int nFd = open(a_sFileName.c_str(), O_RDONLY);
+	if (nFd == -1)
+	{
+		return false;
+	}
+	struct stat st;
+	// a file larger than the address space of a 32-bit host cannot be mapped whole
+	if (fstat(nFd, &st) != 0 || st.st_size == 0 || static_cast<u64>(st.st_size) > SIZE_MAX)
+	{
+		close(nFd);
+		return false;
+	}
+	m_uSize = static_cast<u64>(st.st_size);
+	void* pData = mmap(nullptr, static_cast<size_t>(m_uSize), PROT_READ | PROT_WRITE, MAP_PRIVATE, nFd, 0);
+	close(nFd);
+	if (pData == MAP_FAILED)
+	{
+		m_uSize = 0;
+		return false;
+	}
+	m_pData = static_cast<u8*>(pData);
+#endif
+	return true;
+}
+
+void CMappedFile::Close()
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_hMapping != nullptr)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pData != nullptr)
+	{
+		munmap(m_pData, static_cast<size_t>(m_uSize));
+	}
+#endif
+	m_pData = nullptr;
+	m_uSize = 0;
+}
+
+u8* CMappedFile::GetData() const
+{
+	return m_pData;
+}
+
+u64 CMappedFile::GetSize() const
+{
+	return m_uSize;
+}
+
+CMemoryStreamBuf::CMemoryStreamBuf(const u8* a_pData, u64 a_uSize)
+{
+	char* pBegin = const_cast<char*>(reinterpret_cast<const char*>(a_pData));
+	setg(pBegin, pBegin, pBegin + a_uSize);
+}
+
+CMemoryStreamBuf::pos_type CMemoryStreamBuf::seekoff(off_type a_nOffset, ios_base::seekdir a_eDir, ios_base::openmode a_eMode)
+{
+	if ((a_eMode & ios_base::in) == 0)
+	{
+		return pos_type(off_type(-1));
+	}
+	char* pPosition = nullptr;
+	if (a_eDir == ios_base::beg)
+	{
+		pPosition = eback() + a_nOffset;
+	}
+	else if (a_eDir == ios_base::cur)
+	{
+		pPosition = gptr() + a_nOffset;
+	}
+	else
+	{
+		pPosition = egptr() + a_nOffset;
+	}
+	if (pPosition < eback() || pPosition > egptr())
+	{
+		return pos_type(off_type(-1));
+	}
+	setg(eback(), pPosition, egptr());
+	return pos_type(pPosition - eback());
+}
+
+CMemoryStreamBuf::pos_type CMemoryStreamBuf::seekpos(pos_type a_nPosition, ios_base::openmode a_eMode)
+{
+	return seekoff(off_type(a_nPosition), ios_base::beg, a_eMode);
+}
@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <sdw.h>
+
+// private copy-on-write mapping of a whole file, writes only cost the pages they touch and never reach the file
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+	bool Open(const UString& a_sFileName);
+	void Close();
+	u8* GetData() const;
+	u64 GetSize() const;
+private:
+	CMappedFile(const CMappedFile&);
+	CMappedFile& operator=(const CMappedFile&);
+	u8* m_pData;
+	u64 m_uSize;
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+#endif
+};
+
+// read-only stream over a memory buffer, lets ELFIO parse the mapping without opening the file again
+class CMemoryStreamBuf : public streambuf
+{
+public:
+	CMemoryStreamBuf(const u8* a_pData, u64 a_uSize);
+protected:
+	virtual pos_type seekoff(off_type a_nOffset, ios_base::seekdir a_eDir, ios_base::openmode a_eMode = ios_base::in | ios_base::out);
+	virtual pos_type seekpos(pos_type a_nPosition, ios_base::openmode a_eMode = ios_base::in | ios_base::out);
+};
+
+#endif	// MAPPEDFILE_H_
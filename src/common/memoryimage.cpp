@@ -0,0 +1,175 @@
+#include "memoryimage.h"
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+#include <sys/mman.h>
+#endif
+
+const u64 CMemoryImage::s_uPageSize = 4096;
+
+static bool compareSegmentAddress(u64 a_uAddress, const SSegment& a_Segment)
+{
+	return a_uAddress < a_Segment.Address;
+}
+
+CMemoryImage::CMemoryImage()
+{
+}
+
+CMemoryImage::~CMemoryImage()
+{
+	Clear();
+}
+
+bool CMemoryImage::Create(const vector<SSegment>& a_vSegment)
+{
+	Clear();
+	for (vector<SSegment>::const_iterator it = a_vSegment.begin(); it != a_vSegment.end(); ++it)
+	{
+		if (it->Size == 0 || it->Address % s_uPageSize != 0 || it->Size % s_uPageSize != 0 || it->Size > UINT64_MAX - it->Address || (!m_vSegment.empty() && it->Address < m_vSegment.back().Address + m_vSegment.back().Size))
+		{
+			Clear();
+			return false;
+		}
+		if (it->Size > SIZE_MAX)
+		{
+			// the segment does not fit the address space of a 32-bit host
+			Clear();
+			return false;
+		}
+		u8* pMemory = allocate(it->Size);
+		if (pMemory == nullptr)
+		{
+			Clear();
+			return false;
+		}
+		m_vSegment.push_back(*it);
+		m_vMemory.push_back(pMemory);
+	}
+	return true;
+}
+
+bool CMemoryImage::Copy(const CMemoryImage& a_Memory, bool a_bWritableOnly)
+{
+	vector<SSegment> vSegment;
+	vector<const u8*> vSource;
+	for (n32 i = 0; i < static_cast<n32>(a_Memory.m_vSegment.size()); i++)
+	{
+		if (!a_bWritableOnly || (a_Memory.m_vSegment[i].Protection & UC_PROT_WRITE) != 0)
+		{
+			vSegment.push_back(a_Memory.m_vSegment[i]);
+			vSource.push_back(a_Memory.m_vMemory[i]);
+		}
+	}
+	if (!Create(vSegment))
+	{
+		return false;
+	}
+	for (n32 i = 0; i < static_cast<n32>(m_vSegment.size()); i++)
+	{
+		// a zero page is left alone, writing it would back it
+		for (u64 uOffset = 0; uOffset < m_vSegment[i].Size; uOffset += s_uPageSize)
+		{
+			if (!IsZero(vSource[i] + uOffset, s_uPageSize))
+			{
+				memcpy(m_vMemory[i] + uOffset, vSource[i] + uOffset, static_cast<size_t>(s_uPageSize));
+			}
+		}
+	}
+	return true;
+}
+
+void CMemoryImage::Clear()
+{
+	for (n32 i = 0; i < static_cast<n32>(m_vMemory.size()); i++)
+	{
+		release(m_vMemory[i], m_vSegment[i].Size);
+	}
+	m_vSegment.clear();
+	m_vMemory.clear();
+}
+
+const vector<SSegment>& CMemoryImage::GetSegmentList() const
+{
+	return m_vSegment;
+}
+
+u64 CMemoryImage::GetAddress() const
+{
+	return m_vSegment.empty() ? 0 : m_vSegment.front().Address;
+}
+
+u64 CMemoryImage::GetSize() const
+{
+	return m_vSegment.empty() ? 0 : m_vSegment.back().Address + m_vSegment.back().Size - m_vSegment.front().Address;
+}
+
+u8* CMemoryImage::GetSegmentMemory(n32 a_nIndex) const
+{
+	return m_vMemory[a_nIndex];
+}
+
+u8* CMemoryImage::GetPointer(u64 a_uAddress, u64 a_uSize) const
+{
+	vector<SSegment>::const_iterator it = upper_bound(m_vSegment.begin(), m_vSegment.end(), a_uAddress, compareSegmentAddress);
+	if (it == m_vSegment.begin())
+	{
+		return nullptr;
+	}
+	--it;
+	u64 uOffset = a_uAddress - it->Address;
+	if (uOffset >= it->Size || a_uSize > it->Size - uOffset)
+	{
+		return nullptr;
+	}
+	return m_vMemory[it - m_vSegment.begin()] + uOffset;
+}
+
+bool CMemoryImage::Read(u64 a_uAddress, void* a_pData, u64 a_uSize) const
+{
+	const u8* pMemory = GetPointer(a_uAddress, a_uSize);
+	if (pMemory == nullptr)
+	{
+		return false;
+	}
+	memcpy(a_pData, pMemory, static_cast<size_t>(a_uSize));
+	return true;
+}
+
+bool CMemoryImage::Write(u64 a_uAddress, const void* a_pData, u64 a_uSize)
+{
+	u8* pMemory = GetPointer(a_uAddress, a_uSize);
+	if (pMemory == nullptr)
+	{
+		return false;
+	}
+	memcpy(pMemory, a_pData, static_cast<size_t>(a_uSize));
+	return true;
+}
+
+bool CMemoryImage::IsZero(const u8* a_pData, u64 a_uSize)
+{
+	return a_uSize == 0 || (a_pData[0] == 0 && memcmp(a_pData, a_pData + 1, static_cast<size_t>(a_uSize - 1)) == 0);
+}
+
+// anonymous memory comes zeroed from the system and a page is only backed once it is written, a large .bss costs what the entries write of it
+u8* CMemoryImage::allocate(u64 a_uSize)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return static_cast<u8*>(VirtualAlloc(nullptr, static_cast<size_t>(a_uSize), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+	int nFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+	nFlags |= MAP_NORESERVE;
+#endif
+	void* pMemory = mmap(nullptr, static_cast<size_t>(a_uSize), PROT_READ | PROT_WRITE, nFlags, -1, 0);
+	return pMemory != MAP_FAILED ? static_cast<u8*>(pMemory) : nullptr;
+#endif
+}
+
+void CMemoryImage::release(u8* a_pMemory, u64 a_uSize)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	VirtualFree(a_pMemory, 0, MEM_RELEASE);
+#else
+	munmap(a_pMemory, static_cast<size_t>(a_uSize));
+#endif
+}
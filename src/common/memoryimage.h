@@ -0,0 +1,47 @@
+#ifndef MEMORYIMAGE_H_
+#define MEMORYIMAGE_H_
+
+#include <sdw.h>
+#include <unicorn/unicorn.h>
+
+struct SSegment
+{
+	// page aligned
+	u64 Address;
+	u64 Size;
+	// UC_PROT_*
+	u32 Protection;
+};
+
+// the emulated image, one host buffer per segment so the gaps between segments cost nothing, every buffer is anonymous memory that is only backed once a page is touched
+class CMemoryImage
+{
+public:
+	CMemoryImage();
+	~CMemoryImage();
+	// zero filled, the segments are sorted and do not overlap
+	bool Create(const vector<SSegment>& a_vSegment);
+	// only the non-zero pages are copied, the others stay unbacked
+	bool Copy(const CMemoryImage& a_Memory, bool a_bWritableOnly);
+	void Clear();
+	const vector<SSegment>& GetSegmentList() const;
+	// span of the segments, page aligned
+	u64 GetAddress() const;
+	u64 GetSize() const;
+	u8* GetSegmentMemory(n32 a_nIndex) const;
+	// nullptr unless [a_uAddress, a_uAddress + a_uSize) lies inside one segment
+	u8* GetPointer(u64 a_uAddress, u64 a_uSize) const;
+	bool Read(u64 a_uAddress, void* a_pData, u64 a_uSize) const;
+	bool Write(u64 a_uAddress, const void* a_pData, u64 a_uSize);
+	static bool IsZero(const u8* a_pData, u64 a_uSize);
+	static const u64 s_uPageSize;
+private:
+	CMemoryImage(const CMemoryImage&);
+	CMemoryImage& operator=(const CMemoryImage&);
+	static u8* allocate(u64 a_uSize);
+	static void release(u8* a_pMemory, u64 a_uSize);
+	vector<SSegment> m_vSegment;
+	vector<u8*> m_vMemory;
+};
+
+#endif	// MEMORYIMAGE_H_
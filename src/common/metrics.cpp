@@ -0,0 +1,243 @@
+#include "metrics.h"
+#include <mutex>
+
+// batch workers append to the same file
+static mutex s_WriteMutex;
+
+CMetrics::CMetrics()
+	: m_nStageIndex(-1)
+	, m_nResult(0)
+{
+}
+
+void CMetrics::SetFileName(const UString& a_sFileName)
+{
+	m_sFileName = a_sFileName;
+}
+
+bool CMetrics::IsEnabled() const
+{
+	return !m_sFileName.empty();
+}
+
+void CMetrics::SetInputFileName(const UString& a_sInputFileName)
+{
+	m_sInputFileName = UToU8(a_sInputFileName);
+}
+
+// entering a stage again adds to its total
+void CMetrics::BeginStage(const char* a_pName)
+{
+	EndStage();
+	for (m_nStageIndex = 0; m_nStageIndex < static_cast<n32>(m_vStage.size()); m_nStageIndex++)
+	{
+		if (m_vStage[m_nStageIndex].Name == a_pName)
+		{
+			break;
+		}
+	}
+	if (m_nStageIndex == static_cast<n32>(m_vStage.size()))
+	{
+		SStage stage;
+		stage.Name = a_pName;
+		stage.Time = 0;
+		m_vStage.push_back(stage);
+	}
+	m_StageBegin = chrono::steady_clock::now();
+}
+
+void CMetrics::EndStage()
+{
+	if (m_nStageIndex < 0)
+	{
+		return;
+	}
+	m_vStage[m_nStageIndex].Time += static_cast<u64>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - m_StageBegin).count());
+	m_nStageIndex = -1;
+}
+
+u64 CMetrics::GetStageTime(const char* a_pName) const
+{
+	for (vector<SStage>::const_iterator it = m_vStage.begin(); it != m_vStage.end(); ++it)
+	{
+		if (it->Name == a_pName)
+		{
+			return it->Time;
+		}
+	}
+	return 0;
+}
+
+void CMetrics::AddEntry(const SEntry& a_Entry)
+{
+	if (IsEnabled())
+	{
+		m_vEntry.push_back(a_Entry);
+	}
+}
+
+// a failed input keeps its last stage open, the record names it as the failed stage
+void CMetrics::SetResult(int a_nResult)
+{
+	m_nResult = a_nResult;
+	if (m_nResult == 0)
+	{
+		EndStage();
+	}
+}
+
+bool CMetrics::Write() const
+{
+	if (!IsEnabled())
+	{
+		return true;
+	}
+	bool bCsv = m_sFileName.size() >= 4 && (m_sFileName.compare(m_sFileName.size() - 4, 4, USTR(".csv")) == 0 || m_sFileName.compare(m_sFileName.size() - 4, 4, USTR(".CSV")) == 0);
+	lock_guard<mutex> lock(s_WriteMutex);
+	FILE* fp = UFopen(m_sFileName.c_str(), USTR("ab"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	Fseek(fp, 0, SEEK_END);
+	bool bHeader = Ftell(fp) == 0;
+	bool bResult = bCsv ? writeCsv(fp, bHeader) : writeJson(fp);
+	fclose(fp);
+	return bResult;
+}
+
+const char* CMetrics::GetExitReasonName(EExitReason a_eExitReason)
+{
+	switch (a_eExitReason)
+	{
+	case kExitReasonReturn:
+		return "return";
+	case kExitReasonTimeout:
+		return "timeout";
+	case kExitReasonHang:
+		return "hang";
+	case kExitReasonFetchOutsideText:
+		return "fetch_outside_text";
+	case kExitReasonFetchInsideText:
+		return "fetch_inside_text";
+	case kExitReasonHostCall:
+		return "host_call";
+	case kExitReasonSysCall:
+		return "sys_call";
+	default:
+		return "error";
+	}
+}
+
+bool CMetrics::writeJson(FILE* a_fp) const
+{
+	fprintf(a_fp, "{\"file\":\"%s\",\"result\":%d,", escape(m_sInputFileName).c_str(), m_nResult);
+	if (m_nStageIndex >= 0)
+	{
+		fprintf(a_fp, "\"failed_stage\":\"%s\",", m_vStage[m_nStageIndex].Name.c_str());
+	}
+	fprintf(a_fp, "\"stages\":{");
+	for (vector<SStage>::const_iterator it = m_vStage.begin(); it != m_vStage.end(); ++it)
+	{
+		fprintf(a_fp, "%s\"%s\":%llu", it == m_vStage.begin() ? "" : ",", it->Name.c_str(), static_cast<unsigned long long>(it->Time));
+	}
+	fprintf(a_fp, "},\"entries\":[");
+	for (vector<SEntry>::const_iterator it = m_vEntry.begin(); it != m_vEntry.end(); ++it)
+	{
+		const SEntry& entry = *it;
+		fprintf(a_fp, "%s{\"index\":%d,\"address\":\"0x%llX\",\"instructions\":%llu,\"time\":%llu,\"exit_reason\":\"%s\",\"uc_err\":%u,\"pc\":\"0x%llX\",\"data_pages\":%llu,\"data_bytes\":%llu,\"bss_pages\":%llu,\"bss_bytes\":%llu,\"heap_allocations\":%llu,\"heap_pointers\":%llu,\"speculated\":%s,\"reused\":%s,\"committed\":%s,\"invalidated\":%s}"
+			, it == m_vEntry.begin() ? "" : ","
+			, entry.Index
+			, static_cast<unsigned long long>(entry.Address)
+			, static_cast<unsigned long long>(entry.RunStat.InstructionCount)
+			, static_cast<unsigned long long>(entry.RunStat.Time)
+			, GetExitReasonName(entry.ExitReason)
+			, static_cast<u32>(entry.RunStat.Error)
+			, static_cast<unsigned long long>(entry.RunStat.PC)
+			, static_cast<unsigned long long>(entry.RunStat.DataPageCount)
+			, static_cast<unsigned long long>(entry.RunStat.DataByteCount)
+			, static_cast<unsigned long long>(entry.RunStat.BssPageCount)
+			, static_cast<unsigned long long>(entry.RunStat.BssByteCount)
+			, static_cast<unsigned long long>(entry.RunStat.HeapAllocationCount)
+			, static_cast<unsigned long long>(entry.RunStat.HeapPointerCount)
+			, entry.Speculated ? "true" : "false"
+			, entry.Reused ? "true" : "false"
+			, entry.Committed ? "true" : "false"
+			, entry.Invalidated ? "true" : "false");
+	}
+	return fprintf(a_fp, "]}\n") > 0;
+}
+
+// one row per stage and one row per entry, the record column tells them apart
+bool CMetrics::writeCsv(FILE* a_fp, bool a_bHeader) const
+{
+	if (a_bHeader)
+	{
+		fprintf(a_fp, "record,file,result,name,index,address,instructions,time,exit_reason,uc_err,pc,data_pages,data_bytes,bss_pages,bss_bytes,heap_allocations,heap_pointers,speculated,reused,committed,invalidated\n");
+	}
+	string sFileName = "\"";
+	for (string::const_iterator it = m_sInputFileName.begin(); it != m_sInputFileName.end(); ++it)
+	{
+		if (*it == '"')
+		{
+			sFileName += '"';
+		}
+		sFileName += *it;
+	}
+	sFileName += '"';
+	for (vector<SStage>::const_iterator it = m_vStage.begin(); it != m_vStage.end(); ++it)
+	{
+		bool bFailed = m_nStageIndex >= 0 && it - m_vStage.begin() == m_nStageIndex;
+		fprintf(a_fp, "stage,%s,%d,%s,,,,%llu,%s,,,,,,,,,,,,\n", sFileName.c_str(), m_nResult, it->Name.c_str(), static_cast<unsigned long long>(it->Time), bFailed ? "failed" : "");
+	}
+	for (vector<SEntry>::const_iterator it = m_vEntry.begin(); it != m_vEntry.end(); ++it)
+	{
+		const SEntry& entry = *it;
+		fprintf(a_fp, "entry,%s,%d,,%d,0x%llX,%llu,%llu,%s,%u,0x%llX,%llu,%llu,%llu,%llu,%llu,%llu,%d,%d,%d,%d\n"
+			, sFileName.c_str()
+			, m_nResult
+			, entry.Index
+			, static_cast<unsigned long long>(entry.Address)
+			, static_cast<unsigned long long>(entry.RunStat.InstructionCount)
+			, static_cast<unsigned long long>(entry.RunStat.Time)
+			, GetExitReasonName(entry.ExitReason)
+			, static_cast<u32>(entry.RunStat.Error)
+			, static_cast<unsigned long long>(entry.RunStat.PC)
+			, static_cast<unsigned long long>(entry.RunStat.DataPageCount)
+			, static_cast<unsigned long long>(entry.RunStat.DataByteCount)
+			, static_cast<unsigned long long>(entry.RunStat.BssPageCount)
+			, static_cast<unsigned long long>(entry.RunStat.BssByteCount)
+			, static_cast<unsigned long long>(entry.RunStat.HeapAllocationCount)
+			, static_cast<unsigned long long>(entry.RunStat.HeapPointerCount)
+			, entry.Speculated ? 1 : 0
+			, entry.Reused ? 1 : 0
+			, entry.Committed ? 1 : 0
+			, entry.Invalidated ? 1 : 0);
+	}
+	return !ferror(a_fp);
+}
+
+string CMetrics::escape(const string& a_sText)
+{
+	string sEscaped;
+	for (string::const_iterator it = a_sText.begin(); it != a_sText.end(); ++it)
+	{
+		char c = *it;
+		if (c == '"' || c == '\\')
+		{
+			sEscaped += '\\';
+			sEscaped += c;
+		}
+		else if (static_cast<u8>(c) < 0x20)
+		{
+			char szEscaped[8] = {};
+			sprintf(szEscaped, "\\u%04x", static_cast<u8>(c));
+			sEscaped += szEscaped;
+		}
+		else
+		{
+			sEscaped += c;
+		}
+	}
+	return sEscaped;
+}
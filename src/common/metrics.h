@@ -0,0 +1,55 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <sdw.h>
+#include <chrono>
+#include "runner.h"
+
+// machine readable record of one input, written as one JSON object per line or as CSV rows
+class CMetrics
+{
+public:
+	struct SEntry
+	{
+		n32 Index;
+		u64 Address;
+		EExitReason ExitReason;
+		SRunStat RunStat;
+		bool Speculated;
+		// replayed from the manifest of the last run
+		bool Reused;
+		bool Committed;
+		bool Invalidated;
+	};
+	CMetrics();
+	void SetFileName(const UString& a_sFileName);
+	bool IsEnabled() const;
+	void SetInputFileName(const UString& a_sInputFileName);
+	void BeginStage(const char* a_pName);
+	void EndStage();
+	// total of a stage in microseconds, 0 if it never started
+	u64 GetStageTime(const char* a_pName) const;
+	void AddEntry(const SEntry& a_Entry);
+	void SetResult(int a_nResult);
+	bool Write() const;
+	static const char* GetExitReasonName(EExitReason a_eExitReason);
+private:
+	struct SStage
+	{
+		string Name;
+		// microseconds
+		u64 Time;
+	};
+	bool writeJson(FILE* a_fp) const;
+	bool writeCsv(FILE* a_fp, bool a_bHeader) const;
+	static string escape(const string& a_sText);
+	UString m_sFileName;
+	string m_sInputFileName;
+	vector<SStage> m_vStage;
+	n32 m_nStageIndex;
+	chrono::steady_clock::time_point m_StageBegin;
+	vector<SEntry> m_vEntry;
+	int m_nResult;
+};
+
+#endif	// METRICS_H_
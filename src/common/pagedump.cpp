@@ -0,0 +1,141 @@
+#include "pagedump.h"
+#include "hash.h"
+
+const u32 CPageDump::s_uSignature = SDW_CONVERT_ENDIAN32('EIPD');
+const u32 CPageDump::s_uVersion = 2;
+const u64 CPageDump::s_uPageSize = 4096;
+const u32 CPageDump::s_uFlagDelta = 1;
+const u32 CPageDump::s_uPageFlagRead = 1;
+const u32 CPageDump::s_uPageFlagWrite = 2;
+const u32 CPageDump::s_uPageFlagExecute = 4;
+const u32 CPageDump::s_uPageFlagZero = 8;
+
+bool ParseDumpFormat(const UString& a_sName, EDumpFormat& a_eDumpFormat)
+{
+	if (a_sName == USTR("raw"))
+	{
+		a_eDumpFormat = kDumpFormatRaw;
+	}
+	else if (a_sName == USTR("sparse"))
+	{
+		a_eDumpFormat = kDumpFormatSparse;
+	}
+	else if (a_sName == USTR("delta"))
+	{
+		a_eDumpFormat = kDumpFormatDelta;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+CPageDump::CPageDump()
+	: m_uAddress(0)
+	, m_uAddressMax(0)
+	, m_pMemory(nullptr)
+{
+}
+
+void CPageDump::SetMemory(u64 a_uAddress, u64 a_uAddressMax, const CMemoryImage* a_pMemory)
+{
+	m_uAddress = a_uAddress;
+	m_uAddressMax = a_uAddressMax;
+	m_pMemory = a_pMemory;
+}
+
+bool CPageDump::Write(const UString& a_sFileName, const CMemoryImage* a_pBase) const
+{
+	if (m_pMemory == nullptr || m_uAddress != m_pMemory->GetAddress() || Align(m_uAddressMax, s_uPageSize) > m_uAddress + m_pMemory->GetSize())
+	{
+		return false;
+	}
+	static const u8 c_uZeroPage[4096] = {};
+	u64 uAddressMax = Align(m_uAddressMax, s_uPageSize);
+	SHeader header = {};
+	header.Signature = s_uSignature;
+	header.Version = s_uVersion;
+	header.PageSize = static_cast<u32>(s_uPageSize);
+	header.Flags = a_pBase != nullptr ? s_uFlagDelta : 0;
+	header.AddressMin = m_uAddress;
+	header.AddressMax = m_uAddressMax;
+	const vector<SSegment>& vSegment = m_pMemory->GetSegmentList();
+	if (a_pBase != nullptr)
+	{
+		const vector<SSegment>& vBaseSegment = a_pBase->GetSegmentList();
+		for (n32 i = 0; i < static_cast<n32>(vBaseSegment.size()); i++)
+		{
+			u64 uSegmentHash[3] = { vBaseSegment[i].Address, vBaseSegment[i].Size, Hash64(a_pBase->GetSegmentMemory(i), static_cast<size_t>(vBaseSegment[i].Size), 0) };
+			header.BaseHash = Hash64(uSegmentHash, sizeof(uSegmentHash), header.BaseHash);
+		}
+	}
+	vector<SPage> vPage;
+	vector<const u8*> vPageData;
+	// the gaps between segments are never stored, the reader sees them as zero pages
+	for (n32 i = 0; i < static_cast<n32>(vSegment.size()); i++)
+	{
+		const SSegment& segment = vSegment[i];
+		u32 uFlags = ((segment.Protection & UC_PROT_READ) != 0 ? s_uPageFlagRead : 0) | ((segment.Protection & UC_PROT_WRITE) != 0 ? s_uPageFlagWrite : 0) | ((segment.Protection & UC_PROT_EXEC) != 0 ? s_uPageFlagExecute : 0);
+		for (u64 uAddress = segment.Address; uAddress < segment.Address + segment.Size && uAddress < uAddressMax; uAddress += s_uPageSize)
+		{
+			const u8* pPage = m_pMemory->GetSegmentMemory(i) + (uAddress - segment.Address);
+			const u8* pBasePage = a_pBase != nullptr ? a_pBase->GetPointer(uAddress, s_uPageSize) : nullptr;
+			if (pBasePage == nullptr)
+			{
+				pBasePage = c_uZeroPage;
+			}
+			if (memcmp(pPage, pBasePage, static_cast<size_t>(s_uPageSize)) == 0)
+			{
+				continue;
+			}
+			SPage page = {};
+			page.Address = uAddress;
+			page.Flags = uFlags;
+			page.Hash = Hash64(pPage, static_cast<size_t>(s_uPageSize), 0);
+			if (a_pBase != nullptr && CMemoryImage::IsZero(pPage, s_uPageSize))
+			{
+				page.Flags |= s_uPageFlagZero;
+			}
+			else
+			{
+				page.Offset = vPageData.size();
+				vPageData.push_back(pPage);
+			}
+			vPage.push_back(page);
+		}
+	}
+	header.PageCount = vPage.size();
+	// data follows the index, offsets so far count stored pages
+	u64 uDataOffset = Align(sizeof(SHeader) + vPage.size() * sizeof(SPage), s_uPageSize);
+	for (vector<SPage>::iterator it = vPage.begin(); it != vPage.end(); ++it)
+	{
+		if ((it->Flags & s_uPageFlagZero) == 0)
+		{
+			it->Offset = uDataOffset + it->Offset * s_uPageSize;
+		}
+	}
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("wb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	bool bResult = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (bResult && !vPage.empty())
+	{
+		bResult = fwrite(&*vPage.begin(), sizeof(SPage), vPage.size(), fp) == vPage.size();
+	}
+	if (bResult && !vPageData.empty())
+	{
+		bResult = Seek(fp, uDataOffset);
+	}
+	for (vector<const u8*>::const_iterator it = vPageData.begin(); bResult && it != vPageData.end(); ++it)
+	{
+		bResult = fwrite(*it, 1, static_cast<size_t>(s_uPageSize), fp) == s_uPageSize;
+	}
+	if (fclose(fp) != 0)
+	{
+		bResult = false;
+	}
+	return bResult;
+}
@@ -0,0 +1,68 @@
+#ifndef PAGEDUMP_H_
+#define PAGEDUMP_H_
+
+#include <sdw.h>
+#include "memoryimage.h"
+
+enum EDumpFormat
+{
+	// the image at its address in a flat file, the way the dump always was
+	kDumpFormatRaw,
+	// header, page index and the non-zero pages only
+	kDumpFormatSparse,
+	// the new dump only holds the pages that differ from the old one
+	kDumpFormatDelta,
+};
+
+// raw, sparse or delta
+bool ParseDumpFormat(const UString& a_sName, EDumpFormat& a_eDumpFormat);
+
+// writes a memory image as a header, an index of { address, flags, hash, offset } per stored page and the page data
+class CPageDump
+{
+public:
+	struct SHeader
+	{
+		u32 Signature;
+		u32 Version;
+		u32 PageSize;
+		u32 Flags;
+		u64 AddressMin;
+		u64 AddressMax;
+		// XXH64 chained over { address, size, XXH64 of the data } of every segment of the base image of a delta, 0 otherwise
+		u64 BaseHash;
+		u64 PageCount;
+	};
+	struct SPage
+	{
+		u64 Address;
+		u32 Flags;
+		u32 Reserved;
+		// XXH64 of the page data
+		u64 Hash;
+		// of the data in the file, 0 for zero pages
+		u64 Offset;
+	};
+	CPageDump();
+	// a_uAddressMax is the unaligned end of the image
+	// the page flags follow the segments of a_pMemory
+	void SetMemory(u64 a_uAddress, u64 a_uAddressMax, const CMemoryImage* a_pMemory);
+	// nullptr leaves out the zero pages, otherwise the pages equal to a_pBase
+	bool Write(const UString& a_sFileName, const CMemoryImage* a_pBase) const;
+	static const u32 s_uSignature;
+	static const u32 s_uVersion;
+	static const u64 s_uPageSize;
+	static const u32 s_uFlagDelta;
+	// the page flags, read, write and execute follow the segment protection
+	static const u32 s_uPageFlagRead;
+	static const u32 s_uPageFlagWrite;
+	static const u32 s_uPageFlagExecute;
+	// a delta page that became all zero, it has no data
+	static const u32 s_uPageFlagZero;
+private:
+	u64 m_uAddress;
+	u64 m_uAddressMax;
+	const CMemoryImage* m_pMemory;
+};
+
+#endif	// PAGEDUMP_H_
@@ -0,0 +1,142 @@
+#include "pagetracker.h"
+
+const u64 CPageTracker::s_uPageSize = 4096;
+
+CPageTracker::CPageTracker()
+	: m_uAddress(0)
+	, m_uSize(0)
+	, m_bTrackRead(false)
+{
+}
+
+void CPageTracker::SetRange(u64 a_uAddress, u64 a_uSize)
+{
+	m_uAddress = a_uAddress / s_uPageSize * s_uPageSize;
+	m_uSize = Align(a_uAddress + a_uSize - m_uAddress, s_uPageSize);
+	m_vPageFlag.assign(static_cast<size_t>(m_uSize / s_uPageSize), 0);
+	m_vFetchPageList.clear();
+	m_vReadPageList.clear();
+	m_vWritePageList.clear();
+}
+
+void CPageTracker::SetTrackRead(bool a_bTrackRead)
+{
+	m_bTrackRead = a_bTrackRead;
+}
+
+uc_err CPageTracker::Attach(uc_engine* a_pUc)
+{
+	if (m_uSize == 0)
+	{
+		return UC_ERR_OK;
+	}
+	uc_hook hook = 0;
+	uc_err eErr = uc_hook_add(a_pUc, &hook, UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&CPageTracker::onMemWrite), this, m_uAddress, m_uAddress + m_uSize - 1);
+	if (eErr != UC_ERR_OK || !m_bTrackRead)
+	{
+		return eErr;
+	}
+	eErr = uc_hook_add(a_pUc, &hook, UC_HOOK_MEM_READ, reinterpret_cast<void*>(&CPageTracker::onMemRead), this, m_uAddress, m_uAddress + m_uSize - 1);
+	if (eErr != UC_ERR_OK)
+	{
+		return eErr;
+	}
+	// code is fetched too, an entry that runs code patched by an earlier entry depends on it
+	return uc_hook_add(a_pUc, &hook, UC_HOOK_BLOCK, reinterpret_cast<void*>(&CPageTracker::onBlock), this, m_uAddress, m_uAddress + m_uSize - 1);
+}
+
+void CPageTracker::Clear()
+{
+	for (vector<u32>::const_iterator it = m_vFetchPageList.begin(); it != m_vFetchPageList.end(); ++it)
+	{
+		m_vPageFlag[*it] = 0;
+	}
+	for (vector<u32>::const_iterator it = m_vReadPageList.begin(); it != m_vReadPageList.end(); ++it)
+	{
+		m_vPageFlag[*it] = 0;
+	}
+	for (vector<u32>::const_iterator it = m_vWritePageList.begin(); it != m_vWritePageList.end(); ++it)
+	{
+		m_vPageFlag[*it] = 0;
+	}
+	m_vFetchPageList.clear();
+	m_vReadPageList.clear();
+	m_vWritePageList.clear();
+}
+
+void CPageTracker::MarkFetch(u64 a_uAddress, u64 a_uSize)
+{
+	mark(a_uAddress, a_uSize, kPageFlagFetch, m_vFetchPageList);
+}
+
+void CPageTracker::MarkRead(u64 a_uAddress, u64 a_uSize)
+{
+	mark(a_uAddress, a_uSize, kPageFlagRead, m_vReadPageList);
+}
+
+void CPageTracker::MarkWrite(u64 a_uAddress, u64 a_uSize)
+{
+	mark(a_uAddress, a_uSize, kPageFlagWrite, m_vWritePageList);
+}
+
+u64 CPageTracker::GetAddress() const
+{
+	return m_uAddress;
+}
+
+u32 CPageTracker::GetPageCount() const
+{
+	return static_cast<u32>(m_vPageFlag.size());
+}
+
+const vector<u32>& CPageTracker::GetFetchPageList() const
+{
+	return m_vFetchPageList;
+}
+
+const vector<u32>& CPageTracker::GetReadPageList() const
+{
+	return m_vReadPageList;
+}
+
+const vector<u32>& CPageTracker::GetWritePageList() const
+{
+	return m_vWritePageList;
+}
+
+void CPageTracker::onBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData)
+{
+	CPageTracker* pTracker = static_cast<CPageTracker*>(a_pUserData);
+	pTracker->MarkFetch(a_uAddress, a_uSize);
+}
+
+void CPageTracker::onMemRead(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	CPageTracker* pTracker = static_cast<CPageTracker*>(a_pUserData);
+	pTracker->MarkRead(a_uAddress, static_cast<u64>(a_nSize));
+}
+
+void CPageTracker::onMemWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	CPageTracker* pTracker = static_cast<CPageTracker*>(a_pUserData);
+	pTracker->MarkWrite(a_uAddress, static_cast<u64>(a_nSize));
+}
+
+void CPageTracker::mark(u64 a_uAddress, u64 a_uSize, u8 a_uFlag, vector<u32>& a_vPageList)
+{
+	if (a_uSize == 0 || a_uAddress >= m_uAddress + m_uSize || a_uAddress + a_uSize <= m_uAddress)
+	{
+		return;
+	}
+	u64 uBegin = max<u64>(a_uAddress, m_uAddress);
+	u64 uEnd = min<u64>(a_uAddress + a_uSize, m_uAddress + m_uSize);
+	for (u64 uPage = (uBegin - m_uAddress) / s_uPageSize; uPage <= (uEnd - 1 - m_uAddress) / s_uPageSize; uPage++)
+	{
+		u8& uPageFlag = m_vPageFlag[static_cast<size_t>(uPage)];
+		if ((uPageFlag & a_uFlag) == 0)
+		{
+			uPageFlag |= a_uFlag;
+			a_vPageList.push_back(static_cast<u32>(uPage));
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef PAGETRACKER_H_
+#define PAGETRACKER_H_
+
+#include <sdw.h>
+#include <unicorn/unicorn.h>
+
+// records which pages of the image an entry fetched, read or wrote
+class CPageTracker
+{
+public:
+	CPageTracker();
+	void SetRange(u64 a_uAddress, u64 a_uSize);
+	void SetTrackRead(bool a_bTrackRead);
+	uc_err Attach(uc_engine* a_pUc);
+	void Clear();
+	void MarkFetch(u64 a_uAddress, u64 a_uSize);
+	void MarkRead(u64 a_uAddress, u64 a_uSize);
+	void MarkWrite(u64 a_uAddress, u64 a_uSize);
+	u64 GetAddress() const;
+	u32 GetPageCount() const;
+	const vector<u32>& GetFetchPageList() const;
+	const vector<u32>& GetReadPageList() const;
+	const vector<u32>& GetWritePageList() const;
+	static const u64 s_uPageSize;
+private:
+	enum EPageFlag
+	{
+		kPageFlagRead = 1 << 0,
+		kPageFlagWrite = 1 << 1,
+		kPageFlagFetch = 1 << 2,
+	};
+	static void onBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData);
+	static void onMemRead(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	static void onMemWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	void mark(u64 a_uAddress, u64 a_uSize, u8 a_uFlag, vector<u32>& a_vPageList);
+	u64 m_uAddress;
+	u64 m_uSize;
+	bool m_bTrackRead;
+	vector<u8> m_vPageFlag;
+	vector<u32> m_vFetchPageList;
+	vector<u32> m_vReadPageList;
+	vector<u32> m_vWritePageList;
+};
+
+#endif	// PAGETRACKER_H_
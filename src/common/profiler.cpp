@@ -0,0 +1,244 @@
+#include "profiler.h"
+#include <mutex>
+#include "runner.h"
+
+using namespace ELFIO;
+
+// batch workers append to the same file
+static mutex s_WriteMutex;
+
+CProfiler::CProfiler()
+	: m_uMachine(0)
+	, m_nEntryIndex(-1)
+	, m_uLastAddress(0)
+	, m_pLastBlock(nullptr)
+{
+}
+
+void CProfiler::SetFileName(const UString& a_sFileName)
+{
+	m_sFileName = a_sFileName;
+}
+
+bool CProfiler::IsEnabled() const
+{
+	return !m_sFileName.empty();
+}
+
+void CProfiler::SetInputFileName(const UString& a_sInputFileName)
+{
+	m_sInputFileName = UToU8(a_sInputFileName);
+	string::size_type uPos = m_sInputFileName.find_last_of("/\\");
+	if (uPos != string::npos)
+	{
+		m_sInputFileName.erase(0, uPos + 1);
+	}
+}
+
+void CProfiler::LoadSymbol(const elfio& a_ElfFile)
+{
+	m_uMachine = a_ElfFile.get_machine();
+	m_vSymbol.clear();
+	n32 nSectionSize = a_ElfFile.sections.size();
+	for (n32 i = 0; i < nSectionSize; i++)
+	{
+		section* pSection = a_ElfFile.sections[i];
+		if (pSection == nullptr || (pSection->get_type() != SHT_SYMTAB && pSection->get_type() != SHT_DYNSYM))
+		{
+			continue;
+		}
+		symbol_section_accessor symbolSection(a_ElfFile, pSection);
+		Elf_Xword uSymbolCount = symbolSection.get_symbols_num();
+		for (Elf_Xword j = 0; j < uSymbolCount; j++)
+		{
+			SSymbol symbol;
+			Elf64_Addr uValue = 0;
+			Elf_Xword uSize = 0;
+			unsigned char uBind = 0;
+			unsigned char uType = 0;
+			Elf_Half uSectionIndex = 0;
+			unsigned char uOther = 0;
+			if (!symbolSection.get_symbol(j, symbol.Name, uValue, uSize, uBind, uType, uSectionIndex, uOther) || uType != STT_FUNC || uSectionIndex == SHN_UNDEF || symbol.Name.empty())
+			{
+				continue;
+			}
+			// the Thumb bit is not part of the address
+			symbol.Address = m_uMachine == kMachineARM ? uValue & ~static_cast<u64>(1) : uValue;
+			symbol.Size = uSize;
+			m_vSymbol.push_back(symbol);
+		}
+	}
+	// .symtab repeats the exported functions of .dynsym
+	stable_sort(m_vSymbol.begin(), m_vSymbol.end(), compareSymbol);
+	vector<SSymbol>::iterator itEnd = m_vSymbol.begin();
+	for (vector<SSymbol>::iterator it = m_vSymbol.begin(); it != m_vSymbol.end(); ++it)
+	{
+		if (itEnd == m_vSymbol.begin() || (itEnd - 1)->Address != it->Address)
+		{
+			*itEnd++ = *it;
+		}
+	}
+	m_vSymbol.erase(itEnd, m_vSymbol.end());
+}
+
+void CProfiler::BeginEntry(n32 a_nIndex, const string& a_sName)
+{
+	m_nEntryIndex = a_nIndex;
+	m_sEntryName = a_sName;
+	m_mBlock.clear();
+	m_uLastAddress = 0;
+	m_pLastBlock = nullptr;
+}
+
+void CProfiler::AddBlock(u64 a_uAddress, u32 a_uInstructionCount)
+{
+	if (m_pLastBlock == nullptr || a_uAddress != m_uLastAddress)
+	{
+		// references into an unordered_map survive rehashing
+		SBlock& block = m_mBlock[a_uAddress];
+		m_uLastAddress = a_uAddress;
+		m_pLastBlock = &block;
+	}
+	m_pLastBlock->ExecutionCount++;
+	m_pLastBlock->InstructionCount += a_uInstructionCount;
+}
+
+// blocks outside any known function are named after themselves like IDA does
+void CProfiler::EndEntry()
+{
+	if (m_nEntryIndex < 0)
+	{
+		return;
+	}
+	SEntry entry;
+	entry.Index = m_nEntryIndex;
+	entry.Name = m_sEntryName;
+	map<u64, SFunction> mFunction;
+	for (unordered_map<u64, SBlock>::const_iterator it = m_mBlock.begin(); it != m_mBlock.end(); ++it)
+	{
+		u64 uAddress = it->first;
+		const SSymbol* pSymbol = findSymbol(uAddress);
+		if (pSymbol != nullptr)
+		{
+			uAddress = pSymbol->Address;
+		}
+		map<u64, SFunction>::iterator itFunction = mFunction.find(uAddress);
+		if (itFunction == mFunction.end())
+		{
+			SFunction function;
+			if (pSymbol != nullptr)
+			{
+				function.Name = pSymbol->Name;
+			}
+			else
+			{
+				char szName[32] = {};
+				sprintf(szName, "sub_%llX", static_cast<unsigned long long>(uAddress));
+				function.Name = szName;
+			}
+			function.Address = uAddress;
+			function.BlockCount = 0;
+			function.ExecutionCount = 0;
+			function.InstructionCount = 0;
+			itFunction = mFunction.insert(make_pair(uAddress, function)).first;
+		}
+		SFunction& function = itFunction->second;
+		function.BlockCount++;
+		function.ExecutionCount += it->second.ExecutionCount;
+		function.InstructionCount += it->second.InstructionCount;
+	}
+	for (map<u64, SFunction>::const_iterator it = mFunction.begin(); it != mFunction.end(); ++it)
+	{
+		entry.FunctionList.push_back(it->second);
+	}
+	// hottest first
+	stable_sort(entry.FunctionList.begin(), entry.FunctionList.end(), compareFunction);
+	m_vEntry.push_back(entry);
+	m_nEntryIndex = -1;
+	m_mBlock.clear();
+	m_pLastBlock = nullptr;
+}
+
+bool CProfiler::Write() const
+{
+	if (!IsEnabled())
+	{
+		return true;
+	}
+	bool bCsv = m_sFileName.size() >= 4 && (m_sFileName.compare(m_sFileName.size() - 4, 4, USTR(".csv")) == 0 || m_sFileName.compare(m_sFileName.size() - 4, 4, USTR(".CSV")) == 0);
+	lock_guard<mutex> lock(s_WriteMutex);
+	FILE* fp = UFopen(m_sFileName.c_str(), USTR("ab"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	Fseek(fp, 0, SEEK_END);
+	bool bHeader = Ftell(fp) == 0;
+	bool bResult = bCsv ? writeCsv(fp, bHeader) : writeFolded(fp);
+	fclose(fp);
+	return bResult;
+}
+
+// a symbol without a size runs up to the next one
+const CProfiler::SSymbol* CProfiler::findSymbol(u64 a_uAddress) const
+{
+	SSymbol key;
+	key.Address = a_uAddress;
+	vector<SSymbol>::const_iterator it = upper_bound(m_vSymbol.begin(), m_vSymbol.end(), key, compareSymbol);
+	if (it == m_vSymbol.begin())
+	{
+		return nullptr;
+	}
+	--it;
+	if (it->Size != 0 && a_uAddress >= it->Address + it->Size)
+	{
+		return nullptr;
+	}
+	return &*it;
+}
+
+// file;entry;function instructions, one line per function an entry ran
+bool CProfiler::writeFolded(FILE* a_fp) const
+{
+	for (vector<SEntry>::const_iterator it = m_vEntry.begin(); it != m_vEntry.end(); ++it)
+	{
+		for (vector<SFunction>::const_iterator itFunction = it->FunctionList.begin(); itFunction != it->FunctionList.end(); ++itFunction)
+		{
+			fprintf(a_fp, "%s;%s;%s %llu\n", m_sInputFileName.c_str(), it->Name.c_str(), itFunction->Name.c_str(), static_cast<unsigned long long>(itFunction->InstructionCount));
+		}
+	}
+	return !ferror(a_fp);
+}
+
+bool CProfiler::writeCsv(FILE* a_fp, bool a_bHeader) const
+{
+	if (a_bHeader)
+	{
+		fprintf(a_fp, "file,index,function,address,blocks,executions,instructions\n");
+	}
+	for (vector<SEntry>::const_iterator it = m_vEntry.begin(); it != m_vEntry.end(); ++it)
+	{
+		for (vector<SFunction>::const_iterator itFunction = it->FunctionList.begin(); itFunction != it->FunctionList.end(); ++itFunction)
+		{
+			fprintf(a_fp, "\"%s\",%d,%s,0x%llX,%llu,%llu,%llu\n"
+				, m_sInputFileName.c_str()
+				, it->Index
+				, itFunction->Name.c_str()
+				, static_cast<unsigned long long>(itFunction->Address)
+				, static_cast<unsigned long long>(itFunction->BlockCount)
+				, static_cast<unsigned long long>(itFunction->ExecutionCount)
+				, static_cast<unsigned long long>(itFunction->InstructionCount));
+		}
+	}
+	return !ferror(a_fp);
+}
+
+bool CProfiler::compareSymbol(const SSymbol& a_Lhs, const SSymbol& a_Rhs)
+{
+	return a_Lhs.Address < a_Rhs.Address;
+}
+
+bool CProfiler::compareFunction(const SFunction& a_Lhs, const SFunction& a_Rhs)
+{
+	return a_Lhs.InstructionCount > a_Rhs.InstructionCount;
+}
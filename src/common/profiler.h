@@ -0,0 +1,69 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include <unordered_map>
+
+// opt-in basic block profile of every entry, blocks are summed per function and written as folded stacks for flame graph tools or as CSV rows
+class CProfiler
+{
+public:
+	CProfiler();
+	void SetFileName(const UString& a_sFileName);
+	bool IsEnabled() const;
+	void SetInputFileName(const UString& a_sInputFileName);
+	// the functions of .dynsym and .symtab
+	void LoadSymbol(const ELFIO::elfio& a_ElfFile);
+	// a_sName is what the loader knows the entry as, like .init_array[3]
+	void BeginEntry(n32 a_nIndex, const string& a_sName);
+	// called from the block hook, keep it cheap
+	void AddBlock(u64 a_uAddress, u32 a_uInstructionCount);
+	void EndEntry();
+	bool Write() const;
+private:
+	struct SBlock
+	{
+		u64 ExecutionCount;
+		u64 InstructionCount;
+	};
+	struct SSymbol
+	{
+		u64 Address;
+		u64 Size;
+		string Name;
+	};
+	struct SFunction
+	{
+		string Name;
+		u64 Address;
+		u64 BlockCount;
+		u64 ExecutionCount;
+		u64 InstructionCount;
+	};
+	struct SEntry
+	{
+		n32 Index;
+		string Name;
+		vector<SFunction> FunctionList;
+	};
+	const SSymbol* findSymbol(u64 a_uAddress) const;
+	bool writeFolded(FILE* a_fp) const;
+	bool writeCsv(FILE* a_fp, bool a_bHeader) const;
+	static bool compareSymbol(const SSymbol& a_Lhs, const SSymbol& a_Rhs);
+	static bool compareFunction(const SFunction& a_Lhs, const SFunction& a_Rhs);
+	UString m_sFileName;
+	string m_sInputFileName;
+	u16 m_uMachine;
+	// sorted by address
+	vector<SSymbol> m_vSymbol;
+	n32 m_nEntryIndex;
+	string m_sEntryName;
+	unordered_map<u64, SBlock> m_mBlock;
+	// loops mostly hit the block they just left
+	u64 m_uLastAddress;
+	SBlock* m_pLastBlock;
+	vector<SEntry> m_vEntry;
+};
+
+#endif	// PROFILER_H_
@@ -0,0 +1,432 @@
+#include "relocator.h"
+#include "hostcall.h"
+
+using namespace ELFIO;
+
+CRelocator::CRelocator()
+	: m_uMachine(0)
+	, m_uSlotSize(4)
+	, m_nAppliedCount(0)
+	, m_nUnresolvedCount(0)
+{
+}
+
+bool CRelocator::Apply(const elfio& a_ElfFile, CMemoryImage& a_Memory)
+{
+	m_uMachine = a_ElfFile.get_machine();
+	m_uSlotSize = a_ElfFile.get_class() == ELFCLASS64 ? 8 : 4;
+	m_vSymbolTable.clear();
+	m_vTarget.clear();
+	m_vOriginal.clear();
+	m_nAppliedCount = 0;
+	m_nUnresolvedCount = 0;
+	if (m_uMachine != EM_ARM && m_uMachine != EM_res183/* EM_AARCH64 */)
+	{
+		return false;
+	}
+	vector<SRelocation> vRelocation;
+	bool bDynamic = false;
+	bool bResult = collectDynamic(a_ElfFile, a_Memory, bDynamic, vRelocation);
+	n32 nSectionSize = a_ElfFile.sections.size();
+	for (n32 i = 0; bResult && !bDynamic && i < nSectionSize; i++)
+	{
+		const section* pSection = a_ElfFile.sections[i];
+		if (pSection->get_type() == SHT_REL || pSection->get_type() == SHT_RELA)
+		{
+			bResult = collectSection(a_ElfFile, pSection, vRelocation);
+		}
+	}
+	// the symbol tables point into the image and the file, the symbols are resolved by now
+	m_vSymbolTable.clear();
+	if (!bResult)
+	{
+		return false;
+	}
+	// the dynamic linker walks DT_RELA or DT_REL and then DT_JMPREL in table order, a stable sort keeps that order among relocations sharing a target
+	stable_sort(vRelocation.begin(), vRelocation.end(), compareOffset);
+	for (vector<SRelocation>::const_iterator it = vRelocation.begin(); it != vRelocation.end(); ++it)
+	{
+		const SRelocation& relocation = *it;
+		// the file word of a target is read before its first relocation is applied, it is the addend of every REL entry there
+		u64 uOriginal = 0;
+		if (!m_vTarget.empty() && m_vTarget.back() == relocation.Offset)
+		{
+			uOriginal = m_vOriginal.back();
+		}
+		else if (a_Memory.Read(relocation.Offset, &uOriginal, m_uSlotSize))
+		{
+			m_vTarget.push_back(relocation.Offset);
+			m_vOriginal.push_back(uOriginal);
+		}
+		else
+		{
+			continue;
+		}
+		n64 nAddend = relocation.HasAddend ? relocation.Addend : static_cast<n64>(uOriginal);
+		u64 uValue = 0;
+		switch (relocation.Kind)
+		{
+		case kKindRelative:
+			// B + A, the image is loaded at its link address
+			uValue = static_cast<u64>(nAddend);
+			break;
+		case kKindAbsolute:
+			uValue = relocation.Value + static_cast<u64>(nAddend);
+			break;
+		case kKindGlobalData:
+			// the addend only counts for RELA entries, the dynamic linker ignores the REL word here
+			uValue = relocation.HasAddend ? relocation.Value + static_cast<u64>(nAddend) : relocation.Value;
+			break;
+		}
+		a_Memory.Write(relocation.Offset, &uValue, m_uSlotSize);
+		m_nAppliedCount++;
+	}
+	return true;
+}
+
+u32 CRelocator::GetSlotSize() const
+{
+	return m_uSlotSize;
+}
+
+const vector<u64>& CRelocator::GetTargetList() const
+{
+	return m_vTarget;
+}
+
+void CRelocator::Restore(u8* a_pData, u64 a_uAddress, u64 a_uSize) const
+{
+	for (vector<u64>::const_iterator it = lower_bound(m_vTarget.begin(), m_vTarget.end(), a_uAddress); it != m_vTarget.end() && *it < a_uAddress + a_uSize; ++it)
+	{
+		u64 uOriginal = m_vOriginal[it - m_vTarget.begin()];
+		memcpy(a_pData + (*it - a_uAddress), &uOriginal, static_cast<size_t>(min<u64>(m_uSlotSize, a_uAddress + a_uSize - *it)));
+	}
+}
+
+n32 CRelocator::GetAppliedCount() const
+{
+	return m_nAppliedCount;
+}
+
+n32 CRelocator::GetUnresolvedCount() const
+{
+	return m_nUnresolvedCount;
+}
+
+n32 CRelocator::getKind(u32 a_uType) const
+{
+	if (m_uMachine == EM_ARM)
+	{
+		switch (a_uType)
+		{
+		case 23/* R_ARM_RELATIVE */:
+			return kKindRelative;
+		case 2/* R_ARM_ABS32 */:
+			return kKindAbsolute;
+		case 21/* R_ARM_GLOB_DAT */:
+		case 22/* R_ARM_JUMP_SLOT */:
+			return kKindGlobalData;
+		}
+	}
+	else
+	{
+		switch (a_uType)
+		{
+		case 1027/* R_AARCH64_RELATIVE */:
+			return kKindRelative;
+		case 257/* R_AARCH64_ABS64 */:
+			return kKindAbsolute;
+		case 1025/* R_AARCH64_GLOB_DAT */:
+		case 1026/* R_AARCH64_JUMP_SLOT */:
+			return kKindGlobalData;
+		}
+	}
+	return kKindNone;
+}
+
+// DT_RELA, DT_REL and DT_JMPREL with the symbols of DT_SYMTAB, read from the image where the dynamic linker reads them, a_bDynamic is false without PT_DYNAMIC
+bool CRelocator::collectDynamic(const elfio& a_ElfFile, const CMemoryImage& a_Memory, bool& a_bDynamic, vector<SRelocation>& a_vRelocation)
+{
+	a_bDynamic = false;
+	bool b64 = m_uSlotSize == 8;
+	u64 uEntrySize = m_uSlotSize;
+	const segment* pDynamicSegment = nullptr;
+	n32 nSegmentSize = a_ElfFile.segments.size();
+	for (n32 i = 0; i < nSegmentSize; i++)
+	{
+		const segment* pSegment = a_ElfFile.segments[i];
+		if (pSegment != nullptr && pSegment->get_type() == PT_DYNAMIC)
+		{
+			pDynamicSegment = pSegment;
+			break;
+		}
+	}
+	if (pDynamicSegment == nullptr || pDynamicSegment->get_data() == nullptr)
+	{
+		return true;
+	}
+	a_bDynamic = true;
+	// indexed by tag, every tag used here is below DT_JMPREL
+	u64 uDynamic[DT_JMPREL + 1] = {};
+	bool bDynamic[DT_JMPREL + 1] = {};
+	const char* pDynamic = pDynamicSegment->get_data();
+	u64 uDynamicSize = pDynamicSegment->get_file_size();
+	for (u64 uOffset = 0; uOffset + uEntrySize * 2 <= uDynamicSize; uOffset += uEntrySize * 2)
+	{
+		u64 uTag = 0;
+		u64 uValue = 0;
+		memcpy(&uTag, pDynamic + uOffset, static_cast<size_t>(uEntrySize));
+		memcpy(&uValue, pDynamic + uOffset + uEntrySize, static_cast<size_t>(uEntrySize));
+		if (uTag == DT_NULL)
+		{
+			break;
+		}
+		if (uTag <= DT_JMPREL)
+		{
+			uDynamic[uTag] = uValue;
+			bDynamic[uTag] = true;
+		}
+	}
+	u64 uSymbolEntrySize = b64 ? 24 : 16;
+	if (bDynamic[DT_SYMENT] && uDynamic[DT_SYMENT] != uSymbolEntrySize)
+	{
+		return false;
+	}
+	n32 nSymbolTable = -1;
+	if (bDynamic[DT_SYMTAB] && bDynamic[DT_STRTAB])
+	{
+		SSymbolTable symbolTable;
+		symbolTable.Index = SHN_UNDEF;
+		u64 uSize = 0;
+		symbolTable.Data = getTable(a_Memory, uDynamic[DT_SYMTAB], uSize);
+		// the table has no size of its own, .dynstr follows it in every usual layout
+		if (uDynamic[DT_STRTAB] > uDynamic[DT_SYMTAB])
+		{
+			uSize = min<u64>(uSize, uDynamic[DT_STRTAB] - uDynamic[DT_SYMTAB]);
+		}
+		symbolTable.Count = uSize / uSymbolEntrySize;
+		symbolTable.EntrySize = uSymbolEntrySize;
+		symbolTable.String = reinterpret_cast<const char*>(getTable(a_Memory, uDynamic[DT_STRTAB], symbolTable.StringSize));
+		if (bDynamic[DT_STRSZ])
+		{
+			symbolTable.StringSize = min<u64>(symbolTable.StringSize, uDynamic[DT_STRSZ]);
+		}
+		if (symbolTable.Data != nullptr && symbolTable.String != nullptr)
+		{
+			m_vSymbolTable.push_back(symbolTable);
+			nSymbolTable = static_cast<n32>(m_vSymbolTable.size() - 1);
+		}
+	}
+	// address, size and entry size tags, DT_JMPREL comes last like in the dynamic linker and takes its kind from DT_PLTREL
+	static const u32 c_uTable[3][3] =
+	{
+		{ DT_RELA, DT_RELASZ, DT_RELAENT },
+		{ DT_REL, DT_RELSZ, DT_RELENT },
+		{ DT_JMPREL, DT_PLTRELSZ, DT_NULL }
+	};
+	for (n32 i = 0; i < 3; i++)
+	{
+		if (!bDynamic[c_uTable[i][0]] || uDynamic[c_uTable[i][1]] == 0)
+		{
+			continue;
+		}
+		bool bRela = c_uTable[i][0] == DT_RELA;
+		if (c_uTable[i][0] == DT_JMPREL)
+		{
+			bRela = bDynamic[DT_PLTREL] ? uDynamic[DT_PLTREL] == DT_RELA : m_uMachine != EM_ARM;
+		}
+		u64 uRelocationEntrySize = (b64 ? 16 : 8) + (bRela ? uEntrySize : 0);
+		if (c_uTable[i][2] != DT_NULL && bDynamic[c_uTable[i][2]] && uDynamic[c_uTable[i][2]] != uRelocationEntrySize)
+		{
+			return false;
+		}
+		u64 uSize = 0;
+		const u8* pTable = getTable(a_Memory, uDynamic[c_uTable[i][0]], uSize);
+		if (pTable == nullptr || uDynamic[c_uTable[i][1]] > uSize)
+		{
+			return false;
+		}
+		collect(pTable, uDynamic[c_uTable[i][1]], bRela, nSymbolTable, a_vRelocation);
+	}
+	return true;
+}
+
+// an SHT_REL or SHT_RELA section with the symbol section it links to
+bool CRelocator::collectSection(const elfio& a_ElfFile, const section* a_pSection, vector<SRelocation>& a_vRelocation)
+{
+	if (a_pSection->get_size() == 0)
+	{
+		return true;
+	}
+	const u8* pData = reinterpret_cast<const u8*>(a_pSection->get_data());
+	if (pData == nullptr)
+	{
+		return false;
+	}
+	Elf_Half uSymbolSectionIndex = static_cast<Elf_Half>(a_pSection->get_link());
+	if (uSymbolSectionIndex == SHN_UNDEF || uSymbolSectionIndex >= a_ElfFile.sections.size())
+	{
+		return true;
+	}
+	const section* pSymbolSection = a_ElfFile.sections[uSymbolSectionIndex];
+	if (pSymbolSection->get_type() != SHT_DYNSYM && pSymbolSection->get_type() != SHT_SYMTAB)
+	{
+		return true;
+	}
+	n32 nSymbolTable = 0;
+	while (nSymbolTable < static_cast<n32>(m_vSymbolTable.size()) && m_vSymbolTable[nSymbolTable].Index != uSymbolSectionIndex)
+	{
+		nSymbolTable++;
+	}
+	if (nSymbolTable == static_cast<n32>(m_vSymbolTable.size()))
+	{
+		SSymbolTable symbolTable;
+		symbolTable.Index = uSymbolSectionIndex;
+		symbolTable.Data = reinterpret_cast<const u8*>(pSymbolSection->get_data());
+		symbolTable.EntrySize = m_uSlotSize == 8 ? 24 : 16;
+		symbolTable.Count = symbolTable.Data != nullptr ? pSymbolSection->get_size() / symbolTable.EntrySize : 0;
+		symbolTable.String = nullptr;
+		symbolTable.StringSize = 0;
+		Elf_Half uStringSectionIndex = static_cast<Elf_Half>(pSymbolSection->get_link());
+		if (uStringSectionIndex != SHN_UNDEF && uStringSectionIndex < a_ElfFile.sections.size() && a_ElfFile.sections[uStringSectionIndex]->get_data() != nullptr)
+		{
+			symbolTable.String = a_ElfFile.sections[uStringSectionIndex]->get_data();
+			symbolTable.StringSize = a_ElfFile.sections[uStringSectionIndex]->get_size();
+		}
+		m_vSymbolTable.push_back(symbolTable);
+	}
+	collect(pData, a_pSection->get_size(), a_pSection->get_type() == SHT_RELA, nSymbolTable, a_vRelocation);
+	return true;
+}
+
+void CRelocator::collect(const u8* a_pData, u64 a_uSize, bool a_bRela, n32 a_nSymbolTable, vector<SRelocation>& a_vRelocation)
+{
+	bool b64 = m_uSlotSize == 8;
+	u64 uEntrySize = (b64 ? 16 : 8) + (a_bRela ? (b64 ? 8 : 4) : 0);
+	u64 uEntryCount = a_uSize / uEntrySize;
+	// the entries are read straight from the table, the accessor converts every field of every entry
+	a_vRelocation.reserve(a_vRelocation.size() + static_cast<size_t>(uEntryCount));
+	for (u64 i = 0; i < uEntryCount; i++)
+	{
+		const u8* pEntry = a_pData + i * uEntrySize;
+		SRelocation relocation = {};
+		u64 uSymbol = 0;
+		u32 uType = 0;
+		if (b64)
+		{
+			u64 uInfo = 0;
+			memcpy(&relocation.Offset, pEntry, 8);
+			memcpy(&uInfo, pEntry + 8, 8);
+			if (a_bRela)
+			{
+				memcpy(&relocation.Addend, pEntry + 16, 8);
+			}
+			uSymbol = uInfo >> 32;
+			uType = static_cast<u32>(uInfo);
+		}
+		else
+		{
+			u32 uOffset = 0;
+			u32 uInfo = 0;
+			memcpy(&uOffset, pEntry, 4);
+			memcpy(&uInfo, pEntry + 4, 4);
+			if (a_bRela)
+			{
+				n32 nAddend = 0;
+				memcpy(&nAddend, pEntry + 8, 4);
+				relocation.Addend = nAddend;
+			}
+			relocation.Offset = uOffset;
+			uSymbol = uInfo >> 8;
+			uType = uInfo & 0xFF;
+		}
+		relocation.Kind = getKind(uType);
+		if (relocation.Kind == kKindNone)
+		{
+			continue;
+		}
+		relocation.HasAddend = a_bRela;
+		if (relocation.Kind != kKindRelative && uSymbol != 0)
+		{
+			relocation.Value = resolve(a_nSymbolTable, uSymbol);
+		}
+		a_vRelocation.push_back(relocation);
+	}
+}
+
+u64 CRelocator::resolve(n32 a_nSymbolTable, u64 a_uSymbol)
+{
+	if (a_nSymbolTable < 0 || a_uSymbol >= m_vSymbolTable[a_nSymbolTable].Count)
+	{
+		m_nUnresolvedCount++;
+		return 0;
+	}
+	SSymbolTable& symbolTable = m_vSymbolTable[a_nSymbolTable];
+	if (a_uSymbol >= symbolTable.State.size())
+	{
+		symbolTable.Value.resize(static_cast<size_t>(a_uSymbol + 1), 0);
+		symbolTable.State.resize(static_cast<size_t>(a_uSymbol + 1), 0);
+	}
+	// 0 not looked up yet, 1 resolved, 2 unresolved
+	u8& uState = symbolTable.State[static_cast<size_t>(a_uSymbol)];
+	u64& uValue = symbolTable.Value[static_cast<size_t>(a_uSymbol)];
+	if (uState == 0)
+	{
+		// Elf32_Sym is name, value, size, info, other, shndx and Elf64_Sym is name, info, other, shndx, value, size
+		const u8* pSymbol = symbolTable.Data + a_uSymbol * symbolTable.EntrySize;
+		u32 uName = 0;
+		u16 uSectionIndex = 0;
+		memcpy(&uName, pSymbol, 4);
+		if (m_uSlotSize == 8)
+		{
+			memcpy(&uSectionIndex, pSymbol + 6, 2);
+			memcpy(&uValue, pSymbol + 8, 8);
+		}
+		else
+		{
+			memcpy(&uSectionIndex, pSymbol + 14, 2);
+			memcpy(&uValue, pSymbol + 4, 4);
+		}
+		uState = 2;
+		if (uSectionIndex != SHN_UNDEF)
+		{
+			uState = 1;
+		}
+		else
+		{
+			uValue = 0;
+			const char* pName = uName < symbolTable.StringSize ? symbolTable.String + uName : nullptr;
+			const char* pNameEnd = pName != nullptr ? static_cast<const char*>(memchr(pName, 0, static_cast<size_t>(symbolTable.StringSize - uName))) : nullptr;
+			if (pNameEnd != nullptr && CHostCall::Resolve(string(pName, pNameEnd), uValue))
+			{
+				uState = 1;
+			}
+		}
+	}
+	if (uState != 1)
+	{
+		m_nUnresolvedCount++;
+	}
+	return uValue;
+}
+
+// the bytes from a_uAddress to the end of its segment, PT_DYNAMIC only gives where a table starts
+const u8* CRelocator::getTable(const CMemoryImage& a_Memory, u64 a_uAddress, u64& a_uSize)
+{
+	a_uSize = 0;
+	const vector<SSegment>& vSegment = a_Memory.GetSegmentList();
+	for (vector<SSegment>::const_iterator it = vSegment.begin(); it != vSegment.end(); ++it)
+	{
+		if (a_uAddress >= it->Address && a_uAddress - it->Address < it->Size)
+		{
+			a_uSize = it->Address + it->Size - a_uAddress;
+			return a_Memory.GetPointer(a_uAddress, a_uSize);
+		}
+	}
+	return nullptr;
+}
+
+bool CRelocator::compareOffset(const SRelocation& a_Lhs, const SRelocation& a_Rhs)
+{
+	return a_Lhs.Offset < a_Rhs.Offset;
+}
@@ -0,0 +1,70 @@
+#ifndef RELOCATOR_H_
+#define RELOCATOR_H_
+
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include "memoryimage.h"
+
+// applies the dynamic relocations to the emulated image at base 0 before any entry runs, the dynamic linker rewrites the same words on device so write-back has to keep the file bytes there
+class CRelocator
+{
+public:
+	CRelocator();
+	// the tables are found through PT_DYNAMIC like the dynamic linker finds them, section headers are only a fallback for images without it
+	bool Apply(const ELFIO::elfio& a_ElfFile, CMemoryImage& a_Memory);
+	u32 GetSlotSize() const;
+	// sorted and unique
+	const vector<u64>& GetTargetList() const;
+	// writes the file bytes of every target inside [a_uAddress, a_uAddress + a_uSize) back into a_pData
+	void Restore(u8* a_pData, u64 a_uAddress, u64 a_uSize) const;
+	n32 GetAppliedCount() const;
+	// symbolic relocations against imports without a host implementation, they are bound to 0
+	n32 GetUnresolvedCount() const;
+private:
+	enum EKind
+	{
+		kKindNone,
+		kKindRelative,
+		kKindAbsolute,
+		kKindGlobalData
+	};
+	struct SRelocation
+	{
+		u64 Offset;
+		// S, the value of the symbol
+		u64 Value;
+		n64 Addend;
+		n32 Kind;
+		bool HasAddend;
+	};
+	// raw Elf32_Sym or Elf64_Sym entries, only valid during Apply
+	struct SSymbolTable
+	{
+		// of the symbol section, SHN_UNDEF for DT_SYMTAB
+		ELFIO::Elf_Half Index;
+		const u8* Data;
+		u64 Count;
+		u64 EntrySize;
+		const char* String;
+		u64 StringSize;
+		// grown as the symbols are looked up
+		vector<u64> Value;
+		vector<u8> State;
+	};
+	n32 getKind(u32 a_uType) const;
+	bool collectDynamic(const ELFIO::elfio& a_ElfFile, const CMemoryImage& a_Memory, bool& a_bDynamic, vector<SRelocation>& a_vRelocation);
+	bool collectSection(const ELFIO::elfio& a_ElfFile, const ELFIO::section* a_pSection, vector<SRelocation>& a_vRelocation);
+	void collect(const u8* a_pData, u64 a_uSize, bool a_bRela, n32 a_nSymbolTable, vector<SRelocation>& a_vRelocation);
+	u64 resolve(n32 a_nSymbolTable, u64 a_uSymbol);
+	static const u8* getTable(const CMemoryImage& a_Memory, u64 a_uAddress, u64& a_uSize);
+	static bool compareOffset(const SRelocation& a_Lhs, const SRelocation& a_Rhs);
+	u16 m_uMachine;
+	u32 m_uSlotSize;
+	vector<SSymbolTable> m_vSymbolTable;
+	vector<u64> m_vTarget;
+	vector<u64> m_vOriginal;
+	n32 m_nAppliedCount;
+	n32 m_nUnresolvedCount;
+};
+
+#endif	// RELOCATOR_H_
@@ -0,0 +1,148 @@
+#include "resultcache.h"
+
+const u32 CResultCache::s_uSignature = SDW_CONVERT_ENDIAN32('EIRC');
+const u32 CResultCache::s_uVersion = 3;
+const u64 CResultCache::s_uPageSize = 4096;
+
+CResultCache::CResultCache()
+{
+}
+
+void CResultCache::SetDirName(const UString& a_sDirName)
+{
+	m_sDirName = a_sDirName;
+}
+
+bool CResultCache::IsEnabled() const
+{
+	return !m_sDirName.empty();
+}
+
+// the entry holds the invalidated indices and the pages of the memory image the initializers changed, offsets are relative to the image start
+bool CResultCache::Load(const string& a_sKey, CMemoryImage& a_Memory, set<n32>& a_sInvalidIndex) const
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+	FILE* fp = UFopen(getFileName(a_sKey).c_str(), USTR("rb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	u32 uHeader[4] = {};
+	if (fread(uHeader, sizeof(uHeader), 1, fp) != 1 || uHeader[0] != s_uSignature || uHeader[1] != s_uVersion)
+	{
+		fclose(fp);
+		return false;
+	}
+	vector<n32> vInvalidIndex(uHeader[2]);
+	if (!vInvalidIndex.empty() && fread(&*vInvalidIndex.begin(), sizeof(n32), vInvalidIndex.size(), fp) != vInvalidIndex.size())
+	{
+		fclose(fp);
+		return false;
+	}
+	vector<u64> vPageOffset(uHeader[3]);
+	if (!vPageOffset.empty() && fread(&*vPageOffset.begin(), sizeof(u64), vPageOffset.size(), fp) != vPageOffset.size())
+	{
+		fclose(fp);
+		return false;
+	}
+	string sPageData(static_cast<size_t>(vPageOffset.size() * s_uPageSize), 0);
+	if (!sPageData.empty() && fread(&*sPageData.begin(), 1, sPageData.size(), fp) != sPageData.size())
+	{
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+	for (size_t i = 0; i < vPageOffset.size(); i++)
+	{
+		if (vPageOffset[i] > a_Memory.GetSize() || a_Memory.GetPointer(a_Memory.GetAddress() + vPageOffset[i], s_uPageSize) == nullptr)
+		{
+			return false;
+		}
+	}
+	for (size_t i = 0; i < vPageOffset.size(); i++)
+	{
+		a_Memory.Write(a_Memory.GetAddress() + vPageOffset[i], sPageData.data() + i * s_uPageSize, s_uPageSize);
+	}
+	a_sInvalidIndex.insert(vInvalidIndex.begin(), vInvalidIndex.end());
+	return true;
+}
+
+bool CResultCache::Save(const string& a_sKey, const CMemoryImage& a_OldMemory, const CMemoryImage& a_NewMemory, const set<n32>& a_sInvalidIndex) const
+{
+	if (!IsEnabled() || a_OldMemory.GetAddress() != a_NewMemory.GetAddress())
+	{
+		return false;
+	}
+	vector<n32> vInvalidIndex(a_sInvalidIndex.begin(), a_sInvalidIndex.end());
+	vector<u64> vPageOffset;
+	vector<const u8*> vPage;
+	const vector<SSegment>& vSegment = a_NewMemory.GetSegmentList();
+	for (n32 i = 0; i < static_cast<n32>(vSegment.size()); i++)
+	{
+		const u8* pNewMemory = a_NewMemory.GetSegmentMemory(i);
+		const u8* pOldMemory = a_OldMemory.GetPointer(vSegment[i].Address, vSegment[i].Size);
+		if (pOldMemory == nullptr)
+		{
+			return false;
+		}
+		for (u64 uOffset = 0; uOffset < vSegment[i].Size; uOffset += s_uPageSize)
+		{
+			if (memcmp(pOldMemory + uOffset, pNewMemory + uOffset, static_cast<size_t>(s_uPageSize)) != 0)
+			{
+				vPageOffset.push_back(vSegment[i].Address - a_NewMemory.GetAddress() + uOffset);
+				vPage.push_back(pNewMemory + uOffset);
+			}
+		}
+	}
+	// write a private file and rename it, concurrent runs never see a half written entry
+	UString sFileName = getFileName(a_sKey);
+	char szSuffix[64] = {};
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	sprintf(szSuffix, ".%u.tmp", static_cast<u32>(GetCurrentThreadId()));
+#else
+	sprintf(szSuffix, ".%d.%p.tmp", static_cast<n32>(getpid()), static_cast<void*>(&vPageOffset));
+#endif
+	UString sTempFileName = sFileName + U8ToU(szSuffix);
+	FILE* fp = UFopen(sTempFileName.c_str(), USTR("wb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	u32 uHeader[4] = { s_uSignature, s_uVersion, static_cast<u32>(vInvalidIndex.size()), static_cast<u32>(vPageOffset.size()) };
+	bool bResult = fwrite(uHeader, sizeof(uHeader), 1, fp) == 1;
+	if (bResult && !vInvalidIndex.empty())
+	{
+		bResult = fwrite(&*vInvalidIndex.begin(), sizeof(n32), vInvalidIndex.size(), fp) == vInvalidIndex.size();
+	}
+	if (bResult && !vPageOffset.empty())
+	{
+		bResult = fwrite(&*vPageOffset.begin(), sizeof(u64), vPageOffset.size(), fp) == vPageOffset.size();
+	}
+	for (vector<const u8*>::const_iterator it = vPage.begin(); bResult && it != vPage.end(); ++it)
+	{
+		bResult = fwrite(*it, 1, static_cast<size_t>(s_uPageSize), fp) == s_uPageSize;
+	}
+	fclose(fp);
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	if (!bResult || MoveFileExW(sTempFileName.c_str(), sFileName.c_str(), MOVEFILE_REPLACE_EXISTING) == 0)
+#else
+	if (!bResult || rename(sTempFileName.c_str(), sFileName.c_str()) != 0)
+#endif
+	{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+		_wremove(sTempFileName.c_str());
+#else
+		remove(sTempFileName.c_str());
+#endif
+		return false;
+	}
+	return true;
+}
+
+UString CResultCache::getFileName(const string& a_sKey) const
+{
+	return m_sDirName + USTR("/") + U8ToU(a_sKey) + USTR(".eirc");
+}
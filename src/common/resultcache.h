@@ -0,0 +1,24 @@
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+#include <sdw.h>
+#include "memoryimage.h"
+
+// on-disk cache of emulation results keyed by everything that decides them, a hit replaces the whole .init_array run
+class CResultCache
+{
+public:
+	CResultCache();
+	void SetDirName(const UString& a_sDirName);
+	bool IsEnabled() const;
+	bool Load(const string& a_sKey, CMemoryImage& a_Memory, set<n32>& a_sInvalidIndex) const;
+	bool Save(const string& a_sKey, const CMemoryImage& a_OldMemory, const CMemoryImage& a_NewMemory, const set<n32>& a_sInvalidIndex) const;
+	static const u32 s_uSignature;
+	static const u32 s_uVersion;
+	static const u64 s_uPageSize;
+private:
+	UString getFileName(const string& a_sKey) const;
+	UString m_sDirName;
+};
+
+#endif	// RESULTCACHE_H_
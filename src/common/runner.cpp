@@ -0,0 +1,831 @@
+#include "runner.h"
+#include <chrono>
+
+SBudget::SBudget()
+	: Timeout(10000000)
+	, InstructionCount(0)
+	, Adaptive(false)
+	, SliceInstructionCount(1000000)
+	, MaxInstructionCount(0)
+	, HangCount(10000)
+{
+}
+
+bool ParseBudgetOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SBudget& a_Budget)
+{
+	const UChar* pOption = a_pArgv[a_nIndex];
+	if (UCscmp(pOption, USTR("--adaptive")) == 0)
+	{
+		a_Budget.Adaptive = true;
+		return true;
+	}
+	if (a_nIndex + 1 >= a_nArgc)
+	{
+		return false;
+	}
+	if (UCscmp(pOption, USTR("--timeout")) == 0)
+	{
+		a_Budget.Timeout = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--budget")) == 0)
+	{
+		a_Budget.InstructionCount = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--entry-budget")) == 0)
+	{
+		UString sValue = a_pArgv[a_nIndex + 1];
+		UString::size_type uPos = sValue.find(USTR('='));
+		if (uPos == UString::npos)
+		{
+			return false;
+		}
+		a_Budget.EntryInstructionCount[SToN32(sValue.substr(0, uPos))] = SToU64(sValue.substr(uPos + 1));
+		a_nIndex++;
+	}
+	else if (UCscmp(pOption, USTR("--slice")) == 0)
+	{
+		a_Budget.SliceInstructionCount = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--budget-max")) == 0)
+	{
+		a_Budget.MaxInstructionCount = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--hang-count")) == 0)
+	{
+		a_Budget.HangCount = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void UpdateHashKey(CHashKey& a_HashKey, const SImageLayout& a_ImageLayout)
+{
+	a_HashKey.Update(a_ImageLayout.Machine);
+	a_HashKey.Update(a_ImageLayout.MemoryAddress);
+	a_HashKey.Update(a_ImageLayout.TextAddressMin);
+	a_HashKey.Update(a_ImageLayout.TextAddressMax);
+	a_HashKey.Update(a_ImageLayout.DataAddress);
+	a_HashKey.Update(a_ImageLayout.DataSize);
+	a_HashKey.Update(a_ImageLayout.BssAddress);
+	a_HashKey.Update(a_ImageLayout.BssSize);
+	for (vector<SSegment>::const_iterator it = a_ImageLayout.SegmentList.begin(); it != a_ImageLayout.SegmentList.end(); ++it)
+	{
+		a_HashKey.Update(it->Address);
+		a_HashKey.Update(it->Size);
+		a_HashKey.Update(static_cast<u64>(it->Protection));
+	}
+	a_HashKey.Update(static_cast<u64>(a_ImageLayout.RelocationTargetList.size()));
+	if (!a_ImageLayout.RelocationTargetList.empty())
+	{
+		a_HashKey.Update(&*a_ImageLayout.RelocationTargetList.begin(), a_ImageLayout.RelocationTargetList.size() * sizeof(u64));
+	}
+}
+
+void UpdateHashKey(CHashKey& a_HashKey, const SBudget& a_Budget)
+{
+	a_HashKey.Update(a_Budget.Timeout);
+	a_HashKey.Update(a_Budget.InstructionCount);
+	a_HashKey.Update(static_cast<u64>(a_Budget.EntryInstructionCount.size()));
+	for (map<n32, u64>::const_iterator it = a_Budget.EntryInstructionCount.begin(); it != a_Budget.EntryInstructionCount.end(); ++it)
+	{
+		a_HashKey.Update(static_cast<u64>(it->first));
+		a_HashKey.Update(it->second);
+	}
+	a_HashKey.Update(static_cast<u64>(a_Budget.Adaptive));
+	a_HashKey.Update(a_Budget.SliceInstructionCount);
+	a_HashKey.Update(a_Budget.MaxInstructionCount);
+	a_HashKey.Update(a_Budget.HangCount);
+}
+
+bool ParseHeapOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SHeap& a_Heap)
+{
+	const UChar* pOption = a_pArgv[a_nIndex];
+	if (UCscmp(pOption, USTR("--heap-keep-pointer")) == 0)
+	{
+		a_Heap.KeepPointer = true;
+		return true;
+	}
+	if (a_nIndex + 1 >= a_nArgc)
+	{
+		return false;
+	}
+	if (UCscmp(pOption, USTR("--heap-address")) == 0)
+	{
+		a_Heap.Address = SToU64(a_pArgv[++a_nIndex], 16);
+	}
+	else if (UCscmp(pOption, USTR("--heap-size")) == 0)
+	{
+		a_Heap.Size = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void UpdateHashKey(CHashKey& a_HashKey, const SHeap& a_Heap)
+{
+	a_HashKey.Update(a_Heap.Address);
+	a_HashKey.Update(a_Heap.Size);
+	a_HashKey.Update(static_cast<u64>(a_Heap.KeepPointer));
+}
+
+bool ParseThreadOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SThread& a_Thread)
+{
+	const UChar* pOption = a_pArgv[a_nIndex];
+	if (a_nIndex + 1 >= a_nArgc)
+	{
+		return false;
+	}
+	if (UCscmp(pOption, USTR("--tls-size")) == 0)
+	{
+		a_Thread.TlsSize = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--pid")) == 0)
+	{
+		a_Thread.ProcessId = SToU32(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(pOption, USTR("--clock")) == 0)
+	{
+		a_Thread.ClockTime = SToU64(a_pArgv[++a_nIndex]);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void UpdateHashKey(CHashKey& a_HashKey, const SThread& a_Thread)
+{
+	a_HashKey.Update(a_Thread.TlsSize);
+	a_HashKey.Update(static_cast<u64>(a_Thread.ProcessId));
+	a_HashKey.Update(a_Thread.ClockTime);
+}
+
+CRunner::CRunner()
+	: m_pMemory(nullptr)
+	, m_pWritableMemory(nullptr)
+	, m_eCommitPolicy(kCommitPolicyData)
+	, m_bVerbose(false)
+	, m_nSPRegId(-1)
+	, m_nLRRegId(-1)
+	, m_nPCRegId(-1)
+	, m_nTPRegId(-1)
+	, m_uStackDirtyAddress(UINT64_MAX)
+	, m_uStackDirtyAddressMax(0)
+	, m_bCountInstruction(false)
+	, m_pProfiler(nullptr)
+	, m_uLastBlockAddress(0)
+	, m_uLoopAddress(UINT64_MAX)
+	, m_uLocalWriteCount(0)
+	, m_bHang(false)
+	, m_uWriteProtAddress(0)
+{
+	memset(&m_RunStat, 0, sizeof(m_RunStat));
+}
+
+void CRunner::Init(const SImageLayout& a_ImageLayout, CMemoryImage* a_pMemory, ECommitPolicy a_eCommitPolicy)
+{
+	Init(a_ImageLayout, a_pMemory, a_pMemory, a_eCommitPolicy);
+}
+
+void CRunner::Init(const SImageLayout& a_ImageLayout, const CMemoryImage* a_pMemory, CMemoryImage* a_pWritableMemory, ECommitPolicy a_eCommitPolicy)
+{
+	m_ImageLayout = a_ImageLayout;
+	m_pMemory = a_pMemory;
+	m_pWritableMemory = a_pWritableMemory;
+	m_eCommitPolicy = a_eCommitPolicy;
+	if (m_ImageLayout.Machine == kMachineARM)
+	{
+		m_nSPRegId = UC_ARM_REG_SP;
+		m_nLRRegId = UC_ARM_REG_LR;
+		m_nPCRegId = UC_ARM_REG_PC;
+		m_nTPRegId = UC_ARM_REG_C13_C0_3;
+	}
+	else if (m_ImageLayout.Machine == kMachineAARCH64)
+	{
+		m_nSPRegId = UC_ARM64_REG_SP;
+		m_nLRRegId = UC_ARM64_REG_LR;
+		m_nPCRegId = UC_ARM64_REG_PC;
+		m_nTPRegId = UC_ARM64_REG_TPIDR_EL0;
+	}
+	m_HostCall.Init(m_ImageLayout.Machine);
+	// the image as the guest sees it, one piece per segment as every segment has its own buffer
+	for (vector<SSegment>::const_iterator it = m_ImageLayout.SegmentList.begin(); it != m_ImageLayout.SegmentList.end(); ++it)
+	{
+		if ((it->Protection & UC_PROT_WRITE) != 0)
+		{
+			// every byte an entry can write is rolled back with it, .got, .data.rel.ro and .init_array included
+			m_Snapshot.AddRegion(it->Address, it->Size, m_pWritableMemory->GetPointer(it->Address, it->Size));
+			m_HostCall.AddMemory(it->Address, it->Size, m_pWritableMemory->GetPointer(it->Address, it->Size), false);
+		}
+		else
+		{
+			m_HostCall.AddMemory(it->Address, it->Size, m_pMemory->GetPointer(it->Address, it->Size), true);
+		}
+	}
+	m_sStack.assign(static_cast<size_t>(CEngine::s_uStackSize), 0);
+	m_HostCall.AddMemory(CEngine::s_uStackAddress, m_sStack.size(), reinterpret_cast<u8*>(&*m_sStack.begin()), false);
+	m_HostCall.SetAccessCallback(&CRunner::onHostCallAccess, this);
+}
+
+void CRunner::SetVerbose(bool a_bVerbose)
+{
+	m_bVerbose = a_bVerbose;
+}
+
+void CRunner::AddTracker(CPageTracker* a_pTracker)
+{
+	m_vTracker.push_back(a_pTracker);
+}
+
+void CRunner::SetCountInstruction(bool a_bCountInstruction)
+{
+	m_bCountInstruction = a_bCountInstruction;
+}
+
+void CRunner::SetBudget(const SBudget& a_Budget)
+{
+	m_Budget = a_Budget;
+}
+
+void CRunner::SetHeap(const SHeap& a_Heap)
+{
+	m_HostCall.SetHeap(a_Heap);
+	const SHeap& heap = m_HostCall.GetHeap();
+	m_Snapshot.AddRegion(heap.Address, heap.Size, m_HostCall.GetHeapMemory());
+}
+
+void CRunner::SetThread(const SThread& a_Thread)
+{
+	m_HostCall.SetThread(a_Thread);
+}
+
+void CRunner::SetProfiler(CProfiler* a_pProfiler)
+{
+	m_pProfiler = a_pProfiler;
+}
+
+bool CRunner::Run(u64 a_uAddress, n32 a_nIndex, EExitReason& a_eExitReason)
+{
+	memset(&m_RunStat, 0, sizeof(m_RunStat));
+	n32 nMode = 0;
+	if (m_ImageLayout.Machine == kMachineARM && a_uAddress % 2 != 0)
+	{
+		nMode = 1;
+	}
+	if (m_Engine[nMode].GetUc() == nullptr && !open(nMode))
+	{
+		return false;
+	}
+	clearStack();
+	uc_err eErr = m_Engine[nMode].Reset();
+	if (eErr != UC_ERR_OK)
+	{
+		if (m_bVerbose)
+		{
+			printf("Failed on uc_context_restore() with error returned: %u (%s)\n", eErr, uc_strerror(eErr));
+		}
+		return false;
+	}
+	uc_engine* pUc = m_Engine[nMode].GetUc();
+	m_HostCall.Clear();
+	// the saved context has no thread pointer
+	u64 uTP = m_HostCall.GetThreadPointer();
+	uc_reg_write(pUc, m_nTPRegId, &uTP);
+	m_uLastBlockAddress = 0;
+	m_mLoop.clear();
+	m_uLoopAddress = UINT64_MAX;
+	m_uLocalWriteCount = 0;
+	m_bHang = false;
+	m_uWriteProtAddress = 0;
+	u64 uLR = CEngine::s_uReturnAddress;
+	u64 uPC = 0x00000000;
+	u64 uLimit = m_Budget.InstructionCount;
+	map<n32, u64>::const_iterator itEntry = m_Budget.EntryInstructionCount.find(a_nIndex);
+	if (itEntry != m_Budget.EntryInstructionCount.end())
+	{
+		uLimit = itEntry->second;
+	}
+	u64 uSlice = uLimit;
+	if (m_Budget.Adaptive)
+	{
+		if (uLimit != 0)
+		{
+			uLimit = max<u64>(uLimit, m_Budget.MaxInstructionCount != 0 ? m_Budget.MaxInstructionCount : uLimit * 8);
+		}
+		uSlice = m_Budget.SliceInstructionCount;
+		clearBlock();
+	}
+	u64 uBegin = a_uAddress;
+	u64 uUntil = m_ImageLayout.TextAddressMax - a_uAddress;
+	u64 uExecuted = 0;
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	for (;;)
+	{
+		u64 uCount = uSlice;
+		if (uLimit != 0 && (uCount == 0 || uCount > uLimit - uExecuted))
+		{
+			uCount = uLimit - uExecuted;
+		}
+		u64 uTimeout = 0;
+		if (m_Budget.Timeout != 0)
+		{
+			u64 uElapsed = static_cast<u64>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count());
+			if (uElapsed >= m_Budget.Timeout)
+			{
+				break;
+			}
+			uTimeout = m_Budget.Timeout - uElapsed;
+		}
+		u64 uBlockCount = m_vBlockSeenList.size();
+		u64 uLineCount = m_Snapshot.GetNewLineCount();
+		eErr = uc_emu_start(pUc, uBegin, uUntil, uTimeout, uCount);
+		if (eErr != UC_ERR_OK || uCount == 0 || !m_Budget.Adaptive || m_HostCall.IsFailed() || m_HostCall.IsSysCallFailed() || m_bHang)
+		{
+			break;
+		}
+		uExecuted += uCount;
+		if (uLimit != 0 && uExecuted >= uLimit)
+		{
+			break;
+		}
+		if (m_vBlockSeenList.size() == uBlockCount && m_Snapshot.GetNewLineCount() == uLineCount)
+		{
+			// no new code and no new data written during a whole slice
+			break;
+		}
+		uBegin = 0;
+		eErr = uc_reg_read(pUc, m_nPCRegId, &uBegin);
+		if (m_ImageLayout.Machine == kMachineARM)
+		{
+			u64 uCPSR = 0;
+			eErr = uc_reg_read(pUc, UC_ARM_REG_CPSR, &uCPSR);
+			if ((uCPSR & 0x20) != 0)
+			{
+				uBegin |= 1;
+			}
+		}
+	}
+	m_RunStat.Time = static_cast<u64>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count());
+	m_RunStat.Error = eErr;
+	uc_reg_read(pUc, m_nPCRegId, &m_RunStat.PC);
+	m_RunStat.HeapAllocationCount = m_HostCall.GetAllocationCount();
+	if (m_HostCall.IsFailed())
+	{
+		a_eExitReason = kExitReasonHostCall;
+	}
+	else if (m_HostCall.IsSysCallFailed())
+	{
+		a_eExitReason = kExitReasonSysCall;
+		if (m_bVerbose)
+		{
+			if (m_HostCall.GetInterrupt() == CHostCall::s_uInterruptSvc)
+			{
+				printf("unsupported system call %llu at %llX, aborted\n", static_cast<unsigned long long>(m_HostCall.GetSysCallNumber()), static_cast<unsigned long long>(m_RunStat.PC));
+			}
+			else
+			{
+				printf("exception %u at %llX, aborted\n", m_HostCall.GetInterrupt(), static_cast<unsigned long long>(m_RunStat.PC));
+			}
+		}
+	}
+	else if (m_bHang)
+	{
+		a_eExitReason = kExitReasonHang;
+		m_RunStat.PC = m_uLoopAddress;
+		if (m_bVerbose)
+		{
+			printf("hang in the loop at %llX, aborted\n", static_cast<unsigned long long>(m_uLoopAddress));
+		}
+	}
+	else if (eErr == UC_ERR_OK)
+	{
+		a_eExitReason = kExitReasonTimeout;
+	}
+	else if (eErr == UC_ERR_FETCH_UNMAPPED)
+	{
+		eErr = uc_reg_read(pUc, m_nPCRegId, &uPC);
+		if (uPC == uLR)
+		{
+			a_eExitReason = kExitReasonReturn;
+		}
+		else if (uPC < m_ImageLayout.TextAddressMin || uPC >= m_ImageLayout.TextAddressMax)
+		{
+			a_eExitReason = kExitReasonFetchOutsideText;
+		}
+		else
+		{
+			a_eExitReason = kExitReasonFetchInsideText;
+		}
+	}
+	else
+	{
+		a_eExitReason = kExitReasonError;
+		if (eErr == UC_ERR_WRITE_PROT && m_bVerbose)
+		{
+			printf("write to read-only %llX at %llX, aborted\n", static_cast<unsigned long long>(m_uWriteProtAddress), static_cast<unsigned long long>(m_RunStat.PC));
+		}
+	}
+	return true;
+}
+
+EEntryResult CRunner::Finish(EExitReason a_eExitReason)
+{
+	m_Snapshot.GetChangedSize(m_ImageLayout.DataAddress, m_ImageLayout.DataSize, m_RunStat.DataPageCount, m_RunStat.DataByteCount);
+	m_Snapshot.GetChangedSize(m_ImageLayout.BssAddress, m_ImageLayout.BssSize, m_RunStat.BssPageCount, m_RunStat.BssByteCount);
+	switch (a_eExitReason)
+	{
+	case kExitReasonReturn:
+		if (m_eCommitPolicy == kCommitPolicyAlways || (m_Snapshot.IsChanged(m_ImageLayout.DataAddress, m_ImageLayout.DataSize) && !isChangedOutsideData()))
+		{
+			// the dynamic linker rewrites relocation targets on device, a new value there would be lost
+			if (m_eCommitPolicy == kCommitPolicyData && m_Snapshot.IsChanged(m_ImageLayout.DataAddress, m_ImageLayout.DataSize, m_ImageLayout.RelocationTargetList, m_ImageLayout.Machine == kMachineARM ? 4 : 8))
+			{
+				if (m_bVerbose)
+				{
+					printf("relocation target changed, rolled back\n");
+				}
+				break;
+			}
+			// the thread local storage is not part of the output, a constructor dropped from .init_array would leave it unset
+			if (m_eCommitPolicy == kCommitPolicyData && m_HostCall.IsTlsWritten())
+			{
+				if (m_bVerbose)
+				{
+					printf("thread local storage written, rolled back\n");
+				}
+				break;
+			}
+			const SHeap& heap = m_HostCall.GetHeap();
+			if (heap.Size != 0)
+			{
+				m_RunStat.HeapPointerCount = m_Snapshot.GetDirtyValueCount(m_ImageLayout.DataAddress, m_ImageLayout.DataSize, m_ImageLayout.Machine == kMachineARM ? 4 : 8, heap.Address, m_HostCall.GetHeapTop());
+				if (m_RunStat.HeapPointerCount != 0 && m_bVerbose)
+				{
+					printf("%llu pointers into the heap left in .data%s\n", static_cast<unsigned long long>(m_RunStat.HeapPointerCount), heap.KeepPointer ? "" : ", rolled back");
+				}
+			}
+			if (m_RunStat.HeapPointerCount == 0 || m_HostCall.GetHeap().KeepPointer)
+			{
+				m_Snapshot.Commit();
+				m_HostCall.CommitHeap();
+				return kEntryResultCommitted;
+			}
+		}
+		break;
+	case kExitReasonFetchInsideText:
+		return kEntryResultFailed;
+	case kExitReasonError:
+		if (m_eCommitPolicy == kCommitPolicyData)
+		{
+			return kEntryResultFailed;
+		}
+		break;
+	default:
+		break;
+	}
+	m_Snapshot.Rollback();
+	m_HostCall.RollbackHeap();
+	return kEntryResultRolledBack;
+}
+
+const SRunStat& CRunner::GetRunStat() const
+{
+	return m_RunStat;
+}
+
+// only .data is written back into the file, whatever else an entry changed in the writable segments would be lost, .bss included
+bool CRunner::isChangedOutsideData() const
+{
+	u64 uDataAddressMax = m_ImageLayout.DataAddress + m_ImageLayout.DataSize;
+	for (vector<SSegment>::const_iterator it = m_ImageLayout.SegmentList.begin(); it != m_ImageLayout.SegmentList.end(); ++it)
+	{
+		if ((it->Protection & UC_PROT_WRITE) == 0)
+		{
+			continue;
+		}
+		u64 uAddressMax = it->Address + it->Size;
+		if (it->Address < m_ImageLayout.DataAddress && m_Snapshot.IsChanged(it->Address, min<u64>(uAddressMax, m_ImageLayout.DataAddress) - it->Address))
+		{
+			return true;
+		}
+		u64 uAddress = max<u64>(it->Address, uDataAddressMax);
+		if (uAddress < uAddressMax && m_Snapshot.IsChanged(uAddress, uAddressMax - uAddress))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void CRunner::onBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData)
+{
+	CRunner* pRunner = static_cast<CRunner*>(a_pUserData);
+	if (pRunner->m_bCountInstruction)
+	{
+		pRunner->m_RunStat.InstructionCount += a_uSize / 4;
+	}
+	if (pRunner->m_pProfiler != nullptr)
+	{
+		pRunner->m_pProfiler->AddBlock(a_uAddress, a_uSize / 4);
+	}
+	if (pRunner->m_Budget.Adaptive)
+	{
+		pRunner->markBlock(a_uAddress);
+	}
+	if (pRunner->m_Budget.HangCount != 0)
+	{
+		pRunner->checkLoop(a_pUc, a_uAddress);
+	}
+}
+
+void CRunner::onThumbBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData)
+{
+	CRunner* pRunner = static_cast<CRunner*>(a_pUserData);
+	if (pRunner->m_bCountInstruction || pRunner->m_pProfiler != nullptr)
+	{
+		u32 uCount = pRunner->getThumbInstructionCount(a_pUc, a_uAddress, a_uSize);
+		if (pRunner->m_bCountInstruction)
+		{
+			pRunner->m_RunStat.InstructionCount += uCount;
+		}
+		if (pRunner->m_pProfiler != nullptr)
+		{
+			pRunner->m_pProfiler->AddBlock(a_uAddress, uCount);
+		}
+	}
+	if (pRunner->m_Budget.Adaptive)
+	{
+		pRunner->markBlock(a_uAddress);
+	}
+	if (pRunner->m_Budget.HangCount != 0)
+	{
+		pRunner->checkLoop(a_pUc, a_uAddress);
+	}
+}
+
+void CRunner::onHostCallAccess(void* a_pUserData, u64 a_uAddress, u64 a_uSize, bool a_bWrite)
+{
+	// host implementations bypass the memory hooks, so their accesses are recorded here
+	CRunner* pRunner = static_cast<CRunner*>(a_pUserData);
+	if (a_bWrite)
+	{
+		pRunner->m_Snapshot.MarkDirty(a_uAddress, a_uSize);
+		pRunner->markStack(a_uAddress, a_uSize);
+	}
+	for (vector<CPageTracker*>::iterator it = pRunner->m_vTracker.begin(); it != pRunner->m_vTracker.end(); ++it)
+	{
+		if (a_bWrite)
+		{
+			(*it)->MarkWrite(a_uAddress, a_uSize);
+		}
+		else
+		{
+			(*it)->MarkRead(a_uAddress, a_uSize);
+		}
+	}
+}
+
+void CRunner::onStackWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	CRunner* pRunner = static_cast<CRunner*>(a_pUserData);
+	pRunner->markStack(a_uAddress, static_cast<u64>(a_nSize));
+	if (pRunner->m_Budget.HangCount != 0)
+	{
+		pRunner->countLocalWrite(a_pUc, a_uAddress, a_nSize, a_nValue);
+	}
+}
+
+void CRunner::onLocalWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	static_cast<CRunner*>(a_pUserData)->countLocalWrite(a_pUc, a_uAddress, a_nSize, a_nValue);
+}
+
+bool CRunner::onWriteProt(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	// the fault stops the entry with UC_ERR_WRITE_PROT, only the target is kept for the report
+	static_cast<CRunner*>(a_pUserData)->m_uWriteProtAddress = a_uAddress;
+	return false;
+}
+
+bool CRunner::open(n32 a_nMode)
+{
+	uc_arch eArch = UC_ARCH_ARM;
+	uc_mode eMode = UC_MODE_ARM;
+	if (m_ImageLayout.Machine == kMachineAARCH64)
+	{
+		eArch = UC_ARCH_ARM64;
+	}
+	else if (a_nMode == 1)
+	{
+		eMode = UC_MODE_THUMB;
+	}
+	uc_err eErr = m_Engine[a_nMode].Open(eArch, eMode, *m_pMemory, *m_pWritableMemory, m_sStack, m_nSPRegId, m_nLRRegId, m_nPCRegId);
+	if (eErr != UC_ERR_OK)
+	{
+		if (m_bVerbose)
+		{
+			printf("Failed on uc_open() with error returned: %u (%s)\n", eErr, uc_strerror(eErr));
+		}
+		return false;
+	}
+	eErr = m_Snapshot.Attach(m_Engine[a_nMode].GetUc());
+	if (eErr == UC_ERR_OK)
+	{
+		eErr = m_HostCall.Attach(m_Engine[a_nMode].GetUc());
+	}
+	if (eErr == UC_ERR_OK)
+	{
+		uc_hook hook = 0;
+		eErr = uc_hook_add(m_Engine[a_nMode].GetUc(), &hook, UC_HOOK_MEM_WRITE_PROT, reinterpret_cast<void*>(&CRunner::onWriteProt), this, 1, 0);
+	}
+	if (eErr == UC_ERR_OK && (m_bCountInstruction || m_Budget.Adaptive || m_pProfiler != nullptr || m_Budget.HangCount != 0))
+	{
+		uc_hook hook = 0;
+		eErr = uc_hook_add(m_Engine[a_nMode].GetUc(), &hook, UC_HOOK_BLOCK, reinterpret_cast<void*>(a_nMode == 1 ? &CRunner::onThumbBlock : &CRunner::onBlock), this, 1, 0);
+	}
+	if (eErr == UC_ERR_OK)
+	{
+		// the stack is shared by both engines, whichever runs next clears what this one wrote
+		uc_hook hook = 0;
+		eErr = uc_hook_add(m_Engine[a_nMode].GetUc(), &hook, UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&CRunner::onStackWrite), this, CEngine::s_uStackAddress, CEngine::s_uStackAddress + CEngine::s_uStackSize - 1);
+	}
+	if (eErr == UC_ERR_OK && m_Budget.HangCount != 0 && m_HostCall.GetThread().TlsSize != 0)
+	{
+		// the snapshot sees the writable segments and the heap, a loop keeping its state in thread local storage progresses there, the stack hook counts the stack
+		uc_hook hook = 0;
+		eErr = uc_hook_add(m_Engine[a_nMode].GetUc(), &hook, UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&CRunner::onLocalWrite), this, CHostCall::s_uTlsAddress, CHostCall::s_uTlsAddress + m_HostCall.GetThread().TlsSize - 1);
+	}
+	for (vector<CPageTracker*>::iterator it = m_vTracker.begin(); eErr == UC_ERR_OK && it != m_vTracker.end(); ++it)
+	{
+		eErr = (*it)->Attach(m_Engine[a_nMode].GetUc());
+	}
+	if (eErr != UC_ERR_OK)
+	{
+		if (m_bVerbose)
+		{
+			printf("Failed on uc_hook_add() with error returned: %u (%s)\n", eErr, uc_strerror(eErr));
+		}
+		return false;
+	}
+	return true;
+}
+
+u32 CRunner::getThumbInstructionCount(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize)
+{
+	map<u64, u32>::const_iterator it = m_mThumbBlockInstructionCount.find(a_uAddress);
+	if (it != m_mThumbBlockInstructionCount.end())
+	{
+		return it->second;
+	}
+	vector<u8> vCode(a_uSize);
+	if (a_uSize == 0 || uc_mem_read(a_pUc, a_uAddress, &*vCode.begin(), a_uSize) != UC_ERR_OK)
+	{
+		return 0;
+	}
+	u32 uCount = 0;
+	for (u32 uOffset = 0; uOffset + 2 <= a_uSize; uCount++)
+	{
+		// 0b11101, 0b11110 and 0b11111 in the top bits of the first halfword start a 32-bit instruction
+		u16 uHalfword = static_cast<u16>(vCode[uOffset] | vCode[uOffset + 1] << 8);
+		uOffset += (uHalfword >> 11) >= 0x1D ? 4 : 2;
+	}
+	m_mThumbBlockInstructionCount.insert(make_pair(a_uAddress, uCount));
+	return uCount;
+}
+
+void CRunner::markBlock(u64 a_uAddress)
+{
+	if (a_uAddress < m_ImageLayout.TextAddressMin || a_uAddress >= m_ImageLayout.TextAddressMax)
+	{
+		return;
+	}
+	if (m_vBlockSeen.empty())
+	{
+		m_vBlockSeen.resize(static_cast<size_t>((m_ImageLayout.TextAddressMax - m_ImageLayout.TextAddressMin) / 2 / 8 + 1), 0);
+	}
+	u64 uIndex = (a_uAddress - m_ImageLayout.TextAddressMin) / 2;
+	u8& uBits = m_vBlockSeen[static_cast<size_t>(uIndex / 8)];
+	if ((uBits & (1 << (uIndex % 8))) == 0)
+	{
+		uBits |= 1 << (uIndex % 8);
+		m_vBlockSeenList.push_back(uIndex);
+	}
+}
+
+void CRunner::clearBlock()
+{
+	for (vector<u64>::const_iterator it = m_vBlockSeenList.begin(); it != m_vBlockSeenList.end(); ++it)
+	{
+		m_vBlockSeen[static_cast<size_t>(*it / 8)] = 0;
+	}
+	m_vBlockSeenList.clear();
+}
+
+void CRunner::markStack(u64 a_uAddress, u64 a_uSize)
+{
+	if (a_uSize == 0 || a_uAddress >= CEngine::s_uStackAddress + CEngine::s_uStackSize || a_uAddress + a_uSize <= CEngine::s_uStackAddress)
+	{
+		return;
+	}
+	m_uStackDirtyAddress = min<u64>(m_uStackDirtyAddress, max<u64>(a_uAddress, CEngine::s_uStackAddress));
+	m_uStackDirtyAddressMax = max<u64>(m_uStackDirtyAddressMax, min<u64>(a_uAddress + a_uSize, CEngine::s_uStackAddress + CEngine::s_uStackSize));
+}
+
+// every entry starts from a zeroed stack, a constructor uses a few pages of it at most
+void CRunner::clearStack()
+{
+	if (m_uStackDirtyAddress >= m_uStackDirtyAddressMax)
+	{
+		return;
+	}
+	u64 uOffset = (m_uStackDirtyAddress - CEngine::s_uStackAddress) / 4096 * 4096;
+	u64 uSize = Align(m_uStackDirtyAddressMax - CEngine::s_uStackAddress, 4096) - uOffset;
+	memset(&*m_sStack.begin() + uOffset, 0, static_cast<size_t>(uSize));
+	m_uStackDirtyAddress = UINT64_MAX;
+	m_uStackDirtyAddressMax = 0;
+}
+
+// the hook runs before the store, a store of the value already there is no progress, like the return address a call in the loop pushes
+void CRunner::countLocalWrite(uc_engine* a_pUc, u64 a_uAddress, n32 a_nSize, n64 a_nValue)
+{
+	u64 uValue = 0;
+	if (a_nSize <= 0 || a_nSize > 8 || uc_mem_read(a_pUc, a_uAddress, &uValue, a_nSize) != UC_ERR_OK || memcmp(&uValue, &a_nValue, a_nSize) != 0)
+	{
+		m_uLocalWriteCount++;
+	}
+}
+
+// a spin loop comes back to its head with the state it left there
+// every head counts on its own, so calls through .plt and inner loops between two visits do not reset it, only a write that makes progress does
+// the registers are read on the second visit after progress and after HangCount visits
+void CRunner::checkLoop(uc_engine* a_pUc, u64 a_uAddress)
+{
+	u64 uLastBlockAddress = m_uLastBlockAddress;
+	m_uLastBlockAddress = a_uAddress;
+	if (a_uAddress > uLastBlockAddress)
+	{
+		return;
+	}
+	u64 uProgressCount = m_Snapshot.GetWriteCount() + m_uLocalWriteCount;
+	SLoop& loop = m_mLoop[a_uAddress];
+	if (loop.ProgressCount != uProgressCount)
+	{
+		loop.ProgressCount = uProgressCount;
+		loop.Count = 0;
+		return;
+	}
+	loop.Count++;
+	if (loop.Count == 1)
+	{
+		readRegister(a_pUc, loop.Register);
+	}
+	else if (loop.Count >= m_Budget.HangCount)
+	{
+		vector<u64> vRegister;
+		readRegister(a_pUc, vRegister);
+		if (vRegister == loop.Register)
+		{
+			m_uLoopAddress = a_uAddress;
+			m_bHang = true;
+			uc_emu_stop(a_pUc);
+			return;
+		}
+		// still counting, look again after another HangCount visits
+		loop.Register.swap(vRegister);
+		loop.Count = 1;
+	}
+}
+
+// general purpose registers, stack pointer, link register and flags, then the floating point and SIMD registers and their status, a loop may keep its whole state there
+void CRunner::readRegister(uc_engine* a_pUc, vector<u64>& a_vRegister) const
+{
+	static const n32 c_nARMRegId[] = { UC_ARM_REG_R0, UC_ARM_REG_R1, UC_ARM_REG_R2, UC_ARM_REG_R3, UC_ARM_REG_R4, UC_ARM_REG_R5, UC_ARM_REG_R6, UC_ARM_REG_R7, UC_ARM_REG_R8, UC_ARM_REG_R9, UC_ARM_REG_R10, UC_ARM_REG_R11, UC_ARM_REG_R12, UC_ARM_REG_SP, UC_ARM_REG_LR, UC_ARM_REG_CPSR, UC_ARM_REG_FPSCR };
+	static const n32 c_nAArch64RegId[] = { UC_ARM64_REG_X0, UC_ARM64_REG_X1, UC_ARM64_REG_X2, UC_ARM64_REG_X3, UC_ARM64_REG_X4, UC_ARM64_REG_X5, UC_ARM64_REG_X6, UC_ARM64_REG_X7, UC_ARM64_REG_X8, UC_ARM64_REG_X9, UC_ARM64_REG_X10, UC_ARM64_REG_X11, UC_ARM64_REG_X12, UC_ARM64_REG_X13, UC_ARM64_REG_X14, UC_ARM64_REG_X15, UC_ARM64_REG_X16, UC_ARM64_REG_X17, UC_ARM64_REG_X18, UC_ARM64_REG_X19, UC_ARM64_REG_X20, UC_ARM64_REG_X21, UC_ARM64_REG_X22, UC_ARM64_REG_X23, UC_ARM64_REG_X24, UC_ARM64_REG_X25, UC_ARM64_REG_X26, UC_ARM64_REG_X27, UC_ARM64_REG_X28, UC_ARM64_REG_X29, UC_ARM64_REG_LR, UC_ARM64_REG_SP, UC_ARM64_REG_NZCV, UC_ARM64_REG_FPCR, UC_ARM64_REG_FPSR };
+	bool bARM = m_ImageLayout.Machine == kMachineARM;
+	const n32* pRegId = bARM ? c_nARMRegId : c_nAArch64RegId;
+	n32 nCount = bARM ? static_cast<n32>(sizeof(c_nARMRegId) / sizeof(c_nARMRegId[0])) : static_cast<n32>(sizeof(c_nAArch64RegId) / sizeof(c_nAArch64RegId[0]));
+	// d0-d31 take one word each, q0-q31 two
+	a_vRegister.assign(nCount + (bARM ? 32 : 64), 0);
+	for (n32 i = 0; i < nCount; i++)
+	{
+		uc_reg_read(a_pUc, pRegId[i], &a_vRegister[i]);
+	}
+	for (n32 i = 0; i < 32; i++)
+	{
+		if (bARM)
+		{
+			uc_reg_read(a_pUc, UC_ARM_REG_D0 + i, &a_vRegister[nCount + i]);
+		}
+		else
+		{
+			uc_reg_read(a_pUc, UC_ARM64_REG_Q0 + i, &a_vRegister[nCount + i * 2]);
+		}
+	}
+}
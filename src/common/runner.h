@@ -0,0 +1,198 @@
+#ifndef RUNNER_H_
+#define RUNNER_H_
+
+#include <sdw.h>
+#include <unordered_map>
+#include <elfio/elfio.hpp>
+#include <unicorn/unicorn.h>
+#include "engine.h"
+#include "hash.h"
+#include "hostcall.h"
+#include "pagetracker.h"
+#include "profiler.h"
+#include "snapshot.h"
+
+enum EMachine
+{
+	kMachineARM = EM_ARM,
+	kMachineAARCH64 = EM_res183/* EM_AARCH64 ARM AARCH64 */,
+};
+
+enum EExitReason
+{
+	kExitReasonReturn,
+	kExitReasonTimeout,
+	// a loop went around with the same registers, floating point and SIMD ones included, and without writing, it would spin until the budget ran out
+	kExitReasonHang,
+	kExitReasonFetchOutsideText,
+	kExitReasonFetchInsideText,
+	// an imported function got arguments its host implementation cannot serve, or was abort()
+	kExitReasonHostCall,
+	// an svc asked for a system call without a deterministic answer, or another exception was raised
+	kExitReasonSysCall,
+	kExitReasonError,
+};
+
+enum ECommitPolicy
+{
+	// emuInit, keep an entry only if it changed .data and left the rest of the writable segments alone, .bss included
+	kCommitPolicyData,
+	// dumpInitMemory, keep every entry that returned
+	kCommitPolicyAlways,
+};
+
+enum EEntryResult
+{
+	kEntryResultCommitted,
+	kEntryResultRolledBack,
+	kEntryResultFailed,
+};
+
+struct SImageLayout
+{
+	u16 Machine;
+	u64 MemoryAddress;
+	u64 TextAddressMin;
+	u64 TextAddressMax;
+	u64 DataAddress;
+	u64 DataSize;
+	u64 BssAddress;
+	u64 BssSize;
+	// the PT_LOAD mappings
+	vector<SSegment> SegmentList;
+	// sorted addresses of the words the dynamic relocations write
+	vector<u64> RelocationTargetList;
+};
+
+struct SRunStat
+{
+	u64 InstructionCount;
+	// microseconds
+	u64 Time;
+	uc_err Error;
+	u64 PC;
+	u64 DataPageCount;
+	u64 DataByteCount;
+	u64 BssPageCount;
+	u64 BssByteCount;
+	// calls to malloc, free and the like
+	u64 HeapAllocationCount;
+	// pointers into the heap left in .data by a returning entry
+	u64 HeapPointerCount;
+};
+
+struct SBudget
+{
+	SBudget();
+	// wall clock limit per entry in microseconds, 0 for none
+	u64 Timeout;
+	// instruction limit per entry, 0 for none
+	u64 InstructionCount;
+	map<n32, u64> EntryInstructionCount;
+	// run in slices and stop an entry after the first slice without new blocks or new writes, entries that keep progressing may run up to MaxInstructionCount, 0 meaning 8 times their budget
+	bool Adaptive;
+	u64 SliceInstructionCount;
+	u64 MaxInstructionCount;
+	// abort an entry once backward branches reached the same block this many times without writes to the writable segments or the heap, without a store changing the stack or thread local storage and with the registers it had there before, 0 disables
+	u64 HangCount;
+};
+
+// consumes one of --timeout <us>, --budget <n>, --entry-budget <index>=<n>, --adaptive, --slice <n>, --budget-max <n> or --hang-count <n> at a_nIndex
+bool ParseBudgetOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SBudget& a_Budget);
+
+void UpdateHashKey(CHashKey& a_HashKey, const SImageLayout& a_ImageLayout);
+
+void UpdateHashKey(CHashKey& a_HashKey, const SBudget& a_Budget);
+
+// consumes one of --heap-address <hex>, --heap-size <n> or --heap-keep-pointer at a_nIndex
+bool ParseHeapOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SHeap& a_Heap);
+
+void UpdateHashKey(CHashKey& a_HashKey, const SHeap& a_Heap);
+
+// consumes one of --tls-size <n>, --pid <n> or --clock <ns> at a_nIndex
+bool ParseThreadOption(int a_nArgc, UChar* a_pArgv[], n32& a_nIndex, SThread& a_Thread);
+
+void UpdateHashKey(CHashKey& a_HashKey, const SThread& a_Thread);
+
+// runs initializers over one memory image and keeps or discards what each of them wrote
+class CRunner
+{
+public:
+	CRunner();
+	void Init(const SImageLayout& a_ImageLayout, CMemoryImage* a_pMemory, ECommitPolicy a_eCommitPolicy);
+	// a_pMemory is shared with other runners and only read, this runner writes its own copy of the writable segments, a_pWritableMemory has to hold all of them
+	void Init(const SImageLayout& a_ImageLayout, const CMemoryImage* a_pMemory, CMemoryImage* a_pWritableMemory, ECommitPolicy a_eCommitPolicy);
+	void SetVerbose(bool a_bVerbose);
+	void AddTracker(CPageTracker* a_pTracker);
+	void SetCountInstruction(bool a_bCountInstruction);
+	void SetBudget(const SBudget& a_Budget);
+	void SetHeap(const SHeap& a_Heap);
+	void SetThread(const SThread& a_Thread);
+	// set before the first Run, the block hook is only added when something needs it
+	void SetProfiler(CProfiler* a_pProfiler);
+	bool Run(u64 a_uAddress, n32 a_nIndex, EExitReason& a_eExitReason);
+	EEntryResult Finish(EExitReason a_eExitReason);
+	const SRunStat& GetRunStat() const;
+private:
+	static void onBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData);
+	static void onThumbBlock(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize, void* a_pUserData);
+	static void onHostCallAccess(void* a_pUserData, u64 a_uAddress, u64 a_uSize, bool a_bWrite);
+	static void onStackWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	static void onLocalWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	static bool onWriteProt(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	bool open(n32 a_nMode);
+	u32 getThumbInstructionCount(uc_engine* a_pUc, u64 a_uAddress, u32 a_uSize);
+	void markBlock(u64 a_uAddress);
+	void clearBlock();
+	void markStack(u64 a_uAddress, u64 a_uSize);
+	void clearStack();
+	bool isChangedOutsideData() const;
+	void countLocalWrite(uc_engine* a_pUc, u64 a_uAddress, n32 a_nSize, n64 a_nValue);
+	void checkLoop(uc_engine* a_pUc, u64 a_uAddress);
+	void readRegister(uc_engine* a_pUc, vector<u64>& a_vRegister) const;
+	SImageLayout m_ImageLayout;
+	const CMemoryImage* m_pMemory;
+	CMemoryImage* m_pWritableMemory;
+	ECommitPolicy m_eCommitPolicy;
+	bool m_bVerbose;
+	n32 m_nSPRegId;
+	n32 m_nLRRegId;
+	n32 m_nPCRegId;
+	// TPIDRURO or TPIDR_EL0
+	n32 m_nTPRegId;
+	string m_sStack;
+	// the span of the stack written since it was last cleared, only that much is zeroed before the next entry
+	u64 m_uStackDirtyAddress;
+	u64 m_uStackDirtyAddressMax;
+	// [0] ARM or AARCH64, [1] Thumb
+	CEngine m_Engine[2];
+	CSnapshot m_Snapshot;
+	CHostCall m_HostCall;
+	vector<CPageTracker*> m_vTracker;
+	bool m_bCountInstruction;
+	CProfiler* m_pProfiler;
+	// Thumb blocks mix 16-bit and 32-bit instructions, their count is decoded once per block
+	map<u64, u32> m_mThumbBlockInstructionCount;
+	SRunStat m_RunStat;
+	SBudget m_Budget;
+	// blocks seen by the current entry, one bit per halfword of .text
+	vector<u8> m_vBlockSeen;
+	vector<u64> m_vBlockSeenList;
+	// a head taken by a backward branch, its visits since the last progress and the state at the first of them
+	struct SLoop
+	{
+		u64 Count;
+		u64 ProgressCount;
+		vector<u64> Register;
+	};
+	// the block run last, every loop head of the current entry, the one found hanging and the writes that changed the stack or the thread local storage
+	u64 m_uLastBlockAddress;
+	unordered_map<u64, SLoop> m_mLoop;
+	u64 m_uLoopAddress;
+	u64 m_uLocalWriteCount;
+	bool m_bHang;
+	// where the current entry tried to write a segment without PF_W
+	u64 m_uWriteProtAddress;
+};
+
+#endif	// RUNNER_H_
@@ -0,0 +1,256 @@
+#include "snapshot.h"
+
+const u64 CSnapshot::s_uPageSize = 4096;
+const u64 CSnapshot::s_uLineSize = 64;
+
+CSnapshot::CSnapshot()
+	: m_uNewLineCount(0)
+	, m_uWriteCount(0)
+{
+}
+
+void CSnapshot::AddRegion(u64 a_uAddress, u64 a_uSize, u8* a_pMemory)
+{
+	if (a_uSize == 0 || a_pMemory == nullptr)
+	{
+		return;
+	}
+	m_vRegion.resize(m_vRegion.size() + 1);
+	SRegion& region = m_vRegion.back();
+	region.Address = a_uAddress;
+	region.Size = a_uSize;
+	region.PageAddress = a_uAddress / s_uPageSize * s_uPageSize;
+	region.Memory = a_pMemory;
+	region.DirtyPage.resize(static_cast<size_t>(Align(a_uAddress + a_uSize - region.PageAddress, s_uPageSize) / s_uPageSize), 0);
+}
+
+uc_err CSnapshot::Attach(uc_engine* a_pUc)
+{
+	uc_err eErr = UC_ERR_OK;
+	for (vector<SRegion>::const_iterator it = m_vRegion.begin(); eErr == UC_ERR_OK && it != m_vRegion.end(); ++it)
+	{
+		uc_hook hook = 0;
+		eErr = uc_hook_add(a_pUc, &hook, UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&CSnapshot::onMemWrite), this, it->Address, it->Address + it->Size - 1);
+	}
+	return eErr;
+}
+
+void CSnapshot::MarkDirty(u64 a_uAddress, u64 a_uSize)
+{
+	m_uWriteCount++;
+	for (vector<SRegion>::iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		SRegion& region = *it;
+		if (a_uAddress >= region.Address + region.Size || a_uAddress + a_uSize <= region.Address)
+		{
+			continue;
+		}
+		u64 uBegin = max<u64>(a_uAddress, region.Address);
+		u64 uEnd = min<u64>(a_uAddress + a_uSize, region.Address + region.Size);
+		for (u64 uPage = (uBegin - region.PageAddress) / s_uPageSize; uPage <= (uEnd - 1 - region.PageAddress) / s_uPageSize; uPage++)
+		{
+			u32& uIndex = region.DirtyPage[static_cast<size_t>(uPage)];
+			if (uIndex == 0)
+			{
+				region.DirtyPageList.push_back(static_cast<u32>(uPage));
+				region.WrittenLine.push_back(0);
+				uIndex = static_cast<u32>(region.DirtyPageList.size());
+				region.Shadow.resize(region.Shadow.size() + static_cast<size_t>(s_uPageSize));
+				u64 uOffset = 0;
+				u64 uSize = 0;
+				getPageRange(region, static_cast<u32>(uPage), region.Address, region.Size, uOffset, uSize);
+				memcpy(const_cast<u8*>(getShadow(region, uIndex - 1, uOffset)), region.Memory + uOffset, static_cast<size_t>(uSize));
+			}
+			u64 uPageAddress = region.PageAddress + uPage * s_uPageSize;
+			u64 uLineBegin = (max<u64>(uBegin, uPageAddress) - uPageAddress) / s_uLineSize;
+			u64 uLineEnd = (min<u64>(uEnd, uPageAddress + s_uPageSize) - 1 - uPageAddress) / s_uLineSize;
+			u64& uWrittenLine = region.WrittenLine[uIndex - 1];
+			for (u64 uLine = uLineBegin; uLine <= uLineEnd; uLine++)
+			{
+				if ((uWrittenLine & (1ULL << uLine)) == 0)
+				{
+					uWrittenLine |= 1ULL << uLine;
+					m_uNewLineCount++;
+				}
+			}
+		}
+	}
+}
+
+bool CSnapshot::IsChanged(u64 a_uAddress, u64 a_uSize) const
+{
+	for (vector<SRegion>::const_iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		const SRegion& region = *it;
+		for (n32 i = 0; i < static_cast<n32>(region.DirtyPageList.size()); i++)
+		{
+			u64 uOffset = 0;
+			u64 uSize = 0;
+			if (getPageRange(region, region.DirtyPageList[i], a_uAddress, a_uSize, uOffset, uSize) && memcmp(region.Memory + uOffset, getShadow(region, i, uOffset), static_cast<size_t>(uSize)) != 0)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// pages written and bytes that really differ from the committed state
+void CSnapshot::GetChangedSize(u64 a_uAddress, u64 a_uSize, u64& a_uPageCount, u64& a_uByteCount) const
+{
+	a_uPageCount = 0;
+	a_uByteCount = 0;
+	for (vector<SRegion>::const_iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		const SRegion& region = *it;
+		for (n32 i = 0; i < static_cast<n32>(region.DirtyPageList.size()); i++)
+		{
+			u64 uOffset = 0;
+			u64 uSize = 0;
+			if (!getPageRange(region, region.DirtyPageList[i], a_uAddress, a_uSize, uOffset, uSize))
+			{
+				continue;
+			}
+			a_uPageCount++;
+			const u8* pShadow = getShadow(region, i, uOffset);
+			for (u64 j = 0; j < uSize; j++)
+			{
+				if (region.Memory[uOffset + j] != pShadow[j])
+				{
+					a_uByteCount++;
+				}
+			}
+		}
+	}
+}
+
+// aligned values on the written pages that fall in [a_uValueMin, a_uValueMax), such as pointers into the heap
+u64 CSnapshot::GetDirtyValueCount(u64 a_uAddress, u64 a_uSize, u32 a_uValueSize, u64 a_uValueMin, u64 a_uValueMax) const
+{
+	u64 uCount = 0;
+	for (vector<SRegion>::const_iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		const SRegion& region = *it;
+		for (vector<u32>::const_iterator itPage = region.DirtyPageList.begin(); itPage != region.DirtyPageList.end(); ++itPage)
+		{
+			u64 uOffset = 0;
+			u64 uSize = 0;
+			if (!getPageRange(region, *itPage, a_uAddress, a_uSize, uOffset, uSize))
+			{
+				continue;
+			}
+			for (u64 uAddress = Align(region.Address + uOffset, a_uValueSize); uAddress + a_uValueSize <= region.Address + uOffset + uSize; uAddress += a_uValueSize)
+			{
+				u64 uValue = 0;
+				memcpy(&uValue, region.Memory + (uAddress - region.Address), a_uValueSize);
+				if (uValue >= a_uValueMin && uValue < a_uValueMax)
+				{
+					uCount++;
+				}
+			}
+		}
+	}
+	return uCount;
+}
+
+bool CSnapshot::IsChanged(u64 a_uAddress, u64 a_uSize, const vector<u64>& a_vAddress, u32 a_uValueSize) const
+{
+	if (a_vAddress.empty())
+	{
+		return false;
+	}
+	for (vector<SRegion>::const_iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		const SRegion& region = *it;
+		for (n32 i = 0; i < static_cast<n32>(region.DirtyPageList.size()); i++)
+		{
+			u64 uOffset = 0;
+			u64 uSize = 0;
+			if (!getPageRange(region, region.DirtyPageList[i], a_uAddress, a_uSize, uOffset, uSize))
+			{
+				continue;
+			}
+			for (vector<u64>::const_iterator itAddress = lower_bound(a_vAddress.begin(), a_vAddress.end(), region.Address + uOffset); itAddress != a_vAddress.end() && *itAddress < region.Address + uOffset + uSize; ++itAddress)
+			{
+				u64 uValueOffset = *itAddress - region.Address;
+				u64 uValueSize = min<u64>(a_uValueSize, uOffset + uSize - uValueOffset);
+				if (memcmp(region.Memory + uValueOffset, getShadow(region, i, uValueOffset), static_cast<size_t>(uValueSize)) != 0)
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// the memory already holds the new state, only the saved pages are dropped
+void CSnapshot::Commit()
+{
+	for (vector<SRegion>::iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		SRegion& region = *it;
+		for (vector<u32>::const_iterator itPage = region.DirtyPageList.begin(); itPage != region.DirtyPageList.end(); ++itPage)
+		{
+			region.DirtyPage[*itPage] = 0;
+		}
+		region.DirtyPageList.clear();
+		region.Shadow.clear();
+		region.WrittenLine.clear();
+	}
+}
+
+void CSnapshot::Rollback()
+{
+	for (vector<SRegion>::iterator it = m_vRegion.begin(); it != m_vRegion.end(); ++it)
+	{
+		SRegion& region = *it;
+		for (n32 i = 0; i < static_cast<n32>(region.DirtyPageList.size()); i++)
+		{
+			u64 uOffset = 0;
+			u64 uSize = 0;
+			getPageRange(region, region.DirtyPageList[i], region.Address, region.Size, uOffset, uSize);
+			memcpy(region.Memory + uOffset, getShadow(region, i, uOffset), static_cast<size_t>(uSize));
+			region.DirtyPage[region.DirtyPageList[i]] = 0;
+		}
+		region.DirtyPageList.clear();
+		region.Shadow.clear();
+		region.WrittenLine.clear();
+	}
+}
+
+u64 CSnapshot::GetNewLineCount() const
+{
+	return m_uNewLineCount;
+}
+
+u64 CSnapshot::GetWriteCount() const
+{
+	return m_uWriteCount;
+}
+
+void CSnapshot::onMemWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData)
+{
+	CSnapshot* pSnapshot = static_cast<CSnapshot*>(a_pUserData);
+	pSnapshot->MarkDirty(a_uAddress, static_cast<u64>(a_nSize));
+}
+
+// clip a dirty page to the region and to [a_uAddress, a_uAddress + a_uSize), offsets are relative to the region start
+bool CSnapshot::getPageRange(const SRegion& a_Region, u32 a_uPage, u64 a_uAddress, u64 a_uSize, u64& a_uOffset, u64& a_uRangeSize) const
+{
+	u64 uBegin = max<u64>(max<u64>(a_Region.PageAddress + a_uPage * s_uPageSize, a_Region.Address), a_uAddress);
+	u64 uEnd = min<u64>(min<u64>(a_Region.PageAddress + (a_uPage + 1) * s_uPageSize, a_Region.Address + a_Region.Size), a_uAddress + a_uSize);
+	if (uBegin >= uEnd)
+	{
+		return false;
+	}
+	a_uOffset = uBegin - a_Region.Address;
+	a_uRangeSize = uEnd - uBegin;
+	return true;
+}
+
+// the saved byte of the a_nIndex-th dirty page at the region offset a_uOffset
+const u8* CSnapshot::getShadow(const SRegion& a_Region, n32 a_nIndex, u64 a_uOffset) const
+{
+	return &*a_Region.Shadow.begin() + static_cast<size_t>(a_nIndex * s_uPageSize + (a_Region.Address + a_uOffset - a_Region.PageAddress) % s_uPageSize);
+}
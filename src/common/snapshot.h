@@ -0,0 +1,51 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <sdw.h>
+#include <unicorn/unicorn.h>
+
+// tracks the pages of the writable segments and the heap written by the current entry, a page is saved on its first write so rollback and commit only touch those pages
+class CSnapshot
+{
+public:
+	CSnapshot();
+	void AddRegion(u64 a_uAddress, u64 a_uSize, u8* a_pMemory);
+	uc_err Attach(uc_engine* a_pUc);
+	// before the bytes change, pages the host changes while they are clean are taken as committed
+	void MarkDirty(u64 a_uAddress, u64 a_uSize);
+	bool IsChanged(u64 a_uAddress, u64 a_uSize) const;
+	// only the values at the sorted a_vAddress
+	bool IsChanged(u64 a_uAddress, u64 a_uSize, const vector<u64>& a_vAddress, u32 a_uValueSize) const;
+	void GetChangedSize(u64 a_uAddress, u64 a_uSize, u64& a_uPageCount, u64& a_uByteCount) const;
+	u64 GetDirtyValueCount(u64 a_uAddress, u64 a_uSize, u32 a_uValueSize, u64 a_uValueMin, u64 a_uValueMax) const;
+	void Commit();
+	void Rollback();
+	u64 GetNewLineCount() const;
+	// every write to a region so far, stack writes are not seen
+	u64 GetWriteCount() const;
+	static const u64 s_uPageSize;
+	static const u64 s_uLineSize;
+private:
+	struct SRegion
+	{
+		u64 Address;
+		u64 Size;
+		u64 PageAddress;
+		u8* Memory;
+		// index + 1 into DirtyPageList, 0 while the page is clean
+		vector<u32> DirtyPage;
+		vector<u32> DirtyPageList;
+		// the committed bytes of each dirty page, s_uPageSize each in DirtyPageList order
+		vector<u8> Shadow;
+		// first writes to each cache line of each dirty page since the last commit or rollback, a cheap measure of forward progress
+		vector<u64> WrittenLine;
+	};
+	static void onMemWrite(uc_engine* a_pUc, uc_mem_type a_eType, u64 a_uAddress, n32 a_nSize, n64 a_nValue, void* a_pUserData);
+	bool getPageRange(const SRegion& a_Region, u32 a_uPage, u64 a_uAddress, u64 a_uSize, u64& a_uOffset, u64& a_uRangeSize) const;
+	const u8* getShadow(const SRegion& a_Region, n32 a_nIndex, u64 a_uOffset) const;
+	vector<SRegion> m_vRegion;
+	u64 m_uNewLineCount;
+	u64 m_uWriteCount;
+};
+
+#endif	// SNAPSHOT_H_
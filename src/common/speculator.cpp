@@ -0,0 +1,130 @@
+#include "speculator.h"
+#include <atomic>
+#include <thread>
+
+CSpeculator::CSpeculator()
+	: m_nJobs(0)
+	, m_bCountInstruction(false)
+{
+}
+
+void CSpeculator::SetJobs(n32 a_nJobs)
+{
+	m_nJobs = a_nJobs;
+}
+
+void CSpeculator::SetCountInstruction(bool a_bCountInstruction)
+{
+	m_bCountInstruction = a_bCountInstruction;
+}
+
+void CSpeculator::SetBudget(const SBudget& a_Budget)
+{
+	m_Budget = a_Budget;
+}
+
+void CSpeculator::SetHeap(const SHeap& a_Heap)
+{
+	m_Heap = a_Heap;
+}
+
+void CSpeculator::SetThread(const SThread& a_Thread)
+{
+	m_Thread = a_Thread;
+}
+
+void CSpeculator::Run(const SImageLayout& a_ImageLayout, const CMemoryImage& a_Memory, ECommitPolicy a_eCommitPolicy, const vector<u64>& a_vAddress, vector<SResult>& a_vResult)
+{
+	a_vResult.clear();
+	a_vResult.resize(a_vAddress.size());
+	for (vector<SResult>::iterator it = a_vResult.begin(); it != a_vResult.end(); ++it)
+	{
+		it->Valid = false;
+	}
+	n32 nJobs = m_nJobs;
+	if (nJobs <= 0)
+	{
+		nJobs = static_cast<n32>(thread::hardware_concurrency());
+	}
+	if (nJobs <= 0)
+	{
+		nJobs = 1;
+	}
+	if (static_cast<size_t>(nJobs) > a_vAddress.size())
+	{
+		nJobs = static_cast<n32>(a_vAddress.size());
+	}
+	atomic<size_t> uNext(0);
+	vector<thread> vWorker;
+	for (n32 i = 0; i < nJobs; i++)
+	{
+		vWorker.push_back(thread([&]()
+		{
+			// the workers share the image and only copy the writable segments
+			CMemoryImage memory;
+			if (!memory.Copy(a_Memory, true))
+			{
+				return;
+			}
+			CPageTracker tracker;
+			tracker.SetRange(a_Memory.GetAddress(), a_Memory.GetSize());
+			tracker.SetTrackRead(true);
+			CRunner runner;
+			runner.Init(a_ImageLayout, &a_Memory, &memory, a_eCommitPolicy);
+			runner.AddTracker(&tracker);
+			runner.SetCountInstruction(m_bCountInstruction);
+			runner.SetBudget(m_Budget);
+			runner.SetHeap(m_Heap);
+			runner.SetThread(m_Thread);
+			for (size_t uIndex = uNext++; uIndex < a_vAddress.size(); uIndex = uNext++)
+			{
+				u64 uAddress = a_vAddress[uIndex];
+				if (uAddress < a_ImageLayout.TextAddressMin || uAddress >= a_ImageLayout.TextAddressMax)
+				{
+					continue;
+				}
+				SResult& result = a_vResult[uIndex];
+				tracker.Clear();
+				if (!runner.Run(uAddress, static_cast<n32>(uIndex), result.ExitReason))
+				{
+					continue;
+				}
+				result.EntryResult = runner.Finish(result.ExitReason);
+				result.RunStat = runner.GetRunStat();
+				const vector<u32>& vFetchPageList = tracker.GetFetchPageList();
+				const vector<u32>& vReadPageList = tracker.GetReadPageList();
+				const vector<u32>& vWritePageList = tracker.GetWritePageList();
+				result.AccessPageList = vFetchPageList;
+				result.AccessPageList.insert(result.AccessPageList.end(), vReadPageList.begin(), vReadPageList.end());
+				result.AccessPageList.insert(result.AccessPageList.end(), vWritePageList.begin(), vWritePageList.end());
+				result.WritePageList = vWritePageList;
+				result.WritePageData.resize(static_cast<size_t>(vWritePageList.size() * CPageTracker::s_uPageSize));
+				for (size_t j = 0; j < vWritePageList.size(); j++)
+				{
+					u64 uPageAddress = a_Memory.GetAddress() + vWritePageList[j] * CPageTracker::s_uPageSize;
+					u8* pPage = memory.GetPointer(uPageAddress, CPageTracker::s_uPageSize);
+					const u8* pBasePage = a_Memory.GetPointer(uPageAddress, CPageTracker::s_uPageSize);
+					// a write to a page outside the writable segments faulted before it happened
+					const u8* pData = pPage != nullptr ? pPage : pBasePage;
+					if (pData == nullptr)
+					{
+						continue;
+					}
+					memcpy(&*result.WritePageData.begin() + j * CPageTracker::s_uPageSize, pData, static_cast<size_t>(CPageTracker::s_uPageSize));
+					// put the private pages back to the base state for the next entry, the snapshot takes clean pages as they are
+					if (pPage != nullptr)
+					{
+						memcpy(pPage, pBasePage, static_cast<size_t>(CPageTracker::s_uPageSize));
+					}
+				}
+				// heap addresses depend on what earlier entries allocated, so an entry that allocates runs again in order
+				// so does an entry stopped by the clock or by the adaptive budget, with the other workers competing for the cores it may finish when run alone
+				result.Valid = result.RunStat.HeapAllocationCount == 0 && result.ExitReason != kExitReasonTimeout;
+			}
+		}));
+	}
+	for (vector<thread>::iterator it = vWorker.begin(); it != vWorker.end(); ++it)
+	{
+		it->join();
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef SPECULATOR_H_
+#define SPECULATOR_H_
+
+#include <sdw.h>
+#include "runner.h"
+
+// runs entries in parallel, each on a private copy of the image, and keeps what is needed to commit them in order later
+class CSpeculator
+{
+public:
+	struct SResult
+	{
+		bool Valid;
+		EExitReason ExitReason;
+		EEntryResult EntryResult;
+		SRunStat RunStat;
+		// pages fetched, read or written, the result only holds if none of them changed before the entry commits
+		vector<u32> AccessPageList;
+		vector<u32> WritePageList;
+		string WritePageData;
+	};
+	CSpeculator();
+	void SetJobs(n32 a_nJobs);
+	void SetCountInstruction(bool a_bCountInstruction);
+	void SetBudget(const SBudget& a_Budget);
+	void SetHeap(const SHeap& a_Heap);
+	void SetThread(const SThread& a_Thread);
+	void Run(const SImageLayout& a_ImageLayout, const CMemoryImage& a_Memory, ECommitPolicy a_eCommitPolicy, const vector<u64>& a_vAddress, vector<SResult>& a_vResult);
+private:
+	n32 m_nJobs;
+	bool m_bCountInstruction;
+	SBudget m_Budget;
+	SHeap m_Heap;
+	SThread m_Thread;
+};
+
+#endif	// SPECULATOR_H_
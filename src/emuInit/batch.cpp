@@ -0,0 +1,196 @@
+#include "batch.h"
+#include <atomic>
+#include <thread>
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+CBatch::CBatch()
+	: m_nJobs(0)
+{
+	m_Option.Verbose = false;
+	m_Option.Parallel = 0;
+	m_Option.Manifest = false;
+	m_Option.InPlace = false;
+}
+
+void CBatch::SetJobs(n32 a_nJobs)
+{
+	m_nJobs = a_nJobs;
+}
+
+void CBatch::SetOption(const SEmuInitOption& a_Option)
+{
+	m_Option = a_Option;
+}
+
+bool CBatch::Load(const UString& a_sInputName, const UString& a_sOutputDirName)
+{
+	m_vJob.clear();
+	if (isDirectory(a_sInputName))
+	{
+		return loadDirectory(a_sInputName, a_sOutputDirName);
+	}
+	return loadManifest(a_sInputName, a_sOutputDirName);
+}
+
+int CBatch::Run(FProcess a_fProcess)
+{
+	n32 nJobs = m_nJobs;
+	if (nJobs <= 0)
+	{
+		nJobs = static_cast<n32>(thread::hardware_concurrency());
+	}
+	if (nJobs <= 0)
+	{
+		nJobs = 1;
+	}
+	if (static_cast<size_t>(nJobs) > m_vJob.size())
+	{
+		nJobs = static_cast<n32>(m_vJob.size());
+	}
+	atomic<size_t> uNext(0);
+	vector<thread> vWorker;
+	for (n32 i = 0; i < nJobs; i++)
+	{
+		vWorker.push_back(thread([this, a_fProcess, &uNext]()
+		{
+			for (size_t uIndex = uNext++; uIndex < m_vJob.size(); uIndex = uNext++)
+			{
+				SJob& job = m_vJob[uIndex];
+				job.Result = a_fProcess(job.InputFileName, job.OutputFileName, m_Option);
+			}
+		}));
+	}
+	for (vector<thread>::iterator it = vWorker.begin(); it != vWorker.end(); ++it)
+	{
+		it->join();
+	}
+	int nResult = 0;
+	for (vector<SJob>::const_iterator it = m_vJob.begin(); it != m_vJob.end(); ++it)
+	{
+		const SJob& job = *it;
+		UPrintf(USTR("%d\t%") PRIUS USTR("\n"), job.Result, job.InputFileName.c_str());
+		if (job.Result != 0)
+		{
+			nResult = 1;
+		}
+	}
+	return nResult;
+}
+
+// one input per line, optionally followed by a tab and the output file name
+bool CBatch::loadManifest(const UString& a_sManifestFileName, const UString& a_sOutputDirName)
+{
+	FILE* fp = UFopen(a_sManifestFileName.c_str(), USTR("rb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	string sLine;
+	char szBuffer[4096] = {};
+	while (fgets(szBuffer, sizeof(szBuffer), fp) != nullptr)
+	{
+		sLine += szBuffer;
+		if (!sLine.empty() && sLine[sLine.size() - 1] != '\n' && !feof(fp))
+		{
+			continue;
+		}
+		while (!sLine.empty() && (sLine[sLine.size() - 1] == '\n' || sLine[sLine.size() - 1] == '\r'))
+		{
+			sLine.erase(sLine.size() - 1);
+		}
+		if (!sLine.empty())
+		{
+			SJob job;
+			job.Result = 1;
+			string::size_type uPos = sLine.find('\t');
+			job.InputFileName = U8ToU(sLine.substr(0, uPos));
+			if (uPos != string::npos)
+			{
+				job.OutputFileName = U8ToU(sLine.substr(uPos + 1));
+			}
+			else
+			{
+				job.OutputFileName = a_sOutputDirName + USTR("/") + getFileName(job.InputFileName);
+			}
+			m_vJob.push_back(job);
+		}
+		sLine.clear();
+	}
+	fclose(fp);
+	return true;
+}
+
+bool CBatch::loadDirectory(const UString& a_sInputDirName, const UString& a_sOutputDirName)
+{
+	vector<UString> vFileName;
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	WIN32_FIND_DATAW ffd;
+	HANDLE hFind = FindFirstFileW((a_sInputDirName + USTR("/*")).c_str(), &ffd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	do
+	{
+		if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			vFileName.push_back(ffd.cFileName);
+		}
+	} while (FindNextFileW(hFind, &ffd) != 0);
+	FindClose(hFind);
+#else
+	DIR* pDir = opendir(a_sInputDirName.c_str());
+	if (pDir == nullptr)
+	{
+		return false;
+	}
+	for (dirent* pDirent = readdir(pDir); pDirent != nullptr; pDirent = readdir(pDir))
+	{
+		UString sFileName = pDirent->d_name;
+		if (!isDirectory(a_sInputDirName + USTR("/") + sFileName))
+		{
+			vFileName.push_back(sFileName);
+		}
+	}
+	closedir(pDir);
+#endif
+	sort(vFileName.begin(), vFileName.end());
+	for (vector<UString>::const_iterator it = vFileName.begin(); it != vFileName.end(); ++it)
+	{
+		const UString& sFileName = *it;
+		if (sFileName.size() < 3 || (sFileName.compare(sFileName.size() - 3, 3, USTR(".so")) != 0 && sFileName.find(USTR(".so.")) == UString::npos))
+		{
+			continue;
+		}
+		SJob job;
+		job.InputFileName = a_sInputDirName + USTR("/") + sFileName;
+		job.OutputFileName = a_sOutputDirName + USTR("/") + sFileName;
+		job.Result = 1;
+		m_vJob.push_back(job);
+	}
+	return true;
+}
+
+bool CBatch::isDirectory(const UString& a_sPath)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	DWORD uAttributes = GetFileAttributesW(a_sPath.c_str());
+	return uAttributes != INVALID_FILE_ATTRIBUTES && (uAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat st;
+	return stat(a_sPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+UString CBatch::getFileName(const UString& a_sPath)
+{
+	UString::size_type uPos = a_sPath.find_last_of(USTR("/\\"));
+	if (uPos == UString::npos)
+	{
+		return a_sPath;
+	}
+	return a_sPath.substr(uPos + 1);
+}
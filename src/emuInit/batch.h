@@ -0,0 +1,33 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <sdw.h>
+#include "emuInit.h"
+
+// runs the single file pipeline over a manifest or a directory on a pool of worker threads
+class CBatch
+{
+public:
+	typedef int (*FProcess)(const UString& a_sInputFileName, const UString& a_sOutputFileName, const SEmuInitOption& a_Option);
+	CBatch();
+	void SetJobs(n32 a_nJobs);
+	void SetOption(const SEmuInitOption& a_Option);
+	bool Load(const UString& a_sInputName, const UString& a_sOutputDirName);
+	int Run(FProcess a_fProcess);
+private:
+	struct SJob
+	{
+		UString InputFileName;
+		UString OutputFileName;
+		int Result;
+	};
+	bool loadManifest(const UString& a_sManifestFileName, const UString& a_sOutputDirName);
+	bool loadDirectory(const UString& a_sInputDirName, const UString& a_sOutputDirName);
+	static bool isDirectory(const UString& a_sPath);
+	static UString getFileName(const UString& a_sPath);
+	n32 m_nJobs;
+	SEmuInitOption m_Option;
+	vector<SJob> m_vJob;
+};
+
+#endif	// BATCH_H_
@@ -0,0 +1,32 @@
+#ifndef EMUINIT_H_
+#define EMUINIT_H_
+
+#include <sdw.h>
+#include "runner.h"
+
+struct SEmuInitOption
+{
+	bool Verbose;
+	// run .init_array entries speculatively on this many threads, 0 or 1 runs them in order
+	n32 Parallel;
+	// reuse and store results keyed by the image content here, empty disables the cache
+	UString CacheDirName;
+	// append a record per input here, .csv selects CSV and anything else JSON lines
+	UString MetricsFileName;
+	// append a block profile per input here, .csv selects per function CSV and anything else folded stacks
+	UString ProfileFileName;
+	// keep the footprint of every entry next to the output as <output>.eimf, the next run replays the entries that touch no changed page
+	bool Manifest;
+	// write only the changed byte runs into the output, a different output starts as a clone of the input
+	bool InPlace;
+	// per entry time and instruction limits
+	SBudget Budget;
+	// backs malloc and operator new during emulation
+	SHeap Heap;
+	// thread local storage and the answers to system calls
+	SThread Thread;
+};
+
+int EmuInit(const UString& a_sInputFileName, const UString& a_sOutputFileName, const SEmuInitOption& a_Option);
+
+#endif	// EMUINIT_H_
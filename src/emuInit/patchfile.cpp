@@ -0,0 +1,176 @@
+#include "patchfile.h"
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+#endif
+
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+static bool getFileId(const UString& a_sFileName, BY_HANDLE_FILE_INFORMATION& a_Information)
+{
+	HANDLE hFile = CreateFileW(a_sFileName.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	bool bResult = GetFileInformationByHandle(hFile, &a_Information) != 0;
+	CloseHandle(hFile);
+	return bResult;
+}
+#endif
+
+bool IsSameFile(const UString& a_sFileName, const UString& a_sOtherFileName)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	BY_HANDLE_FILE_INFORMATION information;
+	BY_HANDLE_FILE_INFORMATION otherInformation;
+	if (!getFileId(a_sFileName, information) || !getFileId(a_sOtherFileName, otherInformation))
+	{
+		return false;
+	}
+	return information.dwVolumeSerialNumber == otherInformation.dwVolumeSerialNumber && information.nFileIndexHigh == otherInformation.nFileIndexHigh && information.nFileIndexLow == otherInformation.nFileIndexLow;
+#else
+	struct stat st;
+	struct stat otherSt;
+	if (stat(a_sFileName.c_str(), &st) != 0 || stat(a_sOtherFileName.c_str(), &otherSt) != 0)
+	{
+		return false;
+	}
+	return st.st_dev == otherSt.st_dev && st.st_ino == otherSt.st_ino;
+#endif
+}
+
+// a reflink first, then copy_file_range which may still share blocks or copy inside the kernel, then a plain copy for whatever is left
+bool CloneFile(const UString& a_sSrcFileName, const UString& a_sDestFileName)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	// block cloning on ReFS is up to CopyFileW
+	return CopyFileW(a_sSrcFileName.c_str(), a_sDestFileName.c_str(), FALSE) != 0;
+#else
+	int nSrcFd = open(a_sSrcFileName.c_str(), O_RDONLY);
+	if (nSrcFd == -1)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(nSrcFd, &st) != 0)
+	{
+		close(nSrcFd);
+		return false;
+	}
+	int nDestFd = open(a_sDestFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+	if (nDestFd == -1)
+	{
+		close(nSrcFd);
+		return false;
+	}
+	bool bResult = false;
+	u64 uRemainSize = static_cast<u64>(st.st_size);
+#if defined(FICLONE)
+	if (ioctl(nDestFd, FICLONE, nSrcFd) == 0)
+	{
+		bResult = true;
+		uRemainSize = 0;
+	}
+#endif
+#if defined(SYS_copy_file_range)
+	while (uRemainSize != 0)
+	{
+		long nCopySize = syscall(SYS_copy_file_range, nSrcFd, nullptr, nDestFd, nullptr, static_cast<size_t>(min<u64>(uRemainSize, 0x40000000)), 0);
+		if (nCopySize <= 0)
+		{
+			// other file systems, old kernels and EXDEV go on with the plain copy from here
+			break;
+		}
+		uRemainSize -= static_cast<u64>(nCopySize);
+	}
+#endif
+	if (uRemainSize != 0)
+	{
+		const size_t c_uBufferSize = 0x100000;
+		vector<u8> vBuffer(c_uBufferSize);
+		while (uRemainSize != 0)
+		{
+			ssize_t nReadSize = read(nSrcFd, &*vBuffer.begin(), static_cast<size_t>(min<u64>(uRemainSize, c_uBufferSize)));
+			if (nReadSize <= 0)
+			{
+				break;
+			}
+			ssize_t nWriteOffset = 0;
+			while (nWriteOffset < nReadSize)
+			{
+				ssize_t nWriteSize = write(nDestFd, &*vBuffer.begin() + nWriteOffset, static_cast<size_t>(nReadSize - nWriteOffset));
+				if (nWriteSize <= 0)
+				{
+					break;
+				}
+				nWriteOffset += nWriteSize;
+			}
+			if (nWriteOffset != nReadSize)
+			{
+				break;
+			}
+			uRemainSize -= static_cast<u64>(nReadSize);
+		}
+	}
+	bResult = bResult || uRemainSize == 0;
+	close(nSrcFd);
+	if (close(nDestFd) != 0)
+	{
+		bResult = false;
+	}
+	return bResult;
+#endif
+}
+
+bool PatchFile(const UString& a_sFileName, const u8* a_pData, const vector<pair<u64, u64>>& a_vRange)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("r+b"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	bool bResult = true;
+	for (vector<pair<u64, u64>>::const_iterator it = a_vRange.begin(); bResult && it != a_vRange.end(); ++it)
+	{
+		bResult = Fseek(fp, static_cast<n64>(it->first), SEEK_SET) == 0 && fwrite(a_pData + it->first, 1, static_cast<size_t>(it->second), fp) == it->second;
+	}
+	if (fclose(fp) != 0)
+	{
+		bResult = false;
+	}
+	return bResult;
+#else
+	int nFd = open(a_sFileName.c_str(), O_WRONLY);
+	if (nFd == -1)
+	{
+		return false;
+	}
+	bool bResult = true;
+	for (vector<pair<u64, u64>>::const_iterator it = a_vRange.begin(); bResult && it != a_vRange.end(); ++it)
+	{
+		u64 uOffset = 0;
+		while (uOffset < it->second)
+		{
+			ssize_t nWriteSize = pwrite(nFd, a_pData + it->first + uOffset, static_cast<size_t>(it->second - uOffset), static_cast<off_t>(it->first + uOffset));
+			if (nWriteSize <= 0)
+			{
+				bResult = false;
+				break;
+			}
+			uOffset += static_cast<u64>(nWriteSize);
+		}
+	}
+	if (close(nFd) != 0)
+	{
+		bResult = false;
+	}
+	return bResult;
+#endif
+}
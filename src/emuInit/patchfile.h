@@ -0,0 +1,15 @@
+#ifndef PATCHFILE_H_
+#define PATCHFILE_H_
+
+#include <sdw.h>
+
+// true when both names open the same file, a missing file is never the same
+bool IsSameFile(const UString& a_sFileName, const UString& a_sOtherFileName);
+
+// a_sDestFileName becomes a copy of a_sSrcFileName, sharing its blocks where the file system can clone them
+bool CloneFile(const UString& a_sSrcFileName, const UString& a_sDestFileName);
+
+// writes the byte runs of a_pData given by a_vRange, file offset and size, at the same offsets of an existing file and leaves the rest alone
+bool PatchFile(const UString& a_sFileName, const u8* a_pData, const vector<pair<u64, u64>>& a_vRange);
+
+#endif	// PATCHFILE_H_
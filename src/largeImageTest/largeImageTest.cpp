@@ -0,0 +1,314 @@
+#include <sdw.h>
+#include <elfio/elfio.hpp>
+#include "mappedfile.h"
+#include "pagedump.h"
+#include "elfgenerator.h"
+
+using namespace ELFIO;
+
+// the addresses the generated image uses, read back from its section headers
+struct SLayout
+{
+	u64 DataAddress;
+	u64 DataOffset;
+	u64 DataSize;
+	u64 BssAddress;
+	u64 BssSize;
+	u64 RelaDynOffset;
+	u64 RelaDynSize;
+};
+
+static bool writeFile(const UString& a_sFileName, const string& a_sData)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("wb"), false);
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	bool bResult = fwrite(a_sData.data(), 1, a_sData.size(), fp) == a_sData.size();
+	if (fclose(fp) != 0)
+	{
+		bResult = false;
+	}
+	return bResult;
+}
+
+static bool readFile(const UString& a_sFileName, string& a_sData)
+{
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(a_sFileName))
+	{
+		return false;
+	}
+	a_sData.assign(reinterpret_cast<const char*>(mappedFile.GetData()), static_cast<size_t>(mappedFile.GetSize()));
+	return true;
+}
+
+// the tools are run as built, the same way a user runs them
+static int runTool(const UString& a_sCommandLine)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	// cmd.exe drops the outer quotes
+	return _wsystem((USTR("\"") + a_sCommandLine + USTR("\"")).c_str());
+#else
+	return system(a_sCommandLine.c_str());
+#endif
+}
+
+static UString quote(const UString& a_sArg)
+{
+	return USTR("\"") + a_sArg + USTR("\"");
+}
+
+static bool getLayout(const string& a_sElf, SLayout& a_Layout)
+{
+	CMemoryStreamBuf elfStreamBuf(reinterpret_cast<const u8*>(a_sElf.data()), a_sElf.size());
+	istream input(&elfStreamBuf);
+	elfio elfFile;
+	if (!elfFile.load(input))
+	{
+		return false;
+	}
+	memset(&a_Layout, 0, sizeof(a_Layout));
+	n32 nSectionSize = elfFile.sections.size();
+	for (n32 i = 0; i < nSectionSize; i++)
+	{
+		section* pSection = elfFile.sections[i];
+		string sName = pSection->get_name();
+		if (sName == ".data")
+		{
+			a_Layout.DataAddress = pSection->get_address();
+			a_Layout.DataOffset = pSection->get_offset();
+			a_Layout.DataSize = pSection->get_size();
+		}
+		else if (sName == ".bss")
+		{
+			a_Layout.BssAddress = pSection->get_address();
+			a_Layout.BssSize = pSection->get_size();
+		}
+		else if (sName == ".rela.dyn")
+		{
+			a_Layout.RelaDynOffset = pSection->get_offset();
+			a_Layout.RelaDynSize = pSection->get_size();
+		}
+	}
+	return a_Layout.DataSize != 0 && a_Layout.BssSize != 0 && a_Layout.RelaDynSize != 0;
+}
+
+// the generator lets every BssIntervalth constructor write .bss instead of its own .data slot
+static bool isBssEntry(const SElfParameter& a_Parameter, u64 a_uIndex)
+{
+	return a_Parameter.BssInterval != 0 && (a_uIndex + 1) % a_Parameter.BssInterval == 0;
+}
+
+static u64 getTargetAddress(const SElfParameter& a_Parameter, const SLayout& a_Layout, u64 a_uIndex)
+{
+	if (isBssEntry(a_Parameter, a_uIndex))
+	{
+		return a_Layout.BssAddress + (a_uIndex / a_Parameter.BssInterval % (a_Layout.BssSize / 8)) * 8;
+	}
+	return a_Layout.DataAddress + a_uIndex * 8;
+}
+
+static u64 readU64(const string& a_sData, u64 a_uOffset)
+{
+	u64 uValue = 0;
+	memcpy(&uValue, a_sData.data() + a_uOffset, 8);
+	return uValue;
+}
+
+// emuInit folds the constructors that only wrote .data and rolls back the ones that wrote .bss
+// the new .data slots and the -1 addends of the folded .rela.dyn entries are the only bytes allowed to change
+static bool checkEmuInit(const SElfParameter& a_Parameter, const SLayout& a_Layout, const string& a_sElf, const string& a_sOutput)
+{
+	if (a_sOutput.size() != a_sElf.size())
+	{
+		printf("emuInit: size %llu, expected %llu\n", static_cast<unsigned long long>(a_sOutput.size()), static_cast<unsigned long long>(a_sElf.size()));
+		return false;
+	}
+	string sExpected = a_sElf;
+	n32 nFoldedCount = 0;
+	for (u64 i = 0; i < static_cast<u64>(a_Parameter.EntryCount); i++)
+	{
+		if (isBssEntry(a_Parameter, i))
+		{
+			continue;
+		}
+		u64 uValue = a_Parameter.LoopCount;
+		memcpy(&*sExpected.begin() + a_Layout.DataOffset + i * 8, &uValue, 8);
+		// the .init_array relocations come first, r_addend is the third word of Elf64_Rela
+		uValue = UINT64_MAX;
+		memcpy(&*sExpected.begin() + a_Layout.RelaDynOffset + i * 24 + 16, &uValue, 8);
+		nFoldedCount++;
+	}
+	n32 nOutputFoldedCount = 0;
+	for (u64 i = 0; i < static_cast<u64>(a_Parameter.EntryCount); i++)
+	{
+		if (readU64(a_sOutput, a_Layout.RelaDynOffset + i * 24 + 16) == UINT64_MAX)
+		{
+			nOutputFoldedCount++;
+		}
+	}
+	if (nOutputFoldedCount != nFoldedCount)
+	{
+		printf("emuInit: %d entries folded, expected %d\n", nOutputFoldedCount, nFoldedCount);
+		return false;
+	}
+	for (u64 i = 0; i < a_sOutput.size(); i++)
+	{
+		if (a_sOutput[static_cast<size_t>(i)] != sExpected[static_cast<size_t>(i)])
+		{
+			printf("emuInit: byte at 0x%llX is 0x%02X, expected 0x%02X\n", static_cast<unsigned long long>(i), static_cast<u8>(a_sOutput[static_cast<size_t>(i)]), static_cast<u8>(sExpected[static_cast<size_t>(i)]));
+			return false;
+		}
+	}
+	return true;
+}
+
+// dumpInitMemory keeps every constructor, the delta holds exactly the pages of the slots they wrote
+static bool checkDumpInitMemory(const SElfParameter& a_Parameter, const SLayout& a_Layout, const string& a_sDump)
+{
+	if (a_sDump.size() < sizeof(CPageDump::SHeader))
+	{
+		printf("dumpInitMemory: truncated dump\n");
+		return false;
+	}
+	CPageDump::SHeader header;
+	memcpy(&header, a_sDump.data(), sizeof(header));
+	if (header.Signature != CPageDump::s_uSignature || (header.Flags & CPageDump::s_uFlagDelta) == 0 || header.PageSize != CPageDump::s_uPageSize || header.PageCount > (a_sDump.size() - sizeof(header)) / sizeof(CPageDump::SPage))
+	{
+		printf("dumpInitMemory: bad header\n");
+		return false;
+	}
+	map<u64, const CPageDump::SPage*> mPage;
+	const CPageDump::SPage* pPage = reinterpret_cast<const CPageDump::SPage*>(a_sDump.data() + sizeof(header));
+	for (u64 i = 0; i < header.PageCount; i++)
+	{
+		if ((pPage[i].Flags & CPageDump::s_uPageFlagZero) != 0 || pPage[i].Offset > a_sDump.size() - CPageDump::s_uPageSize)
+		{
+			printf("dumpInitMemory: bad page at 0x%llX\n", static_cast<unsigned long long>(pPage[i].Address));
+			return false;
+		}
+		mPage[pPage[i].Address] = &pPage[i];
+	}
+	set<u64> sSlotPage;
+	for (u64 i = 0; i < static_cast<u64>(a_Parameter.EntryCount); i++)
+	{
+		u64 uAddress = getTargetAddress(a_Parameter, a_Layout, i);
+		u64 uPageAddress = uAddress / CPageDump::s_uPageSize * CPageDump::s_uPageSize;
+		sSlotPage.insert(uPageAddress);
+		map<u64, const CPageDump::SPage*>::const_iterator it = mPage.find(uPageAddress);
+		if (it == mPage.end())
+		{
+			printf("dumpInitMemory: page 0x%llX of entry %llu missing\n", static_cast<unsigned long long>(uPageAddress), static_cast<unsigned long long>(i));
+			return false;
+		}
+		u64 uValue = readU64(a_sDump, it->second->Offset + (uAddress - uPageAddress));
+		if (uValue != a_Parameter.LoopCount)
+		{
+			printf("dumpInitMemory: 0x%llX is %llu, expected %u\n", static_cast<unsigned long long>(uAddress), static_cast<unsigned long long>(uValue), a_Parameter.LoopCount);
+			return false;
+		}
+	}
+	if (sSlotPage.size() != mPage.size())
+	{
+		printf("dumpInitMemory: %llu pages changed, expected %llu\n", static_cast<unsigned long long>(mPage.size()), static_cast<unsigned long long>(sSlotPage.size()));
+		return false;
+	}
+	return true;
+}
+
+int UMain(int argc, UChar* argv[])
+{
+	// largeImageTest [--base <hex>] [--data-size N] [--bss-size N] <emuInit> <dumpInitMemory> <work directory>
+	SElfParameter parameter;
+	parameter.InstructionSet = kInstructionSetAArch64;
+	parameter.EntryCount = 64;
+	parameter.LoopCount = 16;
+	parameter.RelocationCount = 64;
+	parameter.BssInterval = 4;
+	// above 4 GiB, with a .bss that alone is larger than 4 GiB
+	parameter.BaseAddress = 0x200000000ULL;
+	parameter.DataSize = 0x100000;
+	parameter.BssSize = 0x110000000ULL;
+	vector<UString> vArg;
+	for (n32 i = 1; i < argc; i++)
+	{
+		if (UCscmp(argv[i], USTR("--base")) == 0 && i + 1 < argc)
+		{
+			parameter.BaseAddress = SToU64(argv[++i], 16);
+		}
+		else if (UCscmp(argv[i], USTR("--data-size")) == 0 && i + 1 < argc)
+		{
+			parameter.DataSize = SToU64(argv[++i]);
+		}
+		else if (UCscmp(argv[i], USTR("--bss-size")) == 0 && i + 1 < argc)
+		{
+			parameter.BssSize = SToU64(argv[++i]);
+		}
+		else if (argv[i][0] == USTR('-') && argv[i][1] == USTR('-'))
+		{
+			return 1;
+		}
+		else
+		{
+			vArg.push_back(argv[i]);
+		}
+	}
+	if (vArg.size() != 3)
+	{
+		return 1;
+	}
+	string sElf;
+	CElfGenerator generator;
+	SLayout layout;
+	if (!generator.Generate(parameter, sElf) || !getLayout(sElf, layout))
+	{
+		printf("generating the image failed\n");
+		return 1;
+	}
+	UString sBaseName = vArg[2] + USTR("/large.arm64");
+	UString sElfFileName = sBaseName + USTR(".so");
+	UString sEmuInitFileName = sBaseName + USTR(".emu.so");
+	UString sInPlaceFileName = sBaseName + USTR(".inplace.so");
+	if (!writeFile(sElfFileName, sElf))
+	{
+		printf("writing %s failed\n", UToU8(sElfFileName).c_str());
+		return 1;
+	}
+	printf("%llu byte image at 0x%llX, %llu byte .bss\n", static_cast<unsigned long long>(sElf.size()), static_cast<unsigned long long>(parameter.BaseAddress), static_cast<unsigned long long>(layout.BssSize));
+	string sOutput;
+	if (runTool(quote(vArg[0]) + USTR(" ") + quote(sElfFileName) + USTR(" ") + quote(sEmuInitFileName)) != 0 || !readFile(sEmuInitFileName, sOutput))
+	{
+		printf("emuInit failed\n");
+		return 1;
+	}
+	if (!checkEmuInit(parameter, layout, sElf, sOutput))
+	{
+		return 1;
+	}
+	// the positioned writes of --in-place have to give the same file
+	string sInPlaceOutput;
+	if (runTool(quote(vArg[0]) + USTR(" --in-place ") + quote(sElfFileName) + USTR(" ") + quote(sInPlaceFileName)) != 0 || !readFile(sInPlaceFileName, sInPlaceOutput))
+	{
+		printf("emuInit --in-place failed\n");
+		return 1;
+	}
+	if (sInPlaceOutput != sOutput)
+	{
+		printf("emuInit --in-place differs from emuInit\n");
+		return 1;
+	}
+	string sDump;
+	if (runTool(quote(vArg[1]) + USTR(" --format delta ") + quote(sElfFileName) + USTR(" ") + quote(sBaseName + USTR(".old.dump")) + USTR(" ") + quote(sBaseName + USTR(".new.dump"))) != 0 || !readFile(sBaseName + USTR(".new.dump"), sDump))
+	{
+		printf("dumpInitMemory failed\n");
+		return 1;
+	}
+	if (!checkDumpInitMemory(parameter, layout, sDump))
+	{
+		return 1;
+	}
+	printf("passed\n");
+	return 0;
+}
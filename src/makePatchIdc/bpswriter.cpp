@@ -0,0 +1,67 @@
+#include "bpswriter.h"
+
+CBpsWriter::CBpsWriter()
+	: m_uPosition(0)
+{
+}
+
+CBpsWriter::~CBpsWriter()
+{
+	if (m_fp != nullptr)
+	{
+		Close();
+	}
+}
+
+bool CBpsWriter::Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize)
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	if (a_uAddress > m_uPosition)
+	{
+		writeAction(kBpsActionSourceRead, a_uAddress - m_uPosition);
+	}
+	writeAction(kBpsActionTargetRead, a_uSize);
+	write(a_pData, static_cast<size_t>(a_uSize));
+	m_uPosition = a_uAddress + a_uSize;
+	return !m_bFailed;
+}
+
+bool CBpsWriter::Close()
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	if (m_uNewSize > m_uPosition)
+	{
+		writeAction(kBpsActionSourceRead, m_uNewSize - m_uPosition);
+		m_uPosition = m_uNewSize;
+	}
+	writeU32(m_OldCrc.GetValue());
+	writeU32(m_NewCrc.GetValue());
+	flush();
+	writeU32(m_WrittenCrc.GetValue());
+	return close();
+}
+
+bool CBpsWriter::begin()
+{
+	if (!open())
+	{
+		return false;
+	}
+	write(c_szBpsMagic, sizeof(c_szBpsMagic));
+	WriteVarInt(m_sBuffer, m_uOldSize);
+	WriteVarInt(m_sBuffer, m_uNewSize);
+	// no metadata
+	WriteVarInt(m_sBuffer, 0);
+	return true;
+}
+
+void CBpsWriter::writeAction(EBpsAction a_eAction, u64 a_uSize)
+{
+	WriteVarInt(m_sBuffer, (a_uSize - 1) << 2 | a_eAction);
+}
@@ -0,0 +1,20 @@
+#ifndef BPSWRITER_H_
+#define BPSWRITER_H_
+
+#include "patchwriter.h"
+
+// writes a BPS patch with SourceRead for the equal bytes and TargetRead for the runs, followed by the CRC-32 of the old file, the new file and the patch
+class CBpsWriter : public CPatchWriter
+{
+public:
+	CBpsWriter();
+	~CBpsWriter();
+	bool Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize);
+	bool Close();
+private:
+	bool begin();
+	void writeAction(EBpsAction a_eAction, u64 a_uSize);
+	u64 m_uPosition;
+};
+
+#endif	// BPSWRITER_H_
@@ -0,0 +1,84 @@
+#include "deltawriter.h"
+
+const u64 CDeltaWriter::s_uFillSizeMin = 8;
+
+CDeltaWriter::CDeltaWriter()
+	: m_uPosition(0)
+{
+}
+
+CDeltaWriter::~CDeltaWriter()
+{
+	if (m_fp != nullptr)
+	{
+		Close();
+	}
+}
+
+bool CDeltaWriter::Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize)
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	u64 uOffset = 0;
+	while (uOffset < a_uSize)
+	{
+		u64 uFillSize = GetFillSize(a_pData + uOffset, a_uSize - uOffset);
+		if (uFillSize >= s_uFillSizeMin)
+		{
+			writeRecord(a_uAddress + uOffset, a_pData + uOffset, uFillSize, true);
+			uOffset += uFillSize;
+			continue;
+		}
+		// literal bytes up to the next fill
+		u64 uEnd = uOffset + uFillSize;
+		while (uEnd < a_uSize)
+		{
+			uFillSize = GetFillSize(a_pData + uEnd, a_uSize - uEnd);
+			if (uFillSize >= s_uFillSizeMin)
+			{
+				break;
+			}
+			uEnd += uFillSize;
+		}
+		writeRecord(a_uAddress + uOffset, a_pData + uOffset, uEnd - uOffset, false);
+		uOffset = uEnd;
+	}
+	return !m_bFailed;
+}
+
+bool CDeltaWriter::Close()
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	WriteVarInt(m_sBuffer, 0);
+	WriteVarInt(m_sBuffer, 0);
+	writeU32(m_OldCrc.GetValue());
+	writeU32(m_NewCrc.GetValue());
+	flush();
+	writeU32(m_WrittenCrc.GetValue());
+	return close();
+}
+
+bool CDeltaWriter::begin()
+{
+	if (!open())
+	{
+		return false;
+	}
+	write(c_szDeltaMagic, sizeof(c_szDeltaMagic));
+	WriteVarInt(m_sBuffer, m_uOldSize);
+	WriteVarInt(m_sBuffer, m_uNewSize);
+	return true;
+}
+
+void CDeltaWriter::writeRecord(u64 a_uAddress, const u8* a_pData, u64 a_uSize, bool a_bFill)
+{
+	WriteVarInt(m_sBuffer, a_uAddress - m_uPosition);
+	WriteVarInt(m_sBuffer, a_uSize << 1 | (a_bFill ? 1 : 0));
+	write(a_pData, static_cast<size_t>(a_bFill ? 1 : a_uSize));
+	m_uPosition = a_uAddress + a_uSize;
+}
@@ -0,0 +1,22 @@
+#ifndef DELTAWRITER_H_
+#define DELTAWRITER_H_
+
+#include "patchwriter.h"
+
+// "EIDL", old size, new size, then records of bytes skipped, length << 1 | fill and the literal bytes or the fill byte, a 0, 0 record ends them and the CRC-32 of the old file, the new file and the patch follow
+class CDeltaWriter : public CPatchWriter
+{
+public:
+	CDeltaWriter();
+	~CDeltaWriter();
+	bool Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize);
+	bool Close();
+	// repeated bytes at least this long become a fill record
+	static const u64 s_uFillSizeMin;
+private:
+	bool begin();
+	void writeRecord(u64 a_uAddress, const u8* a_pData, u64 a_uSize, bool a_bFill);
+	u64 m_uPosition;
+};
+
+#endif	// DELTAWRITER_H_
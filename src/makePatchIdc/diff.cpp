@@ -0,0 +1,203 @@
+#include "diff.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DIFF_SSE2
+#endif
+
+const u64 CDiff::s_uChunkSize = 4 * 1024 * 1024;
+
+CDiff::CDiff()
+	: m_fpOld(nullptr)
+	, m_fpNew(nullptr)
+	, m_uOldSize(0)
+	, m_uNewSize(0)
+	, m_uGapSize(8)
+	, m_fChunk(nullptr)
+{
+}
+
+CDiff::~CDiff()
+{
+	Close();
+}
+
+bool CDiff::Open(const UChar* a_pOldFileName, const UChar* a_pNewFileName)
+{
+	Close();
+	m_fpOld = UFopen(a_pOldFileName, USTR("rb"), false);
+	if (m_fpOld == nullptr)
+	{
+		return false;
+	}
+	m_fpNew = UFopen(a_pNewFileName, USTR("rb"), false);
+	if (m_fpNew == nullptr)
+	{
+		Close();
+		return false;
+	}
+	Fseek(m_fpOld, 0, SEEK_END);
+	m_uOldSize = Ftell(m_fpOld);
+	Fseek(m_fpOld, 0, SEEK_SET);
+	Fseek(m_fpNew, 0, SEEK_END);
+	m_uNewSize = Ftell(m_fpNew);
+	Fseek(m_fpNew, 0, SEEK_SET);
+	return true;
+}
+
+void CDiff::Close()
+{
+	if (m_fpOld != nullptr)
+	{
+		fclose(m_fpOld);
+		m_fpOld = nullptr;
+	}
+	if (m_fpNew != nullptr)
+	{
+		fclose(m_fpNew);
+		m_fpNew = nullptr;
+	}
+	m_uOldSize = 0;
+	m_uNewSize = 0;
+}
+
+void CDiff::SetGapSize(u32 a_uGapSize)
+{
+	m_uGapSize = a_uGapSize;
+}
+
+void CDiff::SetChunkCallback(FChunk a_fChunk)
+{
+	m_fChunk = a_fChunk;
+}
+
+u64 CDiff::GetOldSize() const
+{
+	return m_uOldSize;
+}
+
+u64 CDiff::GetNewSize() const
+{
+	return m_uNewSize;
+}
+
+bool CDiff::Run(FRun a_fRun, void* a_pUserData)
+{
+	if (m_fpOld == nullptr || m_fpNew == nullptr)
+	{
+		return false;
+	}
+	m_vOld.resize(static_cast<size_t>(s_uChunkSize));
+	m_vNew.resize(static_cast<size_t>(s_uChunkSize));
+	u8* pOld = &*m_vOld.begin();
+	u8* pNew = &*m_vNew.begin();
+	u64 uSizeMin = min<u64>(m_uOldSize, m_uNewSize);
+	for (u64 uOffset = 0; uOffset < uSizeMin; uOffset += s_uChunkSize)
+	{
+		u64 uSize = min<u64>(s_uChunkSize, uSizeMin - uOffset);
+		if (fread(pOld, 1, static_cast<size_t>(uSize), m_fpOld) != uSize || fread(pNew, 1, static_cast<size_t>(uSize), m_fpNew) != uSize)
+		{
+			return false;
+		}
+		if (m_fChunk != nullptr)
+		{
+			m_fChunk(a_pUserData, uOffset, pOld, uSize, pNew, uSize);
+		}
+		u64 uBegin = FindDifferent(pOld, pNew, uSize);
+		while (uBegin < uSize)
+		{
+			u64 uEnd = uBegin;
+			for (;;)
+			{
+				uEnd += FindEqual(pOld + uEnd, pNew + uEnd, uSize - uEnd);
+				u64 uNext = uEnd + FindDifferent(pOld + uEnd, pNew + uEnd, uSize - uEnd);
+				if (uNext == uSize || uNext - uEnd >= m_uGapSize)
+				{
+					break;
+				}
+				uEnd = uNext;
+			}
+			if (!a_fRun(a_pUserData, uOffset + uBegin, pNew + uBegin, uEnd - uBegin))
+			{
+				return false;
+			}
+			uBegin = uEnd + FindDifferent(pOld + uEnd, pNew + uEnd, uSize - uEnd);
+		}
+	}
+	for (u64 uOffset = uSizeMin; uOffset < m_uNewSize; uOffset += s_uChunkSize)
+	{
+		u64 uSize = min<u64>(s_uChunkSize, m_uNewSize - uOffset);
+		if (fread(pNew, 1, static_cast<size_t>(uSize), m_fpNew) != uSize)
+		{
+			return false;
+		}
+		if (m_fChunk != nullptr)
+		{
+			m_fChunk(a_pUserData, uOffset, nullptr, 0, pNew, uSize);
+		}
+		if (!a_fRun(a_pUserData, uOffset, pNew, uSize))
+		{
+			return false;
+		}
+	}
+	// the rest of a longer old file only matters to checksums
+	for (u64 uOffset = uSizeMin; m_fChunk != nullptr && uOffset < m_uOldSize; uOffset += s_uChunkSize)
+	{
+		u64 uSize = min<u64>(s_uChunkSize, m_uOldSize - uOffset);
+		if (fread(pOld, 1, static_cast<size_t>(uSize), m_fpOld) != uSize)
+		{
+			return false;
+		}
+		m_fChunk(a_pUserData, uOffset, pOld, uSize, nullptr, 0);
+	}
+	return true;
+}
+
+u64 CDiff::FindDifferent(const u8* a_pOld, const u8* a_pNew, u64 a_uSize)
+{
+	u64 i = 0;
+#ifdef DIFF_SSE2
+	for (; i + 16 <= a_uSize; i += 16)
+	{
+		u32 uMask = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pOld + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pNew + i)))));
+		if (uMask != 0xFFFF)
+		{
+			break;
+		}
+	}
+#else
+	for (; i + 8 <= a_uSize; i += 8)
+	{
+		u64 uOld = 0;
+		u64 uNew = 0;
+		memcpy(&uOld, a_pOld + i, 8);
+		memcpy(&uNew, a_pNew + i, 8);
+		if (uOld != uNew)
+		{
+			break;
+		}
+	}
+#endif
+	for (; i < a_uSize && a_pOld[i] == a_pNew[i]; i++)
+	{
+	}
+	return i;
+}
+
+u64 CDiff::FindEqual(const u8* a_pOld, const u8* a_pNew, u64 a_uSize)
+{
+	u64 i = 0;
+#ifdef DIFF_SSE2
+	for (; i + 16 <= a_uSize; i += 16)
+	{
+		u32 uMask = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pOld + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pNew + i)))));
+		if (uMask != 0)
+		{
+			break;
+		}
+	}
+#endif
+	for (; i < a_uSize && a_pOld[i] != a_pNew[i]; i++)
+	{
+	}
+	return i;
+}
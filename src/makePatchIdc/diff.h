@@ -0,0 +1,42 @@
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <sdw.h>
+
+// compares two files chunk by chunk and reports the runs of the new file that differ from the old one, bytes past the end of the old file always differ
+class CDiff
+{
+public:
+	// pieces of one run are reported in order and back to back, a run may be split at chunk boundaries
+	typedef bool (*FRun)(void* a_pUserData, u64 a_uOffset, const u8* a_pData, u64 a_uSize);
+	// sees every chunk of both files before its runs, either side is empty past the end of its file
+	typedef void (*FChunk)(void* a_pUserData, u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize);
+	CDiff();
+	~CDiff();
+	bool Open(const UChar* a_pOldFileName, const UChar* a_pNewFileName);
+	void Close();
+	// equal stretches shorter than this are kept inside the surrounding run
+	void SetGapSize(u32 a_uGapSize);
+	u64 GetOldSize() const;
+	u64 GetNewSize() const;
+	void SetChunkCallback(FChunk a_fChunk);
+	bool Run(FRun a_fRun, void* a_pUserData);
+	static const u64 s_uChunkSize;
+	// offset of the first differing byte, a_uSize if none
+	static u64 FindDifferent(const u8* a_pOld, const u8* a_pNew, u64 a_uSize);
+	// offset of the first equal byte, a_uSize if none
+	static u64 FindEqual(const u8* a_pOld, const u8* a_pNew, u64 a_uSize);
+private:
+	CDiff(const CDiff&);
+	CDiff& operator=(const CDiff&);
+	FILE* m_fpOld;
+	FILE* m_fpNew;
+	u64 m_uOldSize;
+	u64 m_uNewSize;
+	u32 m_uGapSize;
+	FChunk m_fChunk;
+	vector<u8> m_vOld;
+	vector<u8> m_vNew;
+};
+
+#endif	// DIFF_H_
@@ -0,0 +1,169 @@
+#include "idcwriter.h"
+#include <cstdarg>
+
+const u64 CIdcWriter::s_uTableRunSize = 32;
+const u64 CIdcWriter::s_uTableLineSize = 64;
+
+CIdcWriter::CIdcWriter()
+	: m_uRunAddress(0)
+	, m_bRunTable(false)
+{
+}
+
+CIdcWriter::~CIdcWriter()
+{
+	Close();
+}
+
+bool CIdcWriter::Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize)
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	if (!m_vRun.empty() && a_uAddress != m_uRunAddress + m_vRun.size())
+	{
+		writeRun(true);
+	}
+	if (m_vRun.empty())
+	{
+		m_uRunAddress = a_uAddress;
+	}
+	m_vRun.insert(m_vRun.end(), a_pData, a_pData + a_uSize);
+	// a long run is written as it grows, only the partial table line is kept
+	if (m_vRun.size() >= s_uBufferSize)
+	{
+		writeRun(false);
+	}
+	if (m_sBuffer.size() >= s_uBufferSize)
+	{
+		flush();
+	}
+	return !m_bFailed;
+}
+
+bool CIdcWriter::Close()
+{
+	if (m_fp == nullptr)
+	{
+		return !m_bFailed;
+	}
+	if (!m_vRun.empty())
+	{
+		writeRun(true);
+	}
+	print("\tmsg(\"patch over!\");\r\n");
+	print("}\r\n");
+	return close();
+}
+
+bool CIdcWriter::begin()
+{
+	if (!open())
+	{
+		return false;
+	}
+	print("#include <idc.idc>\r\n");
+	print("\r\n");
+	print("static patch_hex(ea, s)\r\n");
+	print("{\r\n");
+	print("\tauto i;\r\n");
+	print("\tfor (i = 0; i < strlen(s); i = i + 2)\r\n");
+	print("\t{\r\n");
+	print("\t\tpatch_byte(ea + i / 2, xtol(substr(s, i, i + 2)));\r\n");
+	print("\t}\r\n");
+	print("}\r\n");
+	print("\r\n");
+	print("static main()\r\n");
+	print("{\r\n");
+	return true;
+}
+
+void CIdcWriter::writeRun(bool a_bFinal)
+{
+	u64 uSize = m_vRun.size();
+	const u8* pData = m_vRun.empty() ? nullptr : &*m_vRun.begin();
+	if (!m_bRunTable && uSize < s_uTableRunSize)
+	{
+		// aligned values as wide as possible, the database is little endian like the targets
+		u64 uAddress = m_uRunAddress;
+		u64 uOffset = 0;
+		while (uOffset < uSize)
+		{
+			u32 uValueSize = 8;
+			while (uValueSize > 1 && (uAddress % uValueSize != 0 || uSize - uOffset < uValueSize))
+			{
+				uValueSize /= 2;
+			}
+			writeValue(uAddress, pData + uOffset, uValueSize);
+			uAddress += uValueSize;
+			uOffset += uValueSize;
+		}
+		m_vRun.clear();
+		return;
+	}
+	m_bRunTable = true;
+	u64 uTableSize = a_bFinal ? uSize : uSize / s_uTableLineSize * s_uTableLineSize;
+	writeTable(m_uRunAddress, pData, uTableSize);
+	m_vRun.erase(m_vRun.begin(), m_vRun.begin() + static_cast<size_t>(uTableSize));
+	m_uRunAddress += uTableSize;
+	if (a_bFinal)
+	{
+		m_bRunTable = false;
+	}
+}
+
+void CIdcWriter::writeValue(u64 a_uAddress, const u8* a_pData, u32 a_uSize)
+{
+	u64 uValue = 0;
+	memcpy(&uValue, a_pData, a_uSize);
+	switch (a_uSize)
+	{
+	case 1:
+		print("\tpatch_byte(0x%llX, 0x%02llX);\r\n", static_cast<unsigned long long>(a_uAddress), static_cast<unsigned long long>(uValue));
+		break;
+	case 2:
+		print("\tpatch_word(0x%llX, 0x%04llX);\r\n", static_cast<unsigned long long>(a_uAddress), static_cast<unsigned long long>(uValue));
+		break;
+	case 4:
+		print("\tpatch_dword(0x%llX, 0x%08llX);\r\n", static_cast<unsigned long long>(a_uAddress), static_cast<unsigned long long>(uValue));
+		break;
+	case 8:
+		print("\tpatch_qword(0x%llX, 0x%016llX);\r\n", static_cast<unsigned long long>(a_uAddress), static_cast<unsigned long long>(uValue));
+		break;
+	}
+}
+
+void CIdcWriter::writeTable(u64 a_uAddress, const u8* a_pData, u64 a_uSize)
+{
+	static const char c_Hex[] = "0123456789ABCDEF";
+	for (u64 uOffset = 0; uOffset < a_uSize; uOffset += s_uTableLineSize)
+	{
+		u64 uLineSize = min<u64>(s_uTableLineSize, a_uSize - uOffset);
+		print("\tpatch_hex(0x%llX, \"", static_cast<unsigned long long>(a_uAddress + uOffset));
+		for (u64 i = 0; i < uLineSize; i++)
+		{
+			u8 uByte = a_pData[uOffset + i];
+			m_sBuffer.push_back(c_Hex[uByte >> 4]);
+			m_sBuffer.push_back(c_Hex[uByte & 0xF]);
+		}
+		m_sBuffer.append("\");\r\n");
+		if (m_sBuffer.size() >= s_uBufferSize)
+		{
+			flush();
+		}
+	}
+}
+
+void CIdcWriter::print(const char* a_pFormat, ...)
+{
+	char szLine[256] = {};
+	va_list vaList;
+	va_start(vaList, a_pFormat);
+	n32 nSize = vsnprintf(szLine, sizeof(szLine), a_pFormat, vaList);
+	va_end(vaList);
+	if (nSize > 0)
+	{
+		m_sBuffer.append(szLine, min<size_t>(static_cast<size_t>(nSize), sizeof(szLine) - 1));
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef IDCWRITER_H_
+#define IDCWRITER_H_
+
+#include "patchwriter.h"
+
+// writes an IDA script patching the given runs, short runs become patch_byte/word/dword/qword calls and long runs lines of a hex table, the file is only created by the first run
+class CIdcWriter : public CPatchWriter
+{
+public:
+	CIdcWriter();
+	~CIdcWriter();
+	bool Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize);
+	bool Close();
+	// runs at least this long use the hex table
+	static const u64 s_uTableRunSize;
+	static const u64 s_uTableLineSize;
+private:
+	bool begin();
+	void writeRun(bool a_bFinal);
+	void writeValue(u64 a_uAddress, const u8* a_pData, u32 a_uSize);
+	void writeTable(u64 a_uAddress, const u8* a_pData, u64 a_uSize);
+	void print(const char* a_pFormat, ...);
+	u64 m_uRunAddress;
+	vector<u8> m_vRun;
+	bool m_bRunTable;
+};
+
+#endif	// IDCWRITER_H_
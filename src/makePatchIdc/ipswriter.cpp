@@ -0,0 +1,134 @@
+#include "ipswriter.h"
+
+const u64 CIpsWriter::s_uFillSizeMin = 8;
+
+CIpsWriter::CIpsWriter()
+	: m_uEndPreviousByte(0)
+{
+}
+
+CIpsWriter::~CIpsWriter()
+{
+	if (m_fp != nullptr)
+	{
+		Close();
+	}
+}
+
+void CIpsWriter::Update(u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize)
+{
+	CPatchWriter::Update(a_uOffset, a_pOld, a_uOldSize, a_pNew, a_uNewSize);
+	if (c_uIpsEndOffset - 1 >= a_uOffset && c_uIpsEndOffset - 1 < a_uOffset + a_uNewSize)
+	{
+		m_uEndPreviousByte = a_pNew[c_uIpsEndOffset - 1 - a_uOffset];
+	}
+}
+
+bool CIpsWriter::Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize)
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	if (a_uAddress + a_uSize - 1 > c_uIpsOffsetMax)
+	{
+		if (!m_bFailed)
+		{
+			printf("offset 0x%llX is out of the IPS range\n", static_cast<unsigned long long>(a_uAddress + a_uSize - 1));
+		}
+		m_bFailed = true;
+		return false;
+	}
+	u64 uOffset = 0;
+	while (uOffset < a_uSize)
+	{
+		u64 uFillSize = min<u64>(GetFillSize(a_pData + uOffset, a_uSize - uOffset), c_uIpsRecordSizeMax);
+		if (uFillSize >= s_uFillSizeMin && a_uAddress + uOffset != c_uIpsEndOffset)
+		{
+			writeRecord(a_uAddress + uOffset, a_pData + uOffset, uFillSize, true);
+			uOffset += uFillSize;
+			continue;
+		}
+		// a record moved in front of the end marker carries one more byte
+		u64 uRecordSizeMax = a_uAddress + uOffset == c_uIpsEndOffset ? c_uIpsRecordSizeMax - 1 : c_uIpsRecordSizeMax;
+		u64 uEnd = uOffset + uFillSize;
+		while (uEnd < a_uSize && uEnd - uOffset < uRecordSizeMax)
+		{
+			uFillSize = GetFillSize(a_pData + uEnd, a_uSize - uEnd);
+			if (uFillSize >= s_uFillSizeMin)
+			{
+				break;
+			}
+			uEnd += uFillSize;
+		}
+		uEnd = min<u64>(uEnd, uOffset + uRecordSizeMax);
+		writeRecord(a_uAddress + uOffset, a_pData + uOffset, uEnd - uOffset, false);
+		uOffset = uEnd;
+	}
+	return !m_bFailed;
+}
+
+bool CIpsWriter::Close()
+{
+	if (m_fp == nullptr && !begin())
+	{
+		return false;
+	}
+	write(c_szIpsEnd, sizeof(c_szIpsEnd));
+	if (m_uNewSize < m_uOldSize)
+	{
+		if (m_uNewSize > c_uIpsOffsetMax)
+		{
+			printf("size 0x%llX is out of the IPS range\n", static_cast<unsigned long long>(m_uNewSize));
+			m_bFailed = true;
+		}
+		writeU24(m_uNewSize);
+	}
+	return close();
+}
+
+bool CIpsWriter::begin()
+{
+	if (!open())
+	{
+		return false;
+	}
+	write(c_szIpsMagic, sizeof(c_szIpsMagic));
+	return true;
+}
+
+void CIpsWriter::writeRecord(u64 a_uAddress, const u8* a_pData, u64 a_uSize, bool a_bFill)
+{
+	if (a_uAddress == c_uIpsEndOffset)
+	{
+		writeU24(a_uAddress - 1);
+		writeU16(a_uSize + 1);
+		write(&m_uEndPreviousByte, 1);
+		write(a_pData, static_cast<size_t>(a_uSize));
+		return;
+	}
+	writeU24(a_uAddress);
+	if (a_bFill)
+	{
+		writeU16(0);
+		writeU16(a_uSize);
+		write(a_pData, 1);
+	}
+	else
+	{
+		writeU16(a_uSize);
+		write(a_pData, static_cast<size_t>(a_uSize));
+	}
+}
+
+void CIpsWriter::writeU24(u64 a_uValue)
+{
+	u8 uData[3] = { static_cast<u8>(a_uValue >> 16), static_cast<u8>(a_uValue >> 8), static_cast<u8>(a_uValue) };
+	write(uData, sizeof(uData));
+}
+
+void CIpsWriter::writeU16(u64 a_uValue)
+{
+	u8 uData[2] = { static_cast<u8>(a_uValue >> 8), static_cast<u8>(a_uValue) };
+	write(uData, sizeof(uData));
+}
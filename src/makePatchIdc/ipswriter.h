@@ -0,0 +1,26 @@
+#ifndef IPSWRITER_H_
+#define IPSWRITER_H_
+
+#include "patchwriter.h"
+
+// writes IPS records with RLE for repeated bytes, a shorter new file gets the truncation extension after "EOF", offsets stop at 16 MiB
+class CIpsWriter : public CPatchWriter
+{
+public:
+	CIpsWriter();
+	~CIpsWriter();
+	void Update(u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize);
+	bool Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize);
+	bool Close();
+	// repeated bytes at least this long become an RLE record
+	static const u64 s_uFillSizeMin;
+private:
+	bool begin();
+	void writeRecord(u64 a_uAddress, const u8* a_pData, u64 a_uSize, bool a_bFill);
+	void writeU24(u64 a_uValue);
+	void writeU16(u64 a_uValue);
+	// the new byte in front of the offset that reads as "EOF", a record starting there begins one byte earlier
+	u8 m_uEndPreviousByte;
+};
+
+#endif	// IPSWRITER_H_
@@ -1,72 +1,45 @@
 #include <sdw.h>
+#include "diff.h"
+#include "patchformat.h"
+#include "patchwriter.h"
 
 int UMain(int argc, UChar* argv[])
 {
-	if (argc != 4)
+	EPatchFormat ePatchFormat = kPatchFormatIdc;
+	vector<UString> vArg;
+	for (n32 i = 1; i < argc; i++)
 	{
-		return 1;
-	}
-	FILE* fp = UFopen(argv[1], USTR("rb"), false);
-	if (fp == nullptr)
-	{
-		return 1;
-	}
-	fseek(fp, 0, SEEK_END);
-	u32 uOldSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	vector<u8> vOld(uOldSize);
-	if (uOldSize != 0)
-	{
-		fread(&*vOld.begin(), 1, uOldSize, fp);
+		if (UCscmp(argv[i], USTR("--format")) == 0 && i + 1 < argc)
+		{
+			if (!ParsePatchFormat(argv[++i], ePatchFormat))
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			vArg.push_back(argv[i]);
+		}
 	}
-	fclose(fp);
-	fp = UFopen(argv[2], USTR("rb"), false);
-	if (fp == nullptr)
+	if (vArg.size() != 3)
 	{
 		return 1;
 	}
-	fseek(fp, 0, SEEK_END);
-	u32 uNewSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	vector<u8> vNew(uNewSize);
-	if (uNewSize != 0)
-	{
-		fread(&*vNew.begin(), 1, uNewSize, fp);
-	}
-	fclose(fp);
-	if (uNewSize <= uOldSize && uNewSize != 0 && memcmp(&*vNew.begin(), &*vOld.begin(), uNewSize) == 0)
-	{
-		return 0;
-	}
-	fp = UFopen(argv[3], USTR("wb"), false);
-	if (fp == nullptr)
+	CDiff diff;
+	if (!diff.Open(vArg[0].c_str(), vArg[1].c_str()))
 	{
 		return 1;
 	}
-	fprintf(fp, "#include <idc.idc>\r\n");
-	fprintf(fp, "\r\n");
-	fprintf(fp, "static main()\r\n");
-	fprintf(fp, "{\r\n");
-	u32 uSizeMin = min<u32>(uOldSize, uNewSize);
-	if (uSizeMin != 0)
-	{
-		for (u32 i = 0; i < uSizeMin; i++)
-		{
-			if (vNew[i] != vOld[i])
-			{
-				fprintf(fp, "\tpatch_byte(0x%X, 0x%02X);\r\n", i, vNew[i]);
-			}
-		}
-	}
-	if (uNewSize > uSizeMin)
+	CPatchWriter* pWriter = CPatchWriter::Create(ePatchFormat);
+	pWriter->SetFileName(vArg[2].c_str());
+	pWriter->SetSize(diff.GetOldSize(), diff.GetNewSize());
+	if (ePatchFormat != kPatchFormatIdc)
 	{
-		for (u32 i = uSizeMin; i < uNewSize; i++)
-		{
-			fprintf(fp, "\tpatch_byte(0x%X, 0x%02X);\r\n", i, vNew[i]);
-		}
+		diff.SetChunkCallback(&CPatchWriter::OnChunk);
 	}
-	fprintf(fp, "\tmsg(\"patch over!\");\r\n");
-	fprintf(fp, "}\r\n");
-	fclose(fp);
-	return 0;
+	bool bResult = diff.Run(&CPatchWriter::OnRun, pWriter);
+	// nothing differs, no script is written, the binary formats always write a patch
+	bResult = pWriter->Close() && bResult;
+	delete pWriter;
+	return bResult ? 0 : 1;
 }
@@ -0,0 +1,133 @@
+#include "patchwriter.h"
+#include "bpswriter.h"
+#include "deltawriter.h"
+#include "idcwriter.h"
+#include "ipswriter.h"
+
+const size_t CPatchWriter::s_uBufferSize = 1024 * 1024;
+
+CPatchWriter::CPatchWriter()
+	: m_fp(nullptr)
+	, m_bFailed(false)
+	, m_uOldSize(0)
+	, m_uNewSize(0)
+{
+}
+
+CPatchWriter::~CPatchWriter()
+{
+	if (m_fp != nullptr)
+	{
+		fclose(m_fp);
+	}
+}
+
+void CPatchWriter::SetFileName(const UChar* a_pFileName)
+{
+	m_sFileName = a_pFileName;
+}
+
+void CPatchWriter::SetSize(u64 a_uOldSize, u64 a_uNewSize)
+{
+	m_uOldSize = a_uOldSize;
+	m_uNewSize = a_uNewSize;
+}
+
+void CPatchWriter::Update(u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize)
+{
+	m_OldCrc.Update(a_pOld, static_cast<size_t>(a_uOldSize));
+	m_NewCrc.Update(a_pNew, static_cast<size_t>(a_uNewSize));
+}
+
+bool CPatchWriter::IsOpened() const
+{
+	return m_fp != nullptr;
+}
+
+CPatchWriter* CPatchWriter::Create(EPatchFormat a_ePatchFormat)
+{
+	switch (a_ePatchFormat)
+	{
+	case kPatchFormatIdc:
+		return new CIdcWriter;
+	case kPatchFormatDelta:
+		return new CDeltaWriter;
+	case kPatchFormatIps:
+		return new CIpsWriter;
+	case kPatchFormatBps:
+		return new CBpsWriter;
+	default:
+		return nullptr;
+	}
+}
+
+bool CPatchWriter::OnRun(void* a_pUserData, u64 a_uOffset, const u8* a_pData, u64 a_uSize)
+{
+	return static_cast<CPatchWriter*>(a_pUserData)->Write(a_uOffset, a_pData, a_uSize);
+}
+
+void CPatchWriter::OnChunk(void* a_pUserData, u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize)
+{
+	static_cast<CPatchWriter*>(a_pUserData)->Update(a_uOffset, a_pOld, a_uOldSize, a_pNew, a_uNewSize);
+}
+
+u64 CPatchWriter::GetFillSize(const u8* a_pData, u64 a_uSize)
+{
+	u64 i = 1;
+	for (; i < a_uSize && a_pData[i] == a_pData[0]; i++)
+	{
+	}
+	return min<u64>(i, a_uSize);
+}
+
+bool CPatchWriter::open()
+{
+	m_fp = UFopen(m_sFileName.c_str(), USTR("wb"), false);
+	if (m_fp == nullptr)
+	{
+		m_bFailed = true;
+		return false;
+	}
+	m_sBuffer.reserve(s_uBufferSize + 256);
+	return true;
+}
+
+void CPatchWriter::write(const void* a_pData, size_t a_uSize)
+{
+	m_sBuffer.append(static_cast<const char*>(a_pData), a_uSize);
+	if (m_sBuffer.size() >= s_uBufferSize)
+	{
+		flush();
+	}
+}
+
+void CPatchWriter::writeU32(u32 a_uValue)
+{
+	u8 uData[4] = { static_cast<u8>(a_uValue), static_cast<u8>(a_uValue >> 8), static_cast<u8>(a_uValue >> 16), static_cast<u8>(a_uValue >> 24) };
+	write(uData, sizeof(uData));
+}
+
+bool CPatchWriter::flush()
+{
+	if (!m_sBuffer.empty())
+	{
+		m_WrittenCrc.Update(m_sBuffer.data(), m_sBuffer.size());
+		if (fwrite(m_sBuffer.data(), 1, m_sBuffer.size(), m_fp) != m_sBuffer.size())
+		{
+			m_bFailed = true;
+		}
+		m_sBuffer.clear();
+	}
+	return !m_bFailed;
+}
+
+bool CPatchWriter::close()
+{
+	flush();
+	if (fclose(m_fp) != 0)
+	{
+		m_bFailed = true;
+	}
+	m_fp = nullptr;
+	return !m_bFailed;
+}
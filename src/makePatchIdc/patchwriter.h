@@ -0,0 +1,48 @@
+#ifndef PATCHWRITER_H_
+#define PATCHWRITER_H_
+
+#include <sdw.h>
+#include "crc32.h"
+#include "patchformat.h"
+
+// one output format of makePatchIdc, fed with the chunks and runs of CDiff, output is buffered and written 1 MiB at a time
+class CPatchWriter
+{
+public:
+	CPatchWriter();
+	virtual ~CPatchWriter();
+	void SetFileName(const UChar* a_pFileName);
+	void SetSize(u64 a_uOldSize, u64 a_uNewSize);
+	virtual void Update(u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize);
+	// pieces continuing the previous one belong to the same run
+	virtual bool Write(u64 a_uAddress, const u8* a_pData, u64 a_uSize) = 0;
+	virtual bool Close() = 0;
+	bool IsOpened() const;
+	static CPatchWriter* Create(EPatchFormat a_ePatchFormat);
+	static bool OnRun(void* a_pUserData, u64 a_uOffset, const u8* a_pData, u64 a_uSize);
+	static void OnChunk(void* a_pUserData, u64 a_uOffset, const u8* a_pOld, u64 a_uOldSize, const u8* a_pNew, u64 a_uNewSize);
+	// leading bytes equal to the first one
+	static u64 GetFillSize(const u8* a_pData, u64 a_uSize);
+	static const size_t s_uBufferSize;
+protected:
+	bool open();
+	void write(const void* a_pData, size_t a_uSize);
+	void writeU32(u32 a_uValue);
+	bool flush();
+	bool close();
+	UString m_sFileName;
+	FILE* m_fp;
+	bool m_bFailed;
+	string m_sBuffer;
+	u64 m_uOldSize;
+	u64 m_uNewSize;
+	CCrc32 m_OldCrc;
+	CCrc32 m_NewCrc;
+	// every byte flushed so far
+	CCrc32 m_WrittenCrc;
+private:
+	CPatchWriter(const CPatchWriter&);
+	CPatchWriter& operator=(const CPatchWriter&);
+};
+
+#endif	// PATCHWRITER_H_
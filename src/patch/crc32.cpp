@@ -0,0 +1,50 @@
+#include "crc32.h"
+
+CCrc32::CCrc32()
+	: m_uValue(0xFFFFFFFF)
+{
+}
+
+void CCrc32::Reset()
+{
+	m_uValue = 0xFFFFFFFF;
+}
+
+void CCrc32::Update(const void* a_pData, size_t a_uSize)
+{
+	const u32* pTable = getTable();
+	const u8* pData = static_cast<const u8*>(a_pData);
+	u32 uValue = m_uValue;
+	for (size_t i = 0; i < a_uSize; i++)
+	{
+		uValue = pTable[(uValue ^ pData[i]) & 0xFF] ^ (uValue >> 8);
+	}
+	m_uValue = uValue;
+}
+
+u32 CCrc32::GetValue() const
+{
+	return ~m_uValue;
+}
+
+const u32* CCrc32::getTable()
+{
+	struct STable
+	{
+		STable()
+		{
+			for (u32 i = 0; i < 256; i++)
+			{
+				u32 uValue = i;
+				for (n32 j = 0; j < 8; j++)
+				{
+					uValue = (uValue & 1) != 0 ? 0xEDB88320 ^ (uValue >> 1) : uValue >> 1;
+				}
+				Value[i] = uValue;
+			}
+		}
+		u32 Value[256];
+	};
+	static const STable c_Table;
+	return c_Table.Value;
+}
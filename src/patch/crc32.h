@@ -0,0 +1,19 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <sdw.h>
+
+// the zlib CRC-32 used by BPS, updated chunk by chunk
+class CCrc32
+{
+public:
+	CCrc32();
+	void Reset();
+	void Update(const void* a_pData, size_t a_uSize);
+	u32 GetValue() const;
+private:
+	static const u32* getTable();
+	u32 m_uValue;
+};
+
+#endif	// CRC32_H_
@@ -0,0 +1,104 @@
+#include "patchformat.h"
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+const char c_szDeltaMagic[4] = { 'E', 'I', 'D', 'L' };
+const char c_szIpsMagic[5] = { 'P', 'A', 'T', 'C', 'H' };
+const char c_szIpsEnd[3] = { 'E', 'O', 'F' };
+const char c_szBpsMagic[4] = { 'B', 'P', 'S', '1' };
+
+bool ParsePatchFormat(const UString& a_sName, EPatchFormat& a_ePatchFormat)
+{
+	if (a_sName == USTR("idc"))
+	{
+		a_ePatchFormat = kPatchFormatIdc;
+	}
+	else if (a_sName == USTR("delta"))
+	{
+		a_ePatchFormat = kPatchFormatDelta;
+	}
+	else if (a_sName == USTR("ips"))
+	{
+		a_ePatchFormat = kPatchFormatIps;
+	}
+	else if (a_sName == USTR("bps"))
+	{
+		a_ePatchFormat = kPatchFormatBps;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+EPatchFormat DetectPatchFormat(const u8* a_pData, u64 a_uSize)
+{
+	if (a_uSize >= sizeof(c_szDeltaMagic) && memcmp(a_pData, c_szDeltaMagic, sizeof(c_szDeltaMagic)) == 0)
+	{
+		return kPatchFormatDelta;
+	}
+	if (a_uSize >= sizeof(c_szIpsMagic) && memcmp(a_pData, c_szIpsMagic, sizeof(c_szIpsMagic)) == 0)
+	{
+		return kPatchFormatIps;
+	}
+	if (a_uSize >= sizeof(c_szBpsMagic) && memcmp(a_pData, c_szBpsMagic, sizeof(c_szBpsMagic)) == 0)
+	{
+		return kPatchFormatBps;
+	}
+	return kPatchFormatUnknown;
+}
+
+void WriteVarInt(string& a_sBuffer, u64 a_uValue)
+{
+	for (;;)
+	{
+		u8 uByte = a_uValue & 0x7F;
+		a_uValue >>= 7;
+		if (a_uValue == 0)
+		{
+			a_sBuffer.push_back(static_cast<char>(uByte | 0x80));
+			break;
+		}
+		a_sBuffer.push_back(static_cast<char>(uByte));
+		a_uValue--;
+	}
+}
+
+bool ReadVarInt(const u8* a_pData, u64 a_uSize, u64& a_uOffset, u64& a_uValue)
+{
+	a_uValue = 0;
+	u64 uShift = 1;
+	for (n32 i = 0; i < 10; i++)
+	{
+		if (a_uOffset >= a_uSize)
+		{
+			return false;
+		}
+		u8 uByte = a_pData[a_uOffset++];
+		a_uValue += (uByte & 0x7F) * uShift;
+		if ((uByte & 0x80) != 0)
+		{
+			return true;
+		}
+		uShift <<= 7;
+		a_uValue += uShift;
+	}
+	return false;
+}
+
+bool SetFileSize(FILE* a_fpFile, u64 a_uSize)
+{
+	if (fflush(a_fpFile) != 0)
+	{
+		return false;
+	}
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return _chsize_s(_fileno(a_fpFile), static_cast<n64>(a_uSize)) == 0;
+#else
+	return ftruncate(fileno(a_fpFile), static_cast<off_t>(a_uSize)) == 0;
+#endif
+}
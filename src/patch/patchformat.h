@@ -0,0 +1,47 @@
+#ifndef PATCHFORMAT_H_
+#define PATCHFORMAT_H_
+
+#include <sdw.h>
+
+enum EPatchFormat
+{
+	// IDA script, cannot be applied outside IDA
+	kPatchFormatIdc,
+	// our own run-length delta
+	kPatchFormatDelta,
+	kPatchFormatIps,
+	kPatchFormatBps,
+	kPatchFormatUnknown
+};
+
+// idc, delta, ips or bps
+bool ParsePatchFormat(const UString& a_sName, EPatchFormat& a_ePatchFormat);
+
+EPatchFormat DetectPatchFormat(const u8* a_pData, u64 a_uSize);
+
+// the BPS number encoding, the delta format uses it too
+void WriteVarInt(string& a_sBuffer, u64 a_uValue);
+
+bool ReadVarInt(const u8* a_pData, u64 a_uSize, u64& a_uOffset, u64& a_uValue);
+
+bool SetFileSize(FILE* a_fpFile, u64 a_uSize);
+
+extern const char c_szDeltaMagic[4];
+extern const char c_szIpsMagic[5];
+extern const char c_szIpsEnd[3];
+extern const char c_szBpsMagic[4];
+
+// offset 0x454F46 reads as the IPS end marker
+const u64 c_uIpsEndOffset = 0x454F46;
+const u64 c_uIpsOffsetMax = 0xFFFFFF;
+const u64 c_uIpsRecordSizeMax = 0xFFFF;
+
+enum EBpsAction
+{
+	kBpsActionSourceRead,
+	kBpsActionTargetRead,
+	kBpsActionSourceCopy,
+	kBpsActionTargetCopy
+};
+
+#endif	// PATCHFORMAT_H_